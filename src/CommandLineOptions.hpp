@@ -0,0 +1,76 @@
+#ifndef COMMAND_LINE_OPTIONS
+#define COMMAND_LINE_OPTIONS
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*
+ * Optional command line arguments, shared by all the binaries.
+ *
+ * Options follow the positional arguments and are given in the form
+ * "--name value", or just "--name" for boolean flags.
+ */
+class CommandLineOptions {
+    private:
+        std::map<std::string, std::string> values;
+        mutable std::set<std::string> used;
+
+    public:
+        // Number of positional arguments (including the program name): the first option ends them.
+        int positionalNum;
+
+        CommandLineOptions(int argc, const char * argv[]) {
+            std::string name;
+
+            this->positionalNum = argc;
+            for (int i = 1; i < argc; i++) {
+                if (std::string(argv[i]).rfind("--", 0) == 0) {
+                    this->positionalNum = i;
+                    break;
+                }
+            }
+
+            for (int i = this->positionalNum; i < argc; i++) {
+                name = std::string(argv[i]).substr(2);
+                // A flag is an option not followed by a value.
+                if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                    this->values[name] = argv[i + 1];
+                    i++;
+                } else {
+                    this->values[name] = "";
+                }
+            }
+        }
+
+        bool has(const std::string &name) const {
+            this->used.insert(name);
+            return this->values.count(name) > 0;
+        }
+
+        std::string getString(const std::string &name, const std::string &defaultValue) const {
+            return this->has(name) ? this->values.at(name) : defaultValue;
+        }
+
+        double getDouble(const std::string &name, double defaultValue) const {
+            return this->has(name) ? std::stod(this->values.at(name)) : defaultValue;
+        }
+
+        int getInt(const std::string &name, int defaultValue) const {
+            return this->has(name) ? std::stoi(this->values.at(name)) : defaultValue;
+        }
+
+        // Options which were given but never read by the program (usually typos).
+        std::vector<std::string> getUnused() const {
+            std::vector<std::string> unused;
+            for (auto &value: this->values) {
+                if (this->used.count(value.first) == 0) {
+                    unused.push_back(value.first);
+                }
+            }
+            return unused;
+        }
+};
+
+#endif
@@ -1,50 +1,22 @@
 #include <cmath>
 #include "CompoundDoublePendulum.hpp"
+#include "KernelDispatch.hpp"
 
 CompoundDoublePendulum::CompoundDoublePendulum(double M1, double M2, double L1, double L2, double dt, double g) :
-    DoublePendulum(M1, M2, L1, L2, dt, g, DoublePendulum::Variant::Compound) {
-    // Constants used in the equation of state.
-    this->c[0] = this->M1 * pow(this->L1 / 2.0, 2) / 2.0
-               + this->M1 * pow(this->L1, 2) / 12.0 / 2.0
-               + this->M2 * pow(this->L1, 2) / 2.0;
-    this->c[1] = this->M2 * pow(this->L2 / 2.0, 2) / 2.0
-               + this->M2 * pow(this->L2, 2) / 12.0 / 2.0;
-    this->c[2] = this->M2 * this->L1 * this->L2 / 2.0;
-    this->c[3] = this->g * (this->M1 * this->L1 / 2.0 + this->M2 * this->L1);
-    this->c[4] = this->g * this->M2 * this->L2 / 2.0;
-};
+    DoublePendulum(M1, M2, L1, L2, dt, g, DoublePendulum::Variant::Compound),
+    kernel(M1, M2, L1, L2, g) {};
 
-/*
- * Equations of motion of a compound double pendulum in state form.
- * 
- * Source: https://www.astro.umd.edu/~adhabal/V1/Reports/Order_and_Chaos.pdf
- */
+// Virtual interface to the equations of motion, forwarded to the kernel.
 StateVector CompoundDoublePendulum::motionEquationStateForm(StateVector y) {
     StateVector out;
 
-    out[0] = y.w1;
-    out[1] = (
-        2 * this->c[1] * this->c[3] * sin(y.a1)
-        + pow(this->c[2], 2) * pow(y.w1, 2) * sin(y.a1 - y.a2) * cos(y.a1 - y.a2)
-        + 2 * this->c[1] * this->c[2] * pow(y.w2, 2) * sin(y.a1 - y.a2)
-        - this->c[2] * this->c[4] * cos(y.a1 - y.a2) * sin(y.a2)
-    ) / (
-        pow(this->c[2], 2) * pow(cos(y.a1 - y.a2), 2) - 4 * this->c[0] * this->c[1]
-    );
-    out[2] = y.w2;
-    out[3] = (
-        2 * this->c[0] * this->c[4] * sin(y.a2)
-        - pow(this->c[2], 2) * pow(y.w2, 2) * sin(y.a1 - y.a2) * cos(y.a1 - y.a2)
-        - 2 * this->c[0] * this->c[2] * pow(y.w1, 2) * sin(y.a1 - y.a2)
-        - this->c[2] * this->c[3] * cos(y.a1 - y.a2) * sin(y.a1)
-    ) / (
-        pow(this->c[2], 2) * pow(cos(y.a1 - y.a2), 2) - 4 * this->c[0] * this->c[1]
-    );
+    visitMath(this->mathAccuracy, [&](auto math) {
+        this->kernel.motionEquation(y, out, math);
+    });
 
     return out;
 };
 
-
 double CompoundDoublePendulum::getEnergy(StateVector state) {
     std::array<double, N_COORDS> coords;
     std::array<double, N_COORDS> vel;
@@ -2,20 +2,21 @@
 #define COMPOUND_DOUBLE_PENDULUM
 
 #include "DoublePendulum.hpp"
+#include "PendulumKernel.hpp"
 
 /*
  * Implementation of a DoublePendulum where the masses are distribuited
  * uniformly along each rod.
  */
-class CompoundDoublePendulum : public DoublePendulum {
-    private:
-        // Constants used in the equation of state.
-        double c[5];
+class CompoundDoublePendulum final : public DoublePendulum {
 
     public:
+        // Devirtualized equations of motion, used directly by the hot loops.
+        const PendulumKernel<DoublePendulum::Variant::Compound> kernel;
+
         CompoundDoublePendulum(double M1Val, double M2Val, double L1Val, double L2Val, double dtVal, double gVal);
         StateVector motionEquationStateForm(StateVector y);
         double getEnergy(StateVector state);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,168 @@
+#ifndef DORMAND_PRINCE_54
+#define DORMAND_PRINCE_54
+
+#include <cmath>
+#include <algorithm>
+#include "StateVector.hpp"
+#include "SinCos.hpp"
+
+/*
+ * Embedded Runge Kutta method of order 5(4) by Dormand and Prince, with
+ * adaptive step size control and dense output.
+ *
+ * Each step is solved with the 5th order formula, while the embedded 4th
+ * order one gives an estimate of the local error: the step is rejected and
+ * repeated if the error exceeds the tolerance atol + rtol * |y|, and the
+ * size of the next step is adjusted accordingly. Calm trajectories are then
+ * solved with long steps, violent ones with short steps.
+ *
+ * The last stage of each step is evaluated in the new state, so it is reused
+ * as the first stage of the next step ("first same as last"): an accepted
+ * step costs 6 evaluations of the state equation.
+ *
+ * The state equation is evaluated with the given Math tier (see SinCos.hpp).
+ *
+ * Source: E. Hairer, S.P. Norsett, G. Wanner, "Solving Ordinary Differential
+ *         Equations I", section II.5 and II.6 (dense output).
+ */
+template<typename Kernel, typename Math = ExactMath>
+class DormandPrince54 {
+    private:
+        const Kernel &kernel;
+        const double rtol, atol;
+        // Current and previous time and state (the last accepted step spans [tPrev, t]).
+        double t, tPrev;
+        StateVector y, yPrev;
+        // Size of the next step to attempt.
+        double h;
+        // Stage derivatives of the last accepted step: k7 is the derivative in y.
+        StateVector k1, k3, k4, k5, k6, k7;
+        // Number of evaluations of the state equation so far.
+        long rhsEvaluations;
+
+        // Weighted RMS norm of the error estimate of a step.
+        double errorNorm(const StateVector &err, const StateVector &y0, const StateVector &y1) const {
+            double sum, scale;
+
+            sum = 0;
+            for (std::size_t i = 0; i < StateVector::size(); i++) {
+                scale = this->atol + this->rtol * std::max(std::abs(y0[i]), std::abs(y1[i]));
+                sum += (err[i] / scale) * (err[i] / scale);
+            }
+            return sqrt(sum / StateVector::size());
+        }
+
+    public:
+        DormandPrince54(const Kernel &kernel, double rtol, double atol, Math = Math()) :
+            kernel{kernel}, rtol{rtol}, atol{atol}, t{0}, tPrev{0}, h{0}, rhsEvaluations{0} {};
+
+        // Start a new trajectory from state y0 at time t0, with h0 as first attempted step.
+        void reset(const StateVector &y0, double t0, double h0) {
+            this->t = t0;
+            this->tPrev = t0;
+            this->y = y0;
+            this->yPrev = y0;
+            this->h = h0;
+            this->kernel.motionEquation(this->y, this->k7, Math());
+            this->rhsEvaluations++;
+        }
+
+        /*
+         * Perform one accepted step, never going past tMax.
+         *
+         * Returns false if the step size underflowed (the tolerance cannot be
+         * met) or tMax was already reached.
+         */
+        bool step(double tMax) {
+            StateVector Y, k2, yNew, err, kNew;
+            double hStep, errNorm, factor;
+
+            if (this->t >= tMax) {
+                return false;
+            }
+
+            this->k1 = this->k7;
+            while (true) {
+                hStep = std::min(this->h, tMax - this->t);
+                if (hStep <= 1e-14 * std::max(1.0, std::abs(this->t))) {
+                    return false;
+                }
+
+                Y = this->y + this->k1 * (hStep * (1.0 / 5.0));
+                this->kernel.motionEquation(Y, k2, Math());
+                Y = this->y + (this->k1 * (3.0 / 40.0) + k2 * (9.0 / 40.0)) * hStep;
+                this->kernel.motionEquation(Y, this->k3, Math());
+                Y = this->y + (this->k1 * (44.0 / 45.0) + k2 * (-56.0 / 15.0) + this->k3 * (32.0 / 9.0)) * hStep;
+                this->kernel.motionEquation(Y, this->k4, Math());
+                Y = this->y + (this->k1 * (19372.0 / 6561.0) + k2 * (-25360.0 / 2187.0) + this->k3 * (64448.0 / 6561.0)
+                               + this->k4 * (-212.0 / 729.0)) * hStep;
+                this->kernel.motionEquation(Y, this->k5, Math());
+                Y = this->y + (this->k1 * (9017.0 / 3168.0) + k2 * (-355.0 / 33.0) + this->k3 * (46732.0 / 5247.0)
+                               + this->k4 * (49.0 / 176.0) + this->k5 * (-5103.0 / 18656.0)) * hStep;
+                this->kernel.motionEquation(Y, this->k6, Math());
+                yNew = this->y + (this->k1 * (35.0 / 384.0) + this->k3 * (500.0 / 1113.0) + this->k4 * (125.0 / 192.0)
+                                  + this->k5 * (-2187.0 / 6784.0) + this->k6 * (11.0 / 84.0)) * hStep;
+                this->kernel.motionEquation(yNew, kNew, Math());
+                this->rhsEvaluations += 6;
+
+                // Difference between the 5th and the 4th order solutions.
+                err = (this->k1 * (71.0 / 57600.0) + this->k3 * (-71.0 / 16695.0) + this->k4 * (71.0 / 1920.0)
+                       + this->k5 * (-17253.0 / 339200.0) + this->k6 * (22.0 / 525.0) + kNew * (-1.0 / 40.0)) * hStep;
+                errNorm = this->errorNorm(err, this->y, yNew);
+
+                // Classic controller with a safety factor, limiting the change of step size.
+                if (errNorm == 0) {
+                    factor = 5.0;
+                } else {
+                    factor = std::clamp(0.9 * pow(errNorm, -0.2), 0.2, 5.0);
+                }
+
+                if (errNorm <= 1.0) {
+                    this->tPrev = this->t;
+                    this->yPrev = this->y;
+                    this->t += hStep;
+                    this->y = yNew;
+                    this->k7 = kNew;
+                    // Do not adapt the step size if this step was truncated by tMax.
+                    if (hStep == this->h) {
+                        this->h = hStep * factor;
+                    }
+                    return true;
+                }
+                // Rejected: retry with a smaller step (never grow after a rejection).
+                this->h = hStep * std::min(factor, 1.0);
+            }
+        }
+
+        // Interpolate the state at any time in the span [tPrev, t] of the last accepted step.
+        StateVector denseOutput(double tOut) const {
+            // Coefficients of the continuous extension of order 4.
+            const double d1 = -12715105075.0 / 11282082432.0, d3 = 87487479700.0 / 32700410799.0,
+                         d4 = -10690763975.0 / 1880347072.0, d5 = 701980252875.0 / 199316789632.0,
+                         d6 = -1453857185.0 / 822651844.0, d7 = 69997945.0 / 29380423.0;
+            double hLast, theta, theta1;
+            StateVector r2, r3, r4, r5;
+
+            hLast = this->t - this->tPrev;
+            if (hLast <= 0) {
+                return this->y;
+            }
+            theta = (tOut - this->tPrev) / hLast;
+            theta1 = 1.0 - theta;
+
+            r2 = this->y - this->yPrev;
+            r3 = this->k1 * hLast - r2;
+            r4 = r2 - this->k7 * hLast - r3;
+            r5 = (this->k1 * d1 + this->k3 * d3 + this->k4 * d4 + this->k5 * d5 + this->k6 * d6 + this->k7 * d7) * hLast;
+
+            return this->yPrev + (r2 + (r3 + (r4 + r5 * theta1) * theta) * theta1) * theta;
+        }
+
+        double getTime() const { return this->t; }
+        double getPrevTime() const { return this->tPrev; }
+        const StateVector &getState() const { return this->y; }
+        const StateVector &getPrevState() const { return this->yPrev; }
+        long getRhsEvaluations() const { return this->rhsEvaluations; }
+};
+
+#endif
@@ -6,9 +6,12 @@
 #include "DoublePendulum.hpp"
 #include "SimpleDoublePendulum.hpp"
 #include "CompoundDoublePendulum.hpp"
+#include "KernelDispatch.hpp"
+#include "SymplecticIntegrators.hpp"
 
 DoublePendulum::DoublePendulum(double M1, double M2, double L1, double L2, double dt, double g, Variant variant) :
-    M1{M1}, M2{M2}, L1{L1}, L2{L2}, variant{variant}, dt{dt}, g{g} {};
+    M1{M1}, M2{M2}, L1{L1}, L2{L2}, variant{variant}, dt{dt}, g{g},
+    integrator{Integrator::RK4}, rtol{1e-8}, atol{1e-8}, mathAccuracy{MathAccuracy::Exact} {};
 
 std::unique_ptr<DoublePendulum> DoublePendulum::makeDoublePendulum(double M1, double M2, double L1, double L2,
         double dt, double g, DoublePendulum::Variant type) {
@@ -33,15 +36,120 @@ std::string DoublePendulum::variantToString(DoublePendulum::Variant pendulumType
     }
 }
 
+std::string DoublePendulum::integratorToString(DoublePendulum::Integrator integrator) {
+    switch (integrator) {
+        case DoublePendulum::Integrator::RK4:
+            return "rk4";
+        case DoublePendulum::Integrator::DormandPrince54:
+            return "dopri54";
+        case DoublePendulum::Integrator::ImplicitMidpoint:
+            return "midpoint";
+        case DoublePendulum::Integrator::GaussLegendre4:
+            return "gauss4";
+        case DoublePendulum::Integrator::StormerVerlet:
+            return "verlet";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool DoublePendulum::stringToIntegrator(const std::string &name, DoublePendulum::Integrator &integrator) {
+    for (auto candidate: {DoublePendulum::Integrator::RK4, DoublePendulum::Integrator::DormandPrince54,
+                          DoublePendulum::Integrator::ImplicitMidpoint, DoublePendulum::Integrator::GaussLegendre4,
+                          DoublePendulum::Integrator::StormerVerlet}) {
+        if (name == DoublePendulum::integratorToString(candidate)) {
+            integrator = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string DoublePendulum::mathAccuracyToString(DoublePendulum::MathAccuracy accuracy) {
+    switch (accuracy) {
+        case DoublePendulum::MathAccuracy::Exact:
+            return "exact";
+        case DoublePendulum::MathAccuracy::Fast:
+            return "fast";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool DoublePendulum::stringToMathAccuracy(const std::string &name, DoublePendulum::MathAccuracy &accuracy) {
+    for (auto candidate: {DoublePendulum::MathAccuracy::Exact, DoublePendulum::MathAccuracy::Fast}) {
+        if (name == DoublePendulum::mathAccuracyToString(candidate)) {
+            accuracy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DoublePendulum::setIntegrator(DoublePendulum::Integrator integrator, double rtol, double atol) {
+    this->integrator = integrator;
+    this->rtol = rtol;
+    this->atol = atol;
+}
+
+bool DoublePendulum::isAdaptive() const {
+    return this->integrator == DoublePendulum::Integrator::DormandPrince54;
+}
+
+bool DoublePendulum::isSymplectic() const {
+    return this->integrator == DoublePendulum::Integrator::ImplicitMidpoint
+           || this->integrator == DoublePendulum::Integrator::GaussLegendre4
+           || this->integrator == DoublePendulum::Integrator::StormerVerlet;
+}
+
 /*
  * Calculates the next state vector based on the current one and the equation of motion in the state form,
- * using a Runge Kutta method of the 4th order.
+ * using a Runge Kutta method of the 4th order or, if selected, one of the symplectic integrators.
+ * The steps whose symplectic iterations do not converge are performed with RK4.
  */
 StateVector DoublePendulum::calcNextState(StateVector currState) {
+    bool converged;
+
+    return this->calcNextState(currState, converged);
+}
+
+StateVector DoublePendulum::calcNextState(StateVector currState, bool &converged) {
     StateVector Y1, Y2, Y3, Y4;
     StateVector k1, k2, k3, k4;
     StateVector nextState;
-    
+
+    switch (this->integrator) {
+        case DoublePendulum::Integrator::ImplicitMidpoint:
+            converged = visitMath(this->mathAccuracy, [&](auto math) {
+                return visitKernel(*this, [&](const auto &kernel) {
+                    return implicitMidpointStep(kernel.hamiltonian, currState, nextState, this->dt, math);
+                });
+            });
+            break;
+        case DoublePendulum::Integrator::GaussLegendre4:
+            converged = visitMath(this->mathAccuracy, [&](auto math) {
+                return visitKernel(*this, [&](const auto &kernel) {
+                    return gaussLegendre4Step(kernel.hamiltonian, currState, nextState, this->dt, math);
+                });
+            });
+            break;
+        case DoublePendulum::Integrator::StormerVerlet:
+            converged = visitMath(this->mathAccuracy, [&](auto math) {
+                return visitKernel(*this, [&](const auto &kernel) {
+                    return stormerVerletStep(kernel.hamiltonian, currState, nextState, this->dt, math);
+                });
+            });
+            break;
+        default:
+            converged = false;
+            break;
+    }
+    if (converged) {
+        return nextState;
+    }
+    // RK4 was selected, or replaces the symplectic step.
+    converged = !this->isSymplectic();
+
     Y1 = currState;
     k1 = motionEquationStateForm(Y1);
     Y2 = currState + k1 * this->dt/2.0;
@@ -59,6 +167,14 @@ StateVector DoublePendulum::calcNextState(StateVector currState) {
     return nextState;
 }
 
+void DoublePendulum::sinCos(double x, double &s, double &c) const {
+    if (this->mathAccuracy == DoublePendulum::MathAccuracy::Fast) {
+        FastMath::sinCos(x, s, c);
+    } else {
+        ExactMath::sinCos(x, s, c);
+    }
+}
+
 std::array<double, DoublePendulum::N_COORDS> DoublePendulum::getCartesianCoordinates(StateVector state) {
     /*
      * Order of the points in the coords array: O, G1, A, G2, B.
@@ -67,16 +183,20 @@ std::array<double, DoublePendulum::N_COORDS> DoublePendulum::getCartesianCoordin
      *     O------------o------------o
      */
     std::array<double, DoublePendulum::N_COORDS> coords;
+    double sinA1, cosA1, sinA2, cosA2;
+
+    this->sinCos(state.a1, sinA1, cosA1);
+    this->sinCos(state.a2, sinA2, cosA2);
     
     // Fixed origin: O(x,y)
     coords[0] = 0;
     coords[1] = 0;
     // Extremity of the first rod and junction between the two: A(x,y)
-    coords[4] = this->L1 * sin(state.a1);
-    coords[5] = this->L1 * cos(state.a1);
+    coords[4] = this->L1 * sinA1;
+    coords[5] = this->L1 * cosA1;
     // Extremity of the second rod: B(x,y)
-    coords[8] = coords[4] + this->L2 * sin(state.a2);
-    coords[9] = coords[5] + this->L2 * cos(state.a2);
+    coords[8] = coords[4] + this->L2 * sinA2;
+    coords[9] = coords[5] + this->L2 * cosA2;
     // Midpoint of the first rod: G1(x,y)
     coords[2] = (coords[0] + coords[4]) / 2;
     coords[3] = (coords[1] + coords[5]) / 2;
@@ -96,16 +216,20 @@ std::array<double, DoublePendulum::N_COORDS> DoublePendulum::getCartesianVelocit
      */
 
     std::array<double, DoublePendulum::N_COORDS> vel;
+    double sinA1, cosA1, sinA2, cosA2;
+
+    this->sinCos(state.a1, sinA1, cosA1);
+    this->sinCos(state.a2, sinA2, cosA2);
     
     // Fixed origin: O(x,y)
     vel[0] = 0;
     vel[1] = 0;
     // Extremity of the first rod and junction between the two: A(x,y)
-    vel[4] = + this->L1 * cos(state.a1) * state.w1;
-    vel[5] = - this->L1 * sin(state.a1) * state.w1;
+    vel[4] = + this->L1 * cosA1 * state.w1;
+    vel[5] = - this->L1 * sinA1 * state.w1;
     // Extremity of the second rod: B(x,y)
-    vel[8] = vel[4] + this->L2 * cos(state.a2) * state.w2;
-    vel[9] = vel[5] - this->L2 * sin(state.a2) * state.w2;
+    vel[8] = vel[4] + this->L2 * cosA2 * state.w2;
+    vel[9] = vel[5] - this->L2 * sinA2 * state.w2;
     // Midpoint of the first rod: G1(x,y)
     vel[2] = (vel[0] + vel[4]) / 2;
     vel[3] = (vel[1] + vel[5]) / 2;
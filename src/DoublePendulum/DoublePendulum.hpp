@@ -25,11 +25,38 @@ class DoublePendulum {
         // Pendulum variants.
         enum class Variant {Simple, Compound};
         static std::string variantToString(DoublePendulum::Variant pendulumType);
+        // Numerical methods available to solve the equation of motion.
+        enum class Integrator {RK4, DormandPrince54, ImplicitMidpoint, GaussLegendre4, StormerVerlet};
+        static std::string integratorToString(DoublePendulum::Integrator integrator);
+        // Returns false if the name does not match any integrator.
+        static bool stringToIntegrator(const std::string &name, DoublePendulum::Integrator &integrator);
+        // Accuracy tiers of the trigonometric functions (see SinCos.hpp).
+        enum class MathAccuracy {Exact, Fast};
+        static std::string mathAccuracyToString(DoublePendulum::MathAccuracy accuracy);
+        // Returns false if the name does not match any accuracy tier.
+        static bool stringToMathAccuracy(const std::string &name, DoublePendulum::MathAccuracy &accuracy);
 
         // Physical parameters of the system.
         const double M1, M2, L1, L2;
         const Variant variant;
         const double dt, g;
+        /*
+         * Integrator used to solve the motion: calcNextState() performs one
+         * step of length dt with any of the fixed step integrators (RK4 and
+         * the symplectic ImplicitMidpoint, GaussLegendre4, StormerVerlet),
+         * while the adaptive integrators (DormandPrince54) are driven by the
+         * simulated time and use dt only as first step.
+         * rtol and atol are the error tolerances of the adaptive integrators.
+         */
+        Integrator integrator;
+        double rtol, atol;
+        /*
+         * Sine and cosine used everywhere the state is evaluated: the equations
+         * of motion with any integrator, the cartesian coordinates and the
+         * energy. Exact (libm) by default, Fast trades a couple of ulp for
+         * vectorized polynomials.
+         */
+        MathAccuracy mathAccuracy;
 
         // 2 * 2 degrees of freedom.
         static const int N_STATE_VARS = 2 * 2;
@@ -41,15 +68,27 @@ class DoublePendulum {
 
         DoublePendulum(double M1, double M2, double L1, double L2, double dt, double g, Variant variant);
 
+        void setIntegrator(Integrator integrator, double rtol = 1e-8, double atol = 1e-8);
+        // Wether the integrator chooses the size of its own steps.
+        bool isAdaptive() const;
+        // Wether the integrator is one of the symplectic ones, whose steps may not converge.
+        bool isSymplectic() const;
+
         // State equation of the pendulum: out = f(y)
         virtual StateVector motionEquationStateForm(StateVector y) = 0;
         StateVector calcNextState(StateVector currState);
+        // Same, with converged false if the step of a symplectic integrator did not converge and was done with RK4.
+        StateVector calcNextState(StateVector currState, bool &converged);
         // Get the values of position, velocity and energy of the various elements of the system at a given state.
         std::array<double, N_COORDS> getCartesianCoordinates(StateVector state);
         std::array<double, N_COORDS> getCartesianVelocities(StateVector state);
         virtual double getEnergy(StateVector state) = 0;
         // Get the values characterizing a state in text form.
         std::string getTextOutput(StateVector state, const std::string &separator="\t");        
+
+    protected:
+        // Sine and cosine of x with the selected accuracy tier.
+        void sinCos(double x, double &s, double &c) const;
 };
 
 #endif
\ No newline at end of file
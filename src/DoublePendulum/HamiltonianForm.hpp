@@ -0,0 +1,80 @@
+#ifndef HAMILTONIAN_FORM
+#define HAMILTONIAN_FORM
+
+#include <cmath>
+#include "StateVector.hpp"
+#include "SinCos.hpp"
+
+/*
+ * Hamiltonian formulation of a double pendulum, common to all the variants.
+ *
+ * With generalized coordinates q = (a1, a2) and conjugate momenta p = M(q) w
+ * the Hamiltonian is
+ *
+ *     H(q, p) = 1/2 p^T M(q)^-1 p - k1 cos(q1) - k2 cos(q2)
+ *
+ * where the mass matrix M(q) = [[A, B cos(q1 - q2)], [B cos(q1 - q2), C]]
+ * and k1, k2 only depend on the mass distribution of the variant.
+ *
+ * Canonical states are stored in a StateVector using the same layout of the
+ * Lagrangian ones: (q1, p1, q2, p2) in place of (a1, w1, a2, w2).
+ * As for the kernels, the trigonometric functions come from the Math tier
+ * given as last argument.
+ */
+class HamiltonianForm {
+    public:
+        const double A, B, C, k1, k2;
+
+        HamiltonianForm(double A, double B, double C, double k1, double k2) :
+            A{A}, B{B}, C{C}, k1{k1}, k2{k2} {};
+
+        // Momenta from angular velocities: p = M(q) w.
+        template<typename Math = ExactMath>
+        StateVector toCanonical(const StateVector &y, Math = Math()) const {
+            double c = Math::cos(y.a1 - y.a2);
+            return {y.a1, this->A * y.w1 + this->B * c * y.w2, y.a2, this->B * c * y.w1 + this->C * y.w2};
+        }
+
+        // Angular velocities from momenta: w = M(q)^-1 p.
+        template<typename Math = ExactMath>
+        StateVector fromCanonical(const StateVector &x, Math math = Math()) const {
+            StateVector y;
+            this->velocities(x.a1, x.a2, x.w1, x.w2, y.w1, y.w2, math);
+            y.a1 = x.a1;
+            y.a2 = x.a2;
+            return y;
+        }
+
+        // dH/dp = M(q)^-1 p.
+        template<typename Math = ExactMath>
+        void velocities(double q1, double q2, double p1, double p2, double &dq1, double &dq2, Math = Math()) const {
+            double c = Math::cos(q1 - q2);
+            double det = this->A * this->C - this->B * this->B * c * c;
+            dq1 = (this->C * p1 - this->B * c * p2) / det;
+            dq2 = (this->A * p2 - this->B * c * p1) / det;
+        }
+
+        // -dH/dq: the time derivative of the momenta.
+        template<typename Math = ExactMath>
+        void forces(double q1, double q2, double p1, double p2, double &dp1, double &dp2, Math = Math()) const {
+            double s, c;
+            Math::sinCos(q1 - q2, s, c);
+            double det = this->A * this->C - this->B * this->B * c * c;
+            double num = this->C * p1 * p1 - 2 * this->B * c * p1 * p2 + this->A * p2 * p2;
+            // The kinetic energy only depends on q1 - q2: dT/dq2 = - dT/dq1.
+            double dTdq1 = this->B * s * (p1 * p2 * det - num * this->B * c) / (det * det);
+            dp1 = - dTdq1 - this->k1 * Math::sin(q1);
+            dp2 = + dTdq1 - this->k2 * Math::sin(q2);
+        }
+
+        // Hamilton's equations: time derivative of a canonical state.
+        template<typename Math = ExactMath>
+        StateVector vectorField(const StateVector &x, Math math = Math()) const {
+            StateVector out;
+            this->velocities(x.a1, x.a2, x.w1, x.w2, out.a1, out.a2, math);
+            this->forces(x.a1, x.a2, x.w1, x.w2, out.w1, out.w2, math);
+            return out;
+        }
+};
+
+#endif
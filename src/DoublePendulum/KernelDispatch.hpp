@@ -0,0 +1,43 @@
+#ifndef KERNEL_DISPATCH
+#define KERNEL_DISPATCH
+
+#include "DoublePendulum.hpp"
+#include "SimpleDoublePendulum.hpp"
+#include "CompoundDoublePendulum.hpp"
+#include "SinCos.hpp"
+
+/*
+ * Call f with the PendulumKernel of the given pendulum.
+ *
+ * The variant is resolved here, once, so that f can be a generic lambda whose
+ * body (usually a whole integration loop) is instantiated for each kernel and
+ * runs without any virtual call.
+ * makeDoublePendulum() guarantees that the derived class matches the variant.
+ */
+template<typename F>
+auto visitKernel(DoublePendulum &pendulum, F f) {
+    switch (pendulum.variant) {
+        case DoublePendulum::Variant::Compound:
+            return f(static_cast<CompoundDoublePendulum &>(pendulum).kernel);
+        case DoublePendulum::Variant::Simple:
+        default:
+            return f(static_cast<SimpleDoublePendulum &>(pendulum).kernel);
+    }
+}
+
+/*
+ * Call f with the Math tier (ExactMath or FastMath) matching the accuracy:
+ * as with visitKernel(), the choice is made once for the whole body of f.
+ */
+template<typename F>
+auto visitMath(DoublePendulum::MathAccuracy accuracy, F f) {
+    switch (accuracy) {
+        case DoublePendulum::MathAccuracy::Fast:
+            return f(FastMath());
+        case DoublePendulum::MathAccuracy::Exact:
+        default:
+            return f(ExactMath());
+    }
+}
+
+#endif
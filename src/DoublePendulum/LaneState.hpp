@@ -0,0 +1,50 @@
+#ifndef LANE_STATE
+#define LANE_STATE
+
+/*
+ * The number of lanes follows the widest vector instruction set the compiler
+ * is allowed to use (see ARCH_FLAGS in the makefile): 8 doubles with AVX-512,
+ * 4 with AVX/AVX2, 2 with SSE2 and 1 (plain scalar code) on anything else.
+ */
+#if defined(__AVX512F__)
+    #define LANE_STATE_WIDTH 8
+#elif defined(__AVX__)
+    #define LANE_STATE_WIDTH 4
+#elif defined(__SSE2__)
+    #define LANE_STATE_WIDTH 2
+#else
+    #define LANE_STATE_WIDTH 1
+#endif
+
+// A SIMD register worth of doubles: arithmetic operators act lane by lane.
+typedef double LaneDouble __attribute__((vector_size(LANE_STATE_WIDTH * sizeof(double))));
+// Integers of the same width, also the result of comparisons between LaneDoubles.
+typedef long LaneLong __attribute__((vector_size(LANE_STATE_WIDTH * sizeof(long))));
+// The same register holds twice as many floats, and ints to compare them.
+typedef float LaneFloat __attribute__((vector_size(LANE_STATE_WIDTH * sizeof(double))));
+typedef int LaneInt __attribute__((vector_size(LANE_STATE_WIDTH * sizeof(double))));
+
+/*
+ * Structure-of-arrays version of StateVector: each member holds the same state
+ * variable for LANES independent pendulums, so that they can be advanced
+ * together with SIMD instructions.
+ */
+struct LaneState {
+    typedef double Real;
+    static const int LANES = LANE_STATE_WIDTH;
+
+    LaneDouble a1, w1, a2, w2;
+};
+
+/*
+ * Single precision version of LaneState, for the mixed precision fractal:
+ * twice the lanes in the same registers.
+ */
+struct LaneStateFloat {
+    typedef float Real;
+    static const int LANES = 2 * LANE_STATE_WIDTH;
+
+    LaneFloat a1, w1, a2, w2;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef PENDULUM_KERNEL
+#define PENDULUM_KERNEL
+
+#include <cmath>
+#include "DoublePendulum.hpp"
+#include "LaneState.hpp"
+#include "SinCos.hpp"
+#include "HamiltonianForm.hpp"
+
+/*
+ * Compile-time specialized equations of motion, one per DoublePendulum::Variant.
+ *
+ * A kernel only stores the constant coefficients of the equations, already
+ * folded together at construction, and evaluates the state equation inline:
+ * the same code is instantiated for a single StateVector and for a LaneState,
+ * so that the hot loops of the fractal never go through a virtual call.
+ *
+ * The coefficients are folded only where they are the leading factors of a
+ * product, so the results are bit-identical to the expanded formulas.
+ *
+ * The coefficients are stored as Real: double for StateVector and LaneState,
+ * float for LaneStateFloat (the coefficients are still computed in double).
+ *
+ * The trigonometric functions come from the Math tier given as last argument
+ * (ExactMath or FastMath, see SinCos.hpp), libm by default.
+ *
+ * Each kernel also provides the Hamiltonian form of the same system, used by
+ * the symplectic integrators.
+ */
+template<DoublePendulum::Variant V, typename Real = double>
+class PendulumKernel;
+
+/*
+ * Equations of motion of a simple double pendulum in state form.
+ *
+ * Source: http://www.physics.usyd.edu.au/~wheat/dpend_html/
+ */
+template<typename Real>
+class PendulumKernel<DoublePendulum::Variant::Simple, Real> {
+    private:
+        Real m2l1, m2l2, mg, m2g, ml1, ml2, mNegl1;
+
+    public:
+        static const DoublePendulum::Variant VARIANT = DoublePendulum::Variant::Simple;
+        const HamiltonianForm hamiltonian;
+
+        PendulumKernel(double M1, double M2, double L1, double L2, double g) :
+            m2l1(M2 * L1), m2l2(M2 * L2), mg((M1 + M2) * g), m2g(M2 * g),
+            ml1((M1 + M2) * L1), ml2((M1 + M2) * L2), mNegl1(- (M1 + M2) * L1),
+            // Point masses at the end of each rod.
+            hamiltonian{(M1 + M2) * L1 * L1, M2 * L1 * L2, M2 * L2 * L2, (M1 + M2) * g * L1, M2 * g * L2} {};
+
+        template<typename State, typename Math = ExactMath>
+        inline void motionEquation(const State &y, State &out, Math = Math()) const {
+            decltype(y.a1) sinDiff, cosDiff;
+            Math::sinCos(y.a2 - y.a1, sinDiff, cosDiff);
+            auto sinA1 = Math::sin(y.a1);
+            auto sinA2 = Math::sin(y.a2);
+            auto w1Sq = y.w1 * y.w1;
+            auto w2Sq = y.w2 * y.w2;
+            auto cosDiffSq = cosDiff * cosDiff;
+
+            out.a1 = y.w1;
+            out.w1 = (
+                this->m2l1 * cosDiff * sinDiff * w1Sq
+                + this->m2l2 * sinDiff * w2Sq
+                - this->mg * sinA1
+                + this->m2g * cosDiff * sinA2
+            ) / (this->ml1 - this->m2l1 * cosDiffSq);
+            out.a2 = y.w2;
+            out.w2 = (
+                this->mNegl1 * sinDiff * w1Sq
+                - this->m2l2 * cosDiff * sinDiff * w2Sq
+                + this->mg * cosDiff * sinA1
+                - this->mg * sinA2
+            ) / (this->ml2 - this->m2l2 * cosDiffSq);
+        }
+};
+
+/*
+ * Equations of motion of a compound double pendulum in state form.
+ *
+ * Source: https://www.astro.umd.edu/~adhabal/V1/Reports/Order_and_Chaos.pdf
+ */
+template<typename Real>
+class PendulumKernel<DoublePendulum::Variant::Compound, Real> {
+    private:
+        Real k13, k22, k12, k24, k04, k02, k23, k01;
+
+    public:
+        static const DoublePendulum::Variant VARIANT = DoublePendulum::Variant::Compound;
+        const HamiltonianForm hamiltonian;
+
+        PendulumKernel(double M1, double M2, double L1, double L2, double g) :
+            // Rods with uniform mass distribution: moment of inertia M L^2 / 3 around the pin.
+            hamiltonian{M1 * L1 * L1 / 3.0 + M2 * L1 * L1, M2 * L1 * L2 / 2.0, M2 * L2 * L2 / 3.0,
+                        g * (M1 * L1 / 2.0 + M2 * L1), g * M2 * L2 / 2.0} {
+            double c[5];
+
+            c[0] = M1 * pow(L1 / 2.0, 2) / 2.0
+                 + M1 * pow(L1, 2) / 12.0 / 2.0
+                 + M2 * pow(L1, 2) / 2.0;
+            c[1] = M2 * pow(L2 / 2.0, 2) / 2.0
+                 + M2 * pow(L2, 2) / 12.0 / 2.0;
+            c[2] = M2 * L1 * L2 / 2.0;
+            c[3] = g * (M1 * L1 / 2.0 + M2 * L1);
+            c[4] = g * M2 * L2 / 2.0;
+
+            this->k13 = 2 * c[1] * c[3];
+            this->k22 = pow(c[2], 2);
+            this->k12 = 2 * c[1] * c[2];
+            this->k24 = c[2] * c[4];
+            this->k04 = 2 * c[0] * c[4];
+            this->k02 = 2 * c[0] * c[2];
+            this->k23 = c[2] * c[3];
+            this->k01 = 4 * c[0] * c[1];
+        };
+
+        template<typename State, typename Math = ExactMath>
+        inline void motionEquation(const State &y, State &out, Math = Math()) const {
+            decltype(y.a1) sinDiff, cosDiff;
+            Math::sinCos(y.a1 - y.a2, sinDiff, cosDiff);
+            auto sinA1 = Math::sin(y.a1);
+            auto sinA2 = Math::sin(y.a2);
+            auto w1Sq = y.w1 * y.w1;
+            auto w2Sq = y.w2 * y.w2;
+            // Both equations share the same denominator.
+            auto den = this->k22 * (cosDiff * cosDiff) - this->k01;
+
+            out.a1 = y.w1;
+            out.w1 = (
+                this->k13 * sinA1
+                + this->k22 * w1Sq * sinDiff * cosDiff
+                + this->k12 * w2Sq * sinDiff
+                - this->k24 * cosDiff * sinA2
+            ) / den;
+            out.a2 = y.w2;
+            out.w2 = (
+                this->k04 * sinA2
+                - this->k22 * w2Sq * sinDiff * cosDiff
+                - this->k02 * w1Sq * sinDiff
+                - this->k23 * cosDiff * sinA1
+            ) / den;
+        }
+};
+
+/*
+ * One step of the Runge Kutta method of the 4th order for any kernel, either
+ * on a single StateVector or on a LaneState (LaneStateFloat with a float kernel).
+ */
+template<typename Kernel, typename State, typename Math = ExactMath>
+inline void rungeKutta4(const Kernel &kernel, const State &currState, State &nextState, double dt, Math math = Math()) {
+    typedef typename State::Real Real;
+    const Real h = dt, two = 2, six = 6;
+    State Y, k1, k2, k3, k4;
+
+    kernel.motionEquation(currState, k1, math);
+    Y.a1 = currState.a1 + k1.a1 * h / two;
+    Y.w1 = currState.w1 + k1.w1 * h / two;
+    Y.a2 = currState.a2 + k1.a2 * h / two;
+    Y.w2 = currState.w2 + k1.w2 * h / two;
+
+    kernel.motionEquation(Y, k2, math);
+    Y.a1 = currState.a1 + k2.a1 * h / two;
+    Y.w1 = currState.w1 + k2.w1 * h / two;
+    Y.a2 = currState.a2 + k2.a2 * h / two;
+    Y.w2 = currState.w2 + k2.w2 * h / two;
+
+    kernel.motionEquation(Y, k3, math);
+    Y.a1 = currState.a1 + k3.a1 * h;
+    Y.w1 = currState.w1 + k3.w1 * h;
+    Y.a2 = currState.a2 + k3.a2 * h;
+    Y.w2 = currState.w2 + k3.w2 * h;
+
+    kernel.motionEquation(Y, k4, math);
+    nextState.a1 = currState.a1 + (k1.a1 + k2.a1 * two + k3.a1 * two + k4.a1) * h / six;
+    nextState.w1 = currState.w1 + (k1.w1 + k2.w1 * two + k3.w1 * two + k4.w1) * h / six;
+    nextState.a2 = currState.a2 + (k1.a2 + k2.a2 * two + k3.a2 * two + k4.a2) * h / six;
+    nextState.w2 = currState.w2 + (k1.w2 + k2.w2 * two + k3.w2 * two + k4.w2) * h / six;
+}
+
+#endif
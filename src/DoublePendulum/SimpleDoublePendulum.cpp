@@ -1,35 +1,18 @@
 #include <cmath>
 #include "SimpleDoublePendulum.hpp"
+#include "KernelDispatch.hpp"
 
 SimpleDoublePendulum::SimpleDoublePendulum(double M1, double M2, double L1, double L2, double dt, double g) :
-    DoublePendulum(M1, M2, L1, L2, dt, g, DoublePendulum::Variant::Simple) {};
+    DoublePendulum(M1, M2, L1, L2, dt, g, DoublePendulum::Variant::Simple),
+    kernel(M1, M2, L1, L2, g) {};
 
-/*
- * Equations of motion of a simple double pendulum in state form.
- * 
- * Source: http://www.physics.usyd.edu.au/~wheat/dpend_html/
- */
+// Virtual interface to the equations of motion, forwarded to the kernel.
 StateVector SimpleDoublePendulum::motionEquationStateForm(StateVector y) {
     StateVector out;
 
-    out[0] = y.w1;
-    out[1] = (
-        this->M2 * this->L1 * cos(y.a2 - y.a1) * sin(y.a2 - y.a1) * pow(y.w1, 2)
-        + this->M2 * this->L2 * sin(y.a2 - y.a1) * pow(y.w2, 2)
-        - (this->M1 + this->M2) * this->g * sin(y.a1)
-        + this->M2 * this->g * cos(y.a2 - y.a1) * sin(y.a2)
-    ) / (
-        (this->M1 + this->M2) * this->L1 - this->M2 * this->L1 * pow(cos(y.a2 - y.a1), 2)
-    );
-    out[2] = y.w2;
-    out[3] = (
-        - (this->M1 + this->M2) * this->L1 * sin(y.a2 - y.a1) * pow(y.w1, 2)
-        - this->M2 * this->L2 * cos(y.a2 - y.a1) * sin(y.a2 - y.a1) * pow(y.w2, 2)
-        + (this->M1 + this->M2) * this->g * cos(y.a2 - y.a1) * sin(y.a1)
-        - (this->M1 + this->M2) * this->g * sin(y.a2)
-    ) / (
-        (this->M1 + this->M2) * this->L2 - this->M2 * this->L2 * pow(cos(y.a2 - y.a1), 2)
-    );
+    visitMath(this->mathAccuracy, [&](auto math) {
+        this->kernel.motionEquation(y, out, math);
+    });
 
     return out;
 };
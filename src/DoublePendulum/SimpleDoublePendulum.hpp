@@ -2,17 +2,21 @@
 #define SIMPLE_DOUBLE_PENDULUM
 
 #include "DoublePendulum.hpp"
+#include "PendulumKernel.hpp"
 
 /*
  * Implementation of a DoublePendulum where the masses are concentrated in the
  * second extremity of each rod. 
  */
-class SimpleDoublePendulum : public DoublePendulum {
+class SimpleDoublePendulum final : public DoublePendulum {
 
     public:
+        // Devirtualized equations of motion, used directly by the hot loops.
+        const PendulumKernel<DoublePendulum::Variant::Simple> kernel;
+
         SimpleDoublePendulum(double M1Val, double M2Val, double L1Val, double L2Val, double dtVal, double gVal);
         StateVector motionEquationStateForm(StateVector y);
         double getEnergy(StateVector state);
 };
 
-#endif
\ No newline at end of file
+#endif
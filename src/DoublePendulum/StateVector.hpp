@@ -1,37 +1,50 @@
 #ifndef STATE_VECTOR
 #define STATE_VECTOR
 
-#include <array>
+#include <cstddef>
 
 /*
  * Vector representing the state of the physical system.
- * 
- * It's a simple std::array with additional features:
+ *
+ * It's a plain, trivially copyable struct:
  *  - named access to the four state variables for ease of understanding;
+ *  - indexed access (operator[]) to the same variables, in the order
+ *    a1, w1, a2, w2;
  *  - operator overloads to implement operations between StateVectors in a
  *    member by member fashion;
  *  - operator overloads to implement operations between a StateVector and an
  *    arithmetic type variable (a scalar);
+ *
+ * All the operators are defined inline so that the compiler can fold the
+ * temporaries of the Runge Kutta stages away.
  */
-class StateVector : public std::array<double, 4> {
-    public:
-        // Named access tp state variables.
-        double &a1 = this->at(0);
-        double &w1 = this->at(1);
-        double &a2 = this->at(2);
-        double &w2 = this->at(3);
-        
-        // Operations between StateVectors (member by member).
-        StateVector& operator= (const StateVector &sv);
-        StateVector operator+ (const StateVector &sv);
-        StateVector operator- (const StateVector &sv);
-        StateVector operator* (const StateVector &sv);
-        StateVector operator/ (const StateVector &sv);
-        // Operations with a scalar.
-        StateVector operator+ (double a);
-        StateVector operator- (double a);
-        StateVector operator* (double a);
-        StateVector operator/ (double a);
+struct StateVector {
+    typedef double Real;
+
+    double a1, w1, a2, w2;
+
+    static constexpr std::size_t size() { return 4; }
+
+    // Indexed access to the state variables.
+    double &operator[] (std::size_t i) { return this->*StateVector::members[i]; }
+    const double &operator[] (std::size_t i) const { return this->*StateVector::members[i]; }
+
+    // Operations between StateVectors (member by member).
+    StateVector operator+ (const StateVector &sv) const { return {a1 + sv.a1, w1 + sv.w1, a2 + sv.a2, w2 + sv.w2}; }
+    StateVector operator- (const StateVector &sv) const { return {a1 - sv.a1, w1 - sv.w1, a2 - sv.a2, w2 - sv.w2}; }
+    StateVector operator* (const StateVector &sv) const { return {a1 * sv.a1, w1 * sv.w1, a2 * sv.a2, w2 * sv.w2}; }
+    StateVector operator/ (const StateVector &sv) const { return {a1 / sv.a1, w1 / sv.w1, a2 / sv.a2, w2 / sv.w2}; }
+    // Operations with a scalar.
+    StateVector operator+ (double a) const { return {a1 + a, w1 + a, a2 + a, w2 + a}; }
+    StateVector operator- (double a) const { return {a1 - a, w1 - a, a2 - a, w2 - a}; }
+    StateVector operator* (double a) const { return {a1 * a, w1 * a, a2 * a, w2 * a}; }
+    StateVector operator/ (double a) const { return {a1 / a, w1 / a, a2 / a, w2 / a}; }
+
+    private:
+        // Maps the indices of operator[] to the named members.
+        static constexpr double StateVector::*members[4] = {
+            &StateVector::a1, &StateVector::w1, &StateVector::a2, &StateVector::w2
+        };
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,191 @@
+#ifndef SYMPLECTIC_INTEGRATORS
+#define SYMPLECTIC_INTEGRATORS
+
+#include <cmath>
+#include <algorithm>
+#include "StateVector.hpp"
+#include "HamiltonianForm.hpp"
+
+/*
+ * Structure-preserving integrators, solving the Hamiltonian form of the
+ * equations of motion.
+ *
+ * Being symplectic, their energy error stays bounded (it oscillates instead
+ * of drifting) over arbitrarily long runs, so they can be used with a much
+ * larger dt than RK4 when the energy of the trajectory matters.
+ *
+ * All of them are implicit: the nonlinear equations of each step are solved
+ * by fixed point iteration, which converges quickly as long as dt is small
+ * compared to the fastest motion of the rods. When it does not converge the
+ * step is split in two half steps (still a symplectic map), recursively;
+ * the steps return false if even the smallest ones did not converge, and the
+ * callers then perform the step with RK4 instead.
+ * Input and output states are in the usual (a1, w1, a2, w2) form, and the
+ * trigonometric functions come from the Math tier given as last argument.
+ *
+ * Source: E. Hairer, C. Lubich, G. Wanner, "Geometric Numerical Integration",
+ *         sections II.1 (Gauss methods) and VI.3 (Stormer-Verlet).
+ */
+namespace symplectic {
+    // Convergence criteria of the fixed point iterations.
+    const int MAX_ITERATIONS = 50;
+    const double TOLERANCE = 1e-14;
+    // Maximum number of times a step can be halved.
+    const int MAX_SUBDIVISIONS = 12;
+
+    inline double maxDifference(const StateVector &x, const StateVector &y) {
+        double diff = 0, component;
+        for (std::size_t i = 0; i < StateVector::size(); i++) {
+            component = std::abs(x[i] - y[i]) / (1 + std::abs(x[i]));
+            // NaN never satisfies the convergence criterion (std::max would drop it).
+            if (!std::isfinite(component)) {
+                return INFINITY;
+            }
+            diff = std::max(diff, component);
+        }
+        return diff;
+    }
+
+    /*
+     * Perform a step with the given method, which returns false if its
+     * iterations did not converge: in that case retry with two half steps.
+     * Returns false if the step did not converge after MAX_SUBDIVISIONS
+     * halvings, nextState being then the last estimate of the method.
+     */
+    template<typename Method, typename Math>
+    inline bool subdividedStep(Method method, const HamiltonianForm &h, const StateVector &currState,
+                               StateVector &nextState, double dt, Math math, int depth = 0) {
+        StateVector halfState;
+
+        if (method(h, currState, nextState, dt, math)) {
+            return true;
+        }
+        if (depth >= MAX_SUBDIVISIONS) {
+            return false;
+        }
+        return subdividedStep(method, h, currState, halfState, dt / 2, math, depth + 1)
+               && subdividedStep(method, h, halfState, nextState, dt / 2, math, depth + 1);
+    }
+}
+
+/*
+ * Implicit midpoint rule (Gauss-Legendre method with 1 stage, order 2):
+ * x1 = x0 + dt * f((x0 + x1) / 2).
+ */
+template<typename Math>
+inline bool implicitMidpointTry(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt, Math math) {
+    StateVector x0, k, kPrev;
+
+    x0 = h.toCanonical(currState, math);
+    k = h.vectorField(x0, math);
+    for (int i = 0; i < symplectic::MAX_ITERATIONS; i++) {
+        kPrev = k;
+        k = h.vectorField(x0 + k * (dt / 2.0), math);
+        if (symplectic::maxDifference(k, kPrev) < symplectic::TOLERANCE) {
+            nextState = h.fromCanonical(x0 + k * dt, math);
+            return true;
+        }
+    }
+    nextState = h.fromCanonical(x0 + k * dt, math);
+    return false;
+}
+
+template<typename Math = ExactMath>
+inline bool implicitMidpointStep(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt,
+                                   Math math = Math()) {
+    return symplectic::subdividedStep(implicitMidpointTry<Math>, h, currState, nextState, dt, math);
+}
+
+// Gauss-Legendre method with 2 stages, order 4.
+template<typename Math>
+inline bool gaussLegendre4Try(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt, Math math) {
+    const double a11 = 0.25, a12 = 0.25 - sqrt(3.0) / 6.0;
+    const double a21 = 0.25 + sqrt(3.0) / 6.0, a22 = 0.25;
+    StateVector x0, k1, k2, k1Prev, k2Prev;
+
+    x0 = h.toCanonical(currState, math);
+    k1 = h.vectorField(x0, math);
+    k2 = k1;
+    for (int i = 0; i < symplectic::MAX_ITERATIONS; i++) {
+        k1Prev = k1;
+        k2Prev = k2;
+        k1 = h.vectorField(x0 + (k1Prev * a11 + k2Prev * a12) * dt, math);
+        k2 = h.vectorField(x0 + (k1Prev * a21 + k2Prev * a22) * dt, math);
+        if (std::max(symplectic::maxDifference(k1, k1Prev), symplectic::maxDifference(k2, k2Prev)) < symplectic::TOLERANCE) {
+            nextState = h.fromCanonical(x0 + (k1 + k2) * (dt / 2.0), math);
+            return true;
+        }
+    }
+    nextState = h.fromCanonical(x0 + (k1 + k2) * (dt / 2.0), math);
+    return false;
+}
+
+template<typename Math = ExactMath>
+inline bool gaussLegendre4Step(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt,
+                                 Math math = Math()) {
+    return symplectic::subdividedStep(gaussLegendre4Try<Math>, h, currState, nextState, dt, math);
+}
+
+/*
+ * Generalized Stormer-Verlet (leapfrog) scheme, order 2: composition of the
+ * two symplectic Euler methods, each advancing by half a step.
+ *
+ *     p' = p - dt/2 dH/dq(q, p')               (implicit in p')
+ *     q1 = q + dt/2 (dH/dp(q, p') + dH/dp(q1, p'))  (implicit in q1)
+ *     p1 = p' - dt/2 dH/dq(q1, p')             (explicit)
+ */
+template<typename Math>
+inline bool stormerVerletTry(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt, Math math) {
+    StateVector x0, x1;
+    double pHalf1, pHalf2, prev1, prev2, f1, f2;
+    double v1, v2, vNew1, vNew2;
+    bool converged;
+
+    x0 = h.toCanonical(currState, math);
+
+    // Half step on the momenta.
+    pHalf1 = x0.w1;
+    pHalf2 = x0.w2;
+    converged = false;
+    for (int i = 0; i < symplectic::MAX_ITERATIONS && !converged; i++) {
+        prev1 = pHalf1;
+        prev2 = pHalf2;
+        h.forces(x0.a1, x0.a2, prev1, prev2, f1, f2, math);
+        pHalf1 = x0.w1 + dt / 2.0 * f1;
+        pHalf2 = x0.w2 + dt / 2.0 * f2;
+        converged = std::max(std::abs(pHalf1 - prev1), std::abs(pHalf2 - prev2)) < symplectic::TOLERANCE * (1 + std::abs(pHalf1) + std::abs(pHalf2));
+    }
+    if (!converged) {
+        nextState = currState;
+        return false;
+    }
+
+    // Full step on the coordinates.
+    h.velocities(x0.a1, x0.a2, pHalf1, pHalf2, v1, v2, math);
+    x1 = x0;
+    converged = false;
+    for (int i = 0; i < symplectic::MAX_ITERATIONS && !converged; i++) {
+        prev1 = x1.a1;
+        prev2 = x1.a2;
+        h.velocities(prev1, prev2, pHalf1, pHalf2, vNew1, vNew2, math);
+        x1.a1 = x0.a1 + dt / 2.0 * (v1 + vNew1);
+        x1.a2 = x0.a2 + dt / 2.0 * (v2 + vNew2);
+        converged = std::max(std::abs(x1.a1 - prev1), std::abs(x1.a2 - prev2)) < symplectic::TOLERANCE * (1 + std::abs(x1.a1) + std::abs(x1.a2));
+    }
+
+    // Second half step on the momenta.
+    h.forces(x1.a1, x1.a2, pHalf1, pHalf2, f1, f2, math);
+    x1.w1 = pHalf1 + dt / 2.0 * f1;
+    x1.w2 = pHalf2 + dt / 2.0 * f2;
+
+    nextState = h.fromCanonical(x1, math);
+    return converged;
+}
+
+template<typename Math = ExactMath>
+inline bool stormerVerletStep(const HamiltonianForm &h, const StateVector &currState, StateVector &nextState, double dt,
+                                Math math = Math()) {
+    return symplectic::subdividedStep(stormerVerletTry<Math>, h, currState, nextState, dt, math);
+}
+
+#endif
@@ -1,14 +1,29 @@
 #include <cmath>
 #include <array>
 #include <fstream>
+#include <vector>
+#include <map>
+#include <future>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
 #include "DataRegion.hpp"
 #include "AdaptiveGrid.hpp"
 #include "../ColorScale.hpp"
+#include "../ColorTable.hpp"
+#include "../PngWriter.hpp"
+#include "../ThreadPool.hpp"
+#include "../Instrumentation.hpp"
 
 const char AdaptiveGrid::textComment = '#';
+const int AdaptiveGrid::MAX_DEFAULT_IMAGE_SIZE = 4096;
 
 AdaptiveGrid::AdaptiveGrid(std::shared_ptr<Fractal> fractal, int nStepMax, double ai1Central, double ai2Central, double aiSize) :
-    fractal{fractal}, ai1Central{ai1Central}, ai2Central{ai2Central}, aiSize{aiSize}, nStepMax{nStepMax} {
+    fractal{fractal}, ai1Central{ai1Central}, ai2Central{ai2Central}, aiSize{aiSize}, nStepMax{nStepMax},
+    splits{0}, cycleTime{0}, renderTime{0}, encodeTime{0}, compressionLevel{PngWriter::DEFAULT_LEVEL},
+    refineBatch{1}, refineThreshold{0}, imageSize{0}, viewAi1Central{ai1Central}, viewAi2Central{ai2Central}, viewSize{aiSize} {
+        this->insertions = 0;
+        this->symmetric = this->ai1Central == 0 && this->ai2Central == 0;
         this->initRegions();
     };
 
@@ -17,85 +32,313 @@ AdaptiveGrid::~AdaptiveGrid() {
 };
 
 void AdaptiveGrid::initRegions() {
+    std::array<int, DataRegion::DATA_POINTS_N> values;
+    double x, y;
+
     // The first region covers the whole domanin: subregions will be defined
     // automatically around the most "interesting" areas.
-    this->regions.insert(std::make_unique<DataRegion>(
-        this->ai1Central,
-        this->ai2Central,
-        this->aiSize,
-        this->aiSize,
-        // Lambda expression to fit the f(x, y) format required by DataRegion.
-        [this](double x, double y) -> int {
-            return this->fractal->stepsToFlip(x, y, this->nStepMax);
+    values[DataRegion::DATA_POINTS_N / 2] = this->evaluate(this->ai1Central, this->ai2Central);
+    for (int n = 0; n < DataRegion::DATA_POINTS_N; n++) {
+        if (n != DataRegion::DATA_POINTS_N / 2) {
+            DataRegion::pointPosition(this->ai1Central, this->ai2Central, this->aiSize, n, x, y);
+            values[n] = this->evaluate(x, y);
         }
-    ));
+    }
+    this->nodes.push_back({NO_CHILDREN, 0});
+    this->addRegion(DataRegion(this->ai1Central, this->ai2Central, 0, this->regionSize(0), this->aiSize, values), 0);
 };
 
-std::unique_ptr<png::image<png::rgb_pixel>> AdaptiveGrid::render() {
-    double minSize, size;
-    struct { int x; int y; } imgSize;
-    ColorScale colorScale = ColorScale();
+double AdaptiveGrid::regionSize(int depth) {
+    // Divided once per depth, exactly as the regions are split.
+    if (this->sideLengths.empty()) {
+        this->sideLengths.push_back(this->aiSize);
+    }
+    while ((int) this->sideLengths.size() <= depth) {
+        this->sideLengths.push_back(this->sideLengths.back() / DataRegion::DATA_POINTS_ON_1D);
+    }
+    return this->sideLengths[depth];
+}
+
+void AdaptiveGrid::addRegion(const DataRegion &region, uint32_t node) {
+    uint32_t index;
+
+    if (this->freeRegions.empty()) {
+        index = this->regions.size();
+        this->regions.push_back(region);
+    } else {
+        index = this->freeRegions.back();
+        this->freeRegions.pop_back();
+        this->regions[index] = region;
+    }
+    this->nodes[node].region = index;
+    this->heap.push_back({region.priority, this->insertions++, index, node});
+    std::push_heap(this->heap.begin(), this->heap.end());
+}
+
+int AdaptiveGrid::evaluate(double x, double y) {
+    bool fallback;
+    int steps;
+
+    steps = this->fractal->stepsToFlip(x, y, this->nStepMax, fallback);
+    if (fallback) {
+        std::lock_guard<std::mutex> lock(this->fallbackPointsMutex);
+        this->fallbackPoints.insert({x, y});
+    }
+    return steps;
+}
+
+void AdaptiveGrid::copyFallback(double xSource, double ySource, double x, double y) {
+    std::lock_guard<std::mutex> lock(this->fallbackPointsMutex);
+
+    if (this->fallbackPoints.count({xSource, ySource}) > 0) {
+        this->fallbackPoints.insert({x, y});
+    }
+}
+
+bool AdaptiveGrid::findMirror(double x, double y, int depth, int &steps) {
+    double xMirror, yMirror;
+    int n;
+
+    if (!this->symmetric || this->nodes.empty()) {
+        return false;
+    }
+    /*
+     * The mirror is the center of a DataPoint of the mirror region, or of
+     * the central DataPoints of its sub-regions if split further. A region
+     * less deep (or being split, with depth -1) has not evaluated it yet.
+     */
+    const DataRegion &region = this->findRegion(-x, -y, n);
+    if (region.depth < depth) {
+        return false;
+    }
+    steps = region.values[n];
+    DataRegion::pointPosition(region.x, region.y, this->sideLengths[region.depth], n, xMirror, yMirror);
+    this->copyFallback(xMirror, yMirror, x, y);
+    return true;
+}
+
+const DataRegion &AdaptiveGrid::findRegion(double x, double y, int &n) const {
+    double xCenter, yCenter, xFirst, yFirst, segmentSize;
+    uint32_t node;
+    int depth;
+
+    xCenter = this->ai1Central;
+    yCenter = this->ai2Central;
+    node = 0;
+    depth = 0;
+    while (true) {
+        // The DataPoint of the region of the node containing (x, y), clamped against the rounding on the borders.
+        segmentSize = this->sideLengths[depth] / DataRegion::DATA_POINTS_ON_1D;
+        xFirst = xCenter - this->sideLengths[depth] / 2;
+        yFirst = yCenter - this->sideLengths[depth] / 2;
+        n = std::clamp((int) ((x - xFirst) / segmentSize), 0, DataRegion::DATA_POINTS_ON_1D - 1) * DataRegion::DATA_POINTS_ON_1D
+            + std::clamp((int) ((y - yFirst) / segmentSize), 0, DataRegion::DATA_POINTS_ON_1D - 1);
+        if (this->nodes[node].children == NO_CHILDREN) {
+            return this->regions[this->nodes[node].region];
+        }
+        // Descend in the sub-region centered in the DataPoint.
+        DataRegion::pointPosition(xCenter, yCenter, this->sideLengths[depth], n, xCenter, yCenter);
+        node = this->nodes[node].children + n;
+        depth++;
+    }
+}
+
+int AdaptiveGrid::sample(double x, double y) const {
+    int n;
+
+    if (std::abs(x - this->ai1Central) > this->aiSize / 2 || std::abs(y - this->ai2Central) > this->aiSize / 2) {
+        return -1;
+    }
+    return this->findRegion(x, y, n).values[n];
+}
+
+void AdaptiveGrid::render(std::vector<png::rgb_pixel> &pixels, int &imgSize) {
+    double pixelSize, ai1First, ai2First;
+    int maxDepth;
     float baseSteps;
-    
-    minSize = this->aiSize;
-    // Identify the resolution of the image by finding the minimum subregion side length.
+    std::vector<std::future<void>> tasks;
+
+    maxDepth = 0;
     for (auto &region: this->regions) {
-        size = region->dataPoints[0].size;
-        if (size < minSize) {
-            minSize = size;
-        }
+        maxDepth = std::max(maxDepth, region.depth);
     }
-    imgSize.x = round(this->aiSize / minSize);
-    imgSize.y = imgSize.x;
+    // This also fills sideLengths up to maxDepth + 1, for the threads below.
+    pixelSize = this->regionSize(maxDepth + 1);
+    /*
+     * By default, identify the resolution of the image by the minimum
+     * subregion side length, that of the deepest region, within
+     * MAX_DEFAULT_IMAGE_SIZE (clamped as a double, before the conversion).
+     */
+    imgSize = this->imageSize > 0 ? this->imageSize
+                                  : (int) std::clamp(round(this->viewSize / pixelSize), 1.0, (double) AdaptiveGrid::MAX_DEFAULT_IMAGE_SIZE);
+    pixelSize = this->viewSize / imgSize;
+    ai1First = this->viewAi1Central - this->viewSize / 2;
+    ai2First = this->viewAi2Central - this->viewSize / 2;
 
     // Initialize the image.
-    auto img = std::make_unique<png::image<png::rgb_pixel>>(imgSize.x, imgSize.y);
+    pixels.assign((std::size_t) imgSize * imgSize, png::rgb_pixel());
+
+    // The pixels of the rows [yFirst, yLast), sampled at their centers.
+    auto drawRows = [&](int yFirst, int yLast, const ColorTable &colorTable) {
+        int steps;
 
-    auto drawSquare = [&img](int xCenter, int yCenter, int sizeLen, png::rgb_pixel color) {
-        int halfSizeLen = sizeLen / 2;
-        for (int x = xCenter - halfSizeLen; x <= xCenter + halfSizeLen; x++) {
-            for (int y = yCenter - halfSizeLen; y <= yCenter + halfSizeLen; y++) {
-                img->set_pixel(x, y, color);
+        for (int y = yFirst; y < yLast; y++) {
+            for (int x = 0; x < imgSize; x++) {
+                steps = this->sample(ai1First + (x + 0.5) * pixelSize, ai2First + (y + 0.5) * pixelSize);
+                if (steps >= 0) {
+                    pixels[(std::size_t) y * imgSize + x] = colorTable.getColor(steps);
+                }
             }
         }
     };
 
-    // Calculate all the pixels.
+    // Draw all the rows, each thread on its own band.
     baseSteps = sqrt(this->fractal->pendulum->L1 / this->fractal->pendulum->g) / this->fractal->pendulum->dt;
-    int x, y;
-    for (auto &region: this->regions) {
-        for (auto &dp: region->dataPoints) {
-            x = (int) ((dp.x + this->aiSize / 2) / minSize);
-            y = (int) ((dp.y + this->aiSize / 2) / minSize);
-            drawSquare(x, y, region->dataPoints[0].size / minSize, colorScale.getColor(dp.val / baseSteps, Fractal::STEPS_OUT_OF_SCALE));
-        }
+    ColorTable colorTable(ColorScale(), baseSteps, this->nStepMax);
+    ThreadPool &pool = ThreadPool::shared();
+    int bandRows = (imgSize + pool.getSize() - 1) / pool.getSize();
+    for (int yFirst = 0; yFirst < imgSize; yFirst += bandRows) {
+        tasks.push_back(pool.submit([&, yFirst]() {
+            drawRows(yFirst, std::min(yFirst + bandRows, imgSize), colorTable);
+        }));
+    }
+    for (auto &task: tasks) {
+        task.get();
     }
-
-    return img;
 };
 
 void AdaptiveGrid::cycle(int nCycles) {
-    std::array<std::unique_ptr<DataRegion>, DataRegion::DATA_POINTS_N> newRegions;
+    std::vector<DataRegion> parents;
+    std::vector<uint32_t> parentNodes;
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
 
-    for (int i = 0; i < nCycles; i++) {
-        // Define the new regions based on the highest priority region.
-        newRegions = (*(this->regions.rbegin()))->getSubRegions();
+    for (int i = 0; i < nCycles; i += parents.size()) {
+        // Take the highest priority regions...
+        parents = this->takeRound(nCycles - i, parentNodes);
+        // ... and replace each of them with its sub-regions.
+        this->refine(parents, parentNodes);
+    }
+    this->splits += nCycles;
+    this->cycleTime += Instrumentation::secondsSince(start);
+}
 
-        regions.erase(std::prev(this->regions.end()));
-        
-        // Insert the new regions.
-        for(auto newRegion = std::begin(newRegions); newRegion != std::end(newRegions); ++newRegion) {
-            regions.insert(std::move(*newRegion));
+std::vector<DataRegion> AdaptiveGrid::takeRound(int maxRegions, std::vector<uint32_t> &parentNodes) {
+    std::vector<DataRegion> round;
+    double minPriority;
+
+    parentNodes.clear();
+    maxRegions = std::min(maxRegions, std::max(this->refineBatch, 1));
+    minPriority = this->refineThreshold * this->heap.front().priority;
+    while ((int) round.size() < maxRegions && !this->heap.empty()) {
+        // The first region is always split.
+        if (!round.empty() && this->heap.front().priority < minPriority) {
+            break;
         }
+        std::pop_heap(this->heap.begin(), this->heap.end());
+        uint32_t index = this->heap.back().region;
+        parentNodes.push_back(this->heap.back().node);
+        this->heap.pop_back();
+        round.push_back(this->regions[index]);
+        this->regions[index].depth = -1;
+        this->freeRegions.push_back(index);
     }
+    return round;
 }
 
-void AdaptiveGrid::saveData(const std::string fileName, const std::string separator) {
-    std::ofstream outFile(fileName);
+void AdaptiveGrid::refine(const std::vector<DataRegion> &parents, const std::vector<uint32_t> &parentNodes) {
+    /*
+     * Each point to evaluate: sub-region (index of the parent times
+     * DATA_POINTS_N plus the index of its center) and DataPoint, and for
+     * the mirrors of the points of the same round the index of the point.
+     */
+    struct Point {
+        double x, y;
+        std::size_t subRegion;
+        int n;
+        std::size_t mirror;
+    };
+    std::vector<std::array<int, DataRegion::DATA_POINTS_N>> values(parents.size() * DataRegion::DATA_POINTS_N);
+    std::vector<Point> points, mirrors;
+    std::map<std::pair<double, double>, std::size_t> scheduled;
+    std::vector<std::future<void>> tasks;
+    double size, subSize;
+    uint32_t children;
+    DataPoint center;
+    Point point;
+
+    for (std::size_t p = 0; p < parents.size(); p++) {
+        size = this->regionSize(parents[p].depth);
+        subSize = this->regionSize(parents[p].depth + 1);
+        for (int s = 0; s < DataRegion::DATA_POINTS_N; s++) {
+            center = parents[p].getDataPoint(s, size);
+            point.subRegion = p * DataRegion::DATA_POINTS_N + s;
+            for (point.n = 0; point.n < DataRegion::DATA_POINTS_N; point.n++) {
+                // The center of the sub-region is already known.
+                if (point.n == DataRegion::DATA_POINTS_N / 2) {
+                    values[point.subRegion][point.n] = parents[p].values[s];
+                    continue;
+                }
+                DataRegion::pointPosition(center.x, center.y, subSize, point.n, point.x, point.y);
+                if (this->findMirror(point.x, point.y, parents[p].depth + 1, values[point.subRegion][point.n])) {
+                    continue;
+                }
+                // The mirror of a point evaluated in the same round is copied afterwards.
+                if (this->symmetric) {
+                    auto mirror = scheduled.find({-point.x, -point.y});
+                    if (mirror != scheduled.end()) {
+                        point.mirror = mirror->second;
+                        mirrors.push_back(point);
+                        continue;
+                    }
+                    scheduled[{point.x, point.y}] = points.size();
+                }
+                points.push_back(point);
+            }
+        }
+    }
+
+    // The points are independent: each task evaluates a contiguous chunk of them.
+    ThreadPool &pool = ThreadPool::shared();
+    std::size_t chunkSize = std::max<std::size_t>(1, points.size() / (4 * pool.getSize()));
+    for (std::size_t first = 0; first < points.size(); first += chunkSize) {
+        std::size_t last = std::min(first + chunkSize, points.size());
+        tasks.push_back(pool.submit([this, &points, &values, first, last]() {
+            for (std::size_t i = first; i < last; i++) {
+                values[points[i].subRegion][points[i].n] = this->evaluate(points[i].x, points[i].y);
+            }
+        }));
+    }
+    for (auto &task: tasks) {
+        task.get();
+    }
+    for (auto &mirror: mirrors) {
+        const Point &source = points[mirror.mirror];
+        values[mirror.subRegion][mirror.n] = values[source.subRegion][source.n];
+        this->copyFallback(source.x, source.y, mirror.x, mirror.y);
+    }
+
+    // Insert the new regions, as the children of their parents in the spatial index.
+    for (std::size_t p = 0; p < parents.size(); p++) {
+        size = this->regionSize(parents[p].depth);
+        subSize = this->regionSize(parents[p].depth + 1);
+        children = this->nodes.size();
+        this->nodes[parentNodes[p]].children = children;
+        this->nodes.resize(children + DataRegion::DATA_POINTS_N);
+        for (int s = 0; s < DataRegion::DATA_POINTS_N; s++) {
+            center = parents[p].getDataPoint(s, size);
+            this->nodes[children + s].children = NO_CHILDREN;
+            this->addRegion(DataRegion(center.x, center.y, parents[p].depth + 1, subSize, this->aiSize,
+                                       values[p * DataRegion::DATA_POINTS_N + s]), children + s);
+        }
+    }
+}
+
+void AdaptiveGrid::writeHeader(std::ostream &outFile) {
     std::string systemTypeStr;
-    StateVector currState, nextState;
+    bool mixed;
 
     systemTypeStr = DoublePendulum::variantToString(this->fractal->pendulum->variant);
+    mixed = this->fractal->precision == Fractal::Precision::Mixed;
 
     // Write simulation parameters in the header.
     outFile << this->textComment << "M1" << "=" << this->fractal->pendulum->M1 << std::endl;
@@ -110,17 +353,99 @@ void AdaptiveGrid::saveData(const std::string fileName, const std::string separa
 
     outFile << this->textComment << "dt" << "=" << this->fractal->pendulum->dt << std::endl;
     outFile << this->textComment << "g" << "=" << this->fractal->pendulum->g << std::endl;
+    outFile << this->textComment << "integrator" << "=" << DoublePendulum::integratorToString(this->fractal->pendulum->integrator) << std::endl;
+    outFile << this->textComment << "rtol" << "=" << this->fractal->pendulum->rtol << std::endl;
+    outFile << this->textComment << "atol" << "=" << this->fractal->pendulum->atol << std::endl;
+    outFile << this->textComment << "math" << "=" << DoublePendulum::mathAccuracyToString(this->fractal->pendulum->mathAccuracy) << std::endl;
+    outFile << this->textComment << "precision" << "=" << Fractal::precisionToString(this->fractal->precision) << std::endl;
+    if (mixed) {
+        outFile << this->textComment << "fallbackFraction" << "=" << this->fractal->fallbackFraction << std::endl;
+    }
+    outFile << this->textComment << "earlyExit" << "=" << Fractal::earlyExitToString(this->fractal->earlyExit) << std::endl;
+    if (this->fractal->earlyExit != Fractal::EarlyExit::Off) {
+        outFile << this->textComment << "recurrenceTolerance" << "=" << this->fractal->recurrenceTolerance << std::endl;
+    }
     outFile << this->textComment << "nStepMax" << "=" << this->nStepMax << std::endl;
     outFile << this->textComment << "nCycles" << "=" << this->nStepMax << std::endl;
     
     outFile << this->textComment << "renderType" << "=" << "adaptive" << std::endl;
-    
-    for(auto region = std::begin(regions); region != std::end(regions); ++region) {
-        outFile << (*region)->getTextOutput();
+}
+
+void AdaptiveGrid::saveData(const std::string fileName, const std::string separator) {
+    std::ofstream outFile(fileName);
+    double size;
+    DataPoint dp;
+    bool mixed;
+
+    mixed = this->fractal->precision == Fractal::Precision::Mixed;
+    this->writeHeader(outFile);
+
+    for (auto &region: this->regions) {
+        // Free slot of the arena.
+        if (region.depth < 0) {
+            continue;
+        }
+        size = this->regionSize(region.depth);
+        if (!mixed) {
+            outFile << region.getTextOutput(size);
+            continue;
+        }
+        // Same columns of DataRegion::getTextOutput(), plus the fallback flag.
+        for (int n = 0; n < DataRegion::DATA_POINTS_N; n++) {
+            dp = region.getDataPoint(n, size);
+            outFile << dp.x << separator << dp.y << separator << dp.size << separator << dp.val << separator
+                    << this->fallbackPoints.count({dp.x, dp.y}) << std::endl;
+        }
     }
 };
 
+void AdaptiveGrid::saveFallbackPoints(const std::string fileName, const std::string separator) {
+    std::ofstream outFile(fileName);
+    std::lock_guard<std::mutex> lock(this->fallbackPointsMutex);
+
+    if (!outFile) {
+        throw std::runtime_error("Cannot open " + fileName + " for writing");
+    }
+    this->writeHeader(outFile);
+    outFile << this->textComment << "fallbackPoints" << "=" << this->fallbackPoints.size() << std::endl;
+    // All the digits, to tell apart the points of the deepest regions.
+    outFile.precision(std::numeric_limits<double>::max_digits10);
+    for (auto &point: this->fallbackPoints) {
+        outFile << point.first << separator << point.second << '\n';
+    }
+    outFile.flush();
+    if (!outFile) {
+        throw std::runtime_error("Cannot write " + fileName);
+    }
+}
+
 void AdaptiveGrid::saveImage(const std::string fileName) {
-    auto img = this->render();
-    img->write(fileName);
-};
\ No newline at end of file
+    std::vector<png::rgb_pixel> pixels;
+    int imgSize;
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+
+    this->render(pixels, imgSize);
+    this->renderTime += Instrumentation::secondsSince(start);
+    start = Instrumentation::Clock::now();
+    PngWriter image(fileName, imgSize, imgSize, this->compressionLevel, PngWriter::Filter::Up);
+    image.writeRows(pixels.data(), imgSize);
+    this->encodeTime += Instrumentation::secondsSince(start);
+};
+
+void AdaptiveGrid::report(RunReport &report) {
+    report.setNumber("grid", "nStepMax", this->nStepMax);
+    report.setNumber("grid", "regions", this->heap.size());
+    report.setNumber("grid", "splits", this->splits);
+    report.setNumber("grid", "refineBatch", this->refineBatch);
+
+    report.setNumber("phases", "compute", this->cycleTime);
+    report.setNumber("phases", "render", this->renderTime);
+    report.setNumber("phases", "encode", this->encodeTime);
+
+    report.setNumber("throughput", "splitsPerSecond", this->splits / this->cycleTime);
+    if constexpr (Instrumentation::ENABLED) {
+        report.setNumber("throughput", "megaStepsPerSecond", this->fractal->getStatistics().steps / this->cycleTime / 1e6);
+    }
+
+    this->fractal->report(report);
+}
\ No newline at end of file
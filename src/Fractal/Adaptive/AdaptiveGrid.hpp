@@ -3,9 +3,16 @@
 
 #include <memory>
 #include <set>
-#include <png++/png.hpp>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <png++/rgb_pixel.hpp>
 #include "DataRegion.hpp"
 #include "../Fractal.hpp"
+#include "../RunReport.hpp"
 
 /*
  * Sample the space with varying resolutions, depending on the complexity of
@@ -17,6 +24,8 @@
  * distribution is expected to be inside it. More complex area will receive
  * a higher priority.
  * At each cycle the are with highest priority is split in smaller areas.
+ * Several regions can be split in the same round (see refineBatch), so that
+ * all their points are evaluated concurrently.
  * 
  * Following this strategy ensures that less resources are wasted computing
  * a high density of points in "flat" areas (e.g. the area at the center of
@@ -31,28 +40,130 @@ class AdaptiveGrid {
         // Text output lines starting with this character will be interpreted as comments, not data.
         static const char textComment;
 
-        /**
-         * Custom comparator to compare pointers of any type.
-         * 
-         * Note: the type T must be comparable itself.
+        /*
+         * The regions are stored by value in a single arena: the slots of the
+         * regions which were split are reused by the next new regions (a
+         * free slot has depth -1).
+         */
+        std::vector<DataRegion> regions;
+        std::vector<uint32_t> freeRegions;
+        /*
+         * Binary max-heap of the regions to split, by priority value (see
+         * DataRegion::calcPriority()): heap.front() always is the region
+         * with highest priority. Among regions with the same priority the
+         * last inserted is split first.
+         */
+        struct HeapEntry {
+            double priority;
+            uint64_t insertion;
+            uint32_t region, node;
+
+            bool operator<(const HeapEntry &other) const {
+                return this->priority < other.priority || (this->priority == other.priority && this->insertion < other.insertion);
+            }
+        };
+        std::vector<HeapEntry> heap;
+        uint64_t insertions;
+        // Side length of the regions at each depth (see regionSize()).
+        std::vector<double> sideLengths;
+        /*
+         * Spatial index of the regions: the 9-ary tree of the splits, rooted
+         * in the whole domain (node 0). A split region is an inner node whose
+         * 9 children, one for each of its DataPoints in the same order, are
+         * consecutive nodes from children; a leaf holds the index of its
+         * region in the arena.
          */
-        class ComparePointers {
-            public:
-                template<typename T>
-                bool operator()(std::unique_ptr<T> const &a, std::unique_ptr<T> const &b) {
-                    return (*a) < (*b);
-                }
+        struct Node {
+            uint32_t children, region;
         };
-        // The multiset keeps the regions ordered by priority value, so
-        // std::prev(regions.end()) always is the region with highest priority.
-        // Note: a custom comparator is adopted to compare pointers.
-        std::multiset<std::unique_ptr<DataRegion>, ComparePointers> regions;
+        static const uint32_t NO_CHILDREN = UINT32_MAX;
+        std::vector<Node> nodes;
+        // Points (x, y) recomputed by the double precision fallback (see Fractal::Precision).
+        std::set<std::pair<double, double>> fallbackPoints;
+        // The regions are evaluated by multiple threads.
+        std::mutex fallbackPointsMutex;
+        /*
+         * The flip time is the same at (x, y) and (-x, -y) (see UniformGrid).
+         * DataRegion always splits a region around its center, so if the
+         * domain is centered in the origin its regions come in exact mirror
+         * pairs: a new point is copied from its mirror, found through the
+         * spatial index, if the mirror region was already split as deep.
+         * Elsewhere the points never match.
+         */
+        bool symmetric;
+        // Regions split by cycle(), and wall clock time in [s] spent in cycle(), coloring and encoding the images.
+        long splits;
+        double cycleTime, renderTime, encodeTime;
 
         void initRegions();
-        // Renders the data into a in-memory PNG image of the fractal.
-        std::unique_ptr<png::image<png::rgb_pixel>> render();
+        // Side length of the regions at the given depth, each a third of the previous one.
+        double regionSize(int depth);
+        // Store the region of the leaf node in the arena and queue it in the heap.
+        void addRegion(const DataRegion &region, uint32_t node);
+        // Remove from regions the ones to split in the next round, at most maxRegions (see refineBatch), and their nodes.
+        std::vector<DataRegion> takeRound(int maxRegions, std::vector<uint32_t> &parentNodes);
+        // Split the regions, evaluating all the new points concurrently, and insert the sub-regions.
+        void refine(const std::vector<DataRegion> &parents, const std::vector<uint32_t> &parentNodes);
+        // Evaluate the fractal in (x, y).
+        int evaluate(double x, double y);
+        // Mark (x, y) as recomputed by the fallback if (xSource, ySource), whose value it copies, was.
+        void copyFallback(double xSource, double ySource, double x, double y);
+        /*
+         * Copy in steps the value of (-x, -y), if it was already evaluated as
+         * a DataPoint of a region at least depth deep (only if symmetric).
+         */
+        bool findMirror(double x, double y, int depth, int &steps);
+        // The leaf region containing (x, y), in the domain, and the index n of its DataPoint containing (x, y).
+        const DataRegion &findRegion(double x, double y, int &n) const;
+        // Value of the finest DataPoint containing (x, y), found through the spatial index, or -1 out of the domain.
+        int sample(double x, double y) const;
+        /*
+         * Renders the view into the pixels of a square image, row by row, of
+         * side imgSize (see imageSize): each pixel takes the value of the
+         * DataPoint containing its center.
+         */
+        void render(std::vector<png::rgb_pixel> &pixels, int &imgSize);
+        // Write the simulation parameters, shared by saveData() and saveFallbackPoints().
+        void writeHeader(std::ostream &outFile);
 
     public:
+        // zlib compression level of the PNG images, from 0 to 9 (see PngWriter).
+        int compressionLevel;
+        /*
+         * Number of regions split in each round of cycle(): the points of
+         * their sub-regions (8 new ones for each of the 9 sub-regions) are
+         * all evaluated concurrently, as independent tasks of the pool.
+         * With 1 (the default) the regions are split one by one, exactly in
+         * priority order, and at most 72 points are evaluated concurrently.
+         * A larger batch uses more threads, but some regions are split
+         * before the sub-regions of the previous ones in the same round
+         * could overtake them, so the sampling differs slightly.
+         */
+        int refineBatch;
+        /*
+         * Only the regions whose priority is at least refineThreshold times
+         * the highest one are split in the same round (up to refineBatch of
+         * them), so that low priority regions wait for the next rounds.
+         * Defaults to 0 (always refineBatch regions).
+         */
+        double refineThreshold;
+        /*
+         * Side in pixels of the images. With 0 (the default) a pixel is as
+         * large as the smallest DataPoint, so the side triples with each
+         * level of refinement, up to MAX_DEFAULT_IMAGE_SIZE; any other size
+         * draws the same samples, from a small preview to a large crop,
+         * independently of the depth.
+         */
+        int imageSize;
+        // Largest side of the images with the default imageSize.
+        static const int MAX_DEFAULT_IMAGE_SIZE;
+        /*
+         * Square area drawn in the images: centered in (viewAi1Central,
+         * viewAi2Central), of side viewSize. Defaults to the whole domain,
+         * the pixels out of the domain are black.
+         */
+        double viewAi1Central, viewAi2Central, viewSize;
+
         AdaptiveGrid(std::shared_ptr<Fractal> fractal, int nStepMax, double ai1Central, double ai2Central, double aiSize);
         ~AdaptiveGrid();
 
@@ -60,18 +171,28 @@ class AdaptiveGrid {
         void cycle(int nCycles = 1);
         /*
          * Save the sampled data values in an ASCII file.
+         * With Mixed precision a fifth column marks the points recomputed by
+         * the double precision fallback.
          * 
          * This file can be then read by other programs to render the image of
          * the fractal multiple times without having to perform the calculation
          * all over again.
-         * 
-         * The forceThreadNum parameter can be used to force a certain number
-         * of threads to be used. If it is 0 the number of threads is automatically
-         * assigned to be std::thread::hardware_concurrency().
          */
         void saveData(const std::string fileName, const std::string separator = "\t");
+        /*
+         * Save the points recomputed by the double precision fallback so far
+         * (see Fractal::Precision) in an ASCII file: the header of saveData()
+         * and their number, then the coordinates of a point on each line.
+         * Throws std::runtime_error if the file cannot be written.
+         */
+        void saveFallbackPoints(const std::string fileName, const std::string separator = "\t");
         // Save the image render of the fractal in a PNG file.
         void saveImage(const std::string fileName);
+        /*
+         * Add the sections of the computation so far to the report: regions,
+         * phase timings and throughput (splits per second).
+         */
+        void report(RunReport &report);
 };
 
 #endif
\ No newline at end of file
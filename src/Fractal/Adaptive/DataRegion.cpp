@@ -1,98 +1,53 @@
 #include <cmath>
 #include <string>
 #include <sstream>
-#include <functional>
-#include <memory>
 #include <array>
-#include <thread>
-#include <vector>
 #include "DataRegion.hpp"
 #include "DataPoint.hpp"
 
-DataRegion::DataRegion(DataPoint dp, double fullDomainSize, std::function<double(double, double)> f) :
-    DataRegion(dp.x, dp.y, dp.size, fullDomainSize, f, dp.val) {};
+DataRegion::DataRegion(double x, double y, int depth, double size, double fullDomainSize,
+                       const std::array<int, DATA_POINTS_N> &values) {
+    this->x = x;
+    this->y = y;
+    this->depth = depth;
+    for (int n = 0; n < DATA_POINTS_N; n++) {
+        this->values[n] = values[n];
+    }
 
-DataRegion::DataRegion(double x, double y, double size, double fullDomainSize, std::function<double(double, double)> f) :
-    DataRegion(x, y, size, fullDomainSize, f, f(x, y)) {};
+    calcPriority(size, fullDomainSize);
+}
 
-DataRegion::DataRegion(double x, double y, double size, double fullDomainSize, std::function<double(double, double)> f, double centralValue) {
-    double segmentSize, newValue;
-    double xDataPoint, yDataPoint;
-    int i, j, minIndex;
+/*
+ * Divide the DataRegion in a grid of DATA_POINTS_ON_1D x DATA_POINTS_ON_1D
+ * squares: a DataPoint is evaluated at the center of each square.
+ *
+ * The central square is identified with indices (0, 0) and all the other square
+ * as (i, j) with positive i to the right, positive j to the left.
+ */
+void DataRegion::pointPosition(double x, double y, double size, int n, double &xPoint, double &yPoint) {
+    double segmentSize;
+    int minIndex;
 
-    this->f = f;
-    this->fullDomainSize = fullDomainSize;
-    
     segmentSize = size / DATA_POINTS_ON_1D;
-
-    /*
-     * Divide the DataRegion in a grid of DATA_POINTS_ON_1D x DATA_POINTS_ON_1D
-     * squares: at the center of each square evaluate a DataPoint with f(x, y).
-     * 
-     * The central square is identified with indices (0, 0) and all the other square
-     * as (i, j) with positive i to the right, positive j to the left.
-     */
     minIndex = (int) (DATA_POINTS_ON_1D / 2);
-    for (i = -minIndex; i <= minIndex; i++) {
-        xDataPoint = x + i * segmentSize;
-
-        for (j = -minIndex; j <= minIndex; j++) {
-            yDataPoint = y + j * segmentSize;
-
-            if (i == 0 && j == 0) {
-                // Use the already calculated value for the central grid, skipping one calculation.
-                newValue = centralValue;
-            } else {
-                // Calculate the value of f(x, y) for any other grid.
-                newValue = f(xDataPoint, yDataPoint);
-            }
-
-            dataPoints[(i + minIndex) * DATA_POINTS_ON_1D + (j + minIndex)].update(xDataPoint, yDataPoint, newValue, segmentSize);
-        }
-    }
-
-    calcPriority();
+    xPoint = x + (n / DATA_POINTS_ON_1D - minIndex) * segmentSize;
+    yPoint = y + (n % DATA_POINTS_ON_1D - minIndex) * segmentSize;
 }
 
-std::array<std::unique_ptr<DataRegion>, DataRegion::DATA_POINTS_N> DataRegion::getSubRegions(int forceThreadNum) {
-    std::array<std::unique_ptr<DataRegion>, DATA_POINTS_N> subRegions;
-    int threadsNum;
-    std::vector<std::thread> threads;
-
-    // Multiple threads can be used to calculate the pixel data in parallel.
-    if (forceThreadNum == 0) {
-        threadsNum = std::thread::hardware_concurrency();
-    } else {
-        threadsNum = forceThreadNum;
-    }
-
-    auto createRegions = [&subRegions, this](int threadsNum, int threadIndex) {
-        // Each thread creates different regions thanks to the different offset.
-        for (int i = threadIndex; i < DATA_POINTS_N; i += threadsNum) {
-            subRegions[i] = std::make_unique<DataRegion>(this->dataPoints[i], this->fullDomainSize, this->f);
-        }
-    };
-
-    // Create N-1 threads...
-    for (int threadIndex = 0; threadIndex < threadsNum - 1; threadIndex++) {
-        threads.push_back(std::thread(createRegions, threadsNum, threadIndex));
-    }
-    // ... and also use the current thread.
-    createRegions(threadsNum, threadsNum-1);
-
-    // Wait for all threads to finish.
-    for (auto &t: threads) {
-        t.join();
-    }
+DataPoint DataRegion::getDataPoint(int n, double size) const {
+    double xDataPoint, yDataPoint;
 
-    return subRegions;
+    pointPosition(this->x, this->y, size, n, xDataPoint, yDataPoint);
+    return DataPoint(xDataPoint, yDataPoint, this->values[n], size / DATA_POINTS_ON_1D);
 }
 
-std::string DataRegion::getTextOutput(const char *separator) {
+std::string DataRegion::getTextOutput(double size, const char *separator) const {
     std::stringstream ss;
+    DataPoint dp;
 
-    for(auto dp = std::begin(dataPoints); dp != std::end(dataPoints); ++dp) {
-        ss << (*dp).x << separator  << (*dp).y << separator << (*dp).size << separator << (*dp).val << std::endl;
+    for (int n = 0; n < DATA_POINTS_N; n++) {
+        dp = this->getDataPoint(n, size);
+        ss << dp.x << separator << dp.y << separator << dp.size << separator << dp.val << std::endl;
     }
     return ss.str();
 }
@@ -118,19 +73,19 @@ bool operator>= (const DataRegion &dp1, const DataRegion &dp2) {
  * Priority is directly proportianal to the side length of the subregions
  * and to the coefficient of variation of the DataPoints.
  */
-void DataRegion::calcPriority() {
+void DataRegion::calcPriority(double size, double fullDomainSize) {
     int i;
     double mean, sigma, cv;
 
     mean = 0;
     for (i = 0; i < DATA_POINTS_N; i++) {
-        mean += dataPoints[i].val;
+        mean += values[i];
     }
     mean = mean / DATA_POINTS_N;
 
     sigma = 0;
     for (i = 0; i < DATA_POINTS_N; i++) {
-        sigma = sigma + pow(dataPoints[i].val - mean, 2);
+        sigma = sigma + pow(values[i] - mean, 2);
     }
     sigma = sqrt(sigma);
 
@@ -151,5 +106,5 @@ void DataRegion::calcPriority() {
      * simple direct proportionality. Some factors might be added to weigh one
      * with respect to the other, for example by adding an exponent to each member.
      */
-    priority = pow((1 + cv), 2)  * dataPoints[0].size / fullDomainSize;
+    priority = pow((1 + cv), 2)  * (size / DATA_POINTS_ON_1D) / fullDomainSize;
 }
\ No newline at end of file
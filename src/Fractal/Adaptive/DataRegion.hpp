@@ -2,8 +2,7 @@
 #define DATA_REGION
 
 #include <string>
-#include <memory>
-#include <functional>
+#include <array>
 #include "DataPoint.hpp"
 
 /*
@@ -17,7 +16,7 @@
  * are various zones where the calculation would proceed to a very large number
  * (or even to infinity) which consume a lot of cycles while not producing very
  * interesting results.
- * 
+ *
  * A DataRegion divides its (square) domain in N (3x3=9 by default)
  * sub-regions, evaluating a DataPoint with the function f(x, y) in the center
  * of each one.
@@ -26,6 +25,12 @@
  * so have lower priority) and the coefficient of variation of its N DataPoints
  * (regions with a lower coefficient have a lower priority since they probably
  * are more uniform).
+ *
+ * The regions are kept by the million (see AdaptiveGrid), so a DataRegion
+ * only stores its center, its depth and the values of its DataPoints (64
+ * bytes): the side length of a region only depends on its depth, and the
+ * function f(x, y) is evaluated by the owner of the regions, which creates
+ * them with the values already known.
  */
 class DataRegion {
     public:
@@ -37,45 +42,40 @@ class DataRegion {
          */
         static const int DATA_POINTS_ON_1D = 3;
         static const int DATA_POINTS_N = DATA_POINTS_ON_1D * DATA_POINTS_ON_1D;
+        // Center of the region.
+        double x, y;
         double priority;
-        DataPoint dataPoints[DATA_POINTS_N];
+        // Values of f(x, y) at the DataPoints, at the positions given by pointPosition().
+        int values[DATA_POINTS_N];
+        // Number of splits from the whole domain (depth 0) to this region.
+        int depth;
 
+        DataRegion() = default;
         /*
          * The DataRegion covers a square area of length size, whose center
-         * has coordiantes (x, y).
-         * f(x, y) is the function defined on the whole xy domain.
-         */
-        DataRegion(double x, double y, double size, double fullDomainSize, std::function<double(double, double)> f);
-        /*
-         * If the value corresponding to the central node is already known it
-         * can be passed directly, avoinding one evaluation of f(x, y).
+         * has coordiantes (x, y), and values[n] is the value of f(x, y) at
+         * the n-th DataPoint.
+         * fullDomainSize is the length of the whole xy domain.
          */
-        DataRegion(double x, double y, double size, double fullDomainSize, std::function<double(double, double)> f, double centralValue);
-        /*
-         * DataRegion can be directly initialized providing the DataPoint which
-         * was located in the central subregion of the previously existing
-         * sub-region.
-         */
-        DataRegion(DataPoint centralDp, double fullDomainSize, std::function<double(double, double)> f);
+        DataRegion(double x, double y, int depth, double size, double fullDomainSize, const std::array<int, DATA_POINTS_N> &values);
+
+        // Center (xPoint, yPoint) of the n-th DataPoint of the region of side size centered in (x, y).
+        static void pointPosition(double x, double y, double size, int n, double &xPoint, double &yPoint);
+        // The n-th DataPoint, if the side length of the region is size.
+        DataPoint getDataPoint(int n, double size) const;
 
-        // Generates the new regions from the existing subregions.
-        std::array<std::unique_ptr<DataRegion>, DATA_POINTS_N> getSubRegions(int forceThreadNum = 0);
-        
         // Text output passed to a Python script for image rendering.
-        std::string getTextOutput(const char *separator = "\t");
+        std::string getTextOutput(double size, const char *separator = "\t") const;
 
         // Two DataRegions can be confronted directly through their priority value.
         friend bool operator< (const DataRegion &dp1, const DataRegion &dp2);
         friend bool operator<= (const DataRegion &dp1, const DataRegion &dp2);
         friend bool operator> (const DataRegion &dp1, const DataRegion &dp2);
-        friend bool operator>= (const DataRegion &dp1, const DataRegion &dp2);      
+        friend bool operator>= (const DataRegion &dp1, const DataRegion &dp2);
 
     private:
-        // The function to be evaluated is passed to each subregion when it is created.
-        std::function<double(double, double)> f;
-        double fullDomainSize;
         // The algorithm to calculate the priority value of the region.
-        void calcPriority();
+        void calcPriority(double size, double fullDomainSize);
 };
 
-#endif
\ No newline at end of file
+#endif
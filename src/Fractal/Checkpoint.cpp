@@ -0,0 +1,171 @@
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Checkpoint.hpp"
+
+static const std::string HEADER_END = "#end\n";
+
+// Round up to a multiple of the page size.
+static std::size_t pageAlign(std::size_t size) {
+    std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+Checkpoint::Checkpoint(const std::string fileName, const std::string &header, int imgSizeX, int imgSizeY,
+                       int tileSize, int bytesPerPixel, bool resume) :
+    fileName{fileName}, imgSizeX{imgSizeX}, imgSizeY{imgSizeY}, tileSize{tileSize},
+    tilesX{(imgSizeX + tileSize - 1) / tileSize}, tilesY{(imgSizeY + tileSize - 1) / tileSize},
+    fileDescriptor{-1}, mapping{nullptr}, flushInterval{60}
+{
+    std::size_t headerSize, tilesSize, stepsSize, pixelsNum;
+    struct stat fileStat;
+
+    pixelsNum = (std::size_t) imgSizeX * imgSizeY;
+    headerSize = pageAlign(header.size() + HEADER_END.size());
+    tilesSize = pageAlign(this->tilesX * this->tilesY);
+    stepsSize = pageAlign(pixelsNum * bytesPerPixel);
+    this->mappingSize = headerSize + tilesSize + stepsSize + pageAlign(pixelsNum);
+
+    this->fileDescriptor = open(fileName.c_str(), resume ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (this->fileDescriptor < 0) {
+        throw std::runtime_error("Cannot open the checkpoint file " + fileName);
+    }
+    if (resume) {
+        if (fstat(this->fileDescriptor, &fileStat) != 0 || (std::size_t) fileStat.st_size != this->mappingSize) {
+            close(this->fileDescriptor);
+            throw std::runtime_error("The checkpoint file " + fileName + " does not match the size of the render");
+        }
+    } else if (ftruncate(this->fileDescriptor, this->mappingSize) != 0) {
+        close(this->fileDescriptor);
+        throw std::runtime_error("Cannot resize the checkpoint file " + fileName);
+    }
+
+    this->mapping = (char *) mmap(nullptr, this->mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->fileDescriptor, 0);
+    if (this->mapping == MAP_FAILED) {
+        close(this->fileDescriptor);
+        throw std::runtime_error("Cannot map the checkpoint file " + fileName);
+    }
+    this->tileDone = this->mapping + headerSize;
+    this->steps = this->tileDone + tilesSize;
+    this->fallback = this->steps + stepsSize;
+
+    if (resume) {
+        try {
+            this->validateHeader(header);
+        } catch (const std::runtime_error &) {
+            munmap(this->mapping, this->mappingSize);
+            close(this->fileDescriptor);
+            throw;
+        }
+    } else {
+        // The new file is all zeros: no tile is done.
+        std::memcpy(this->mapping, header.data(), header.size());
+        std::memcpy(this->mapping + header.size(), HEADER_END.data(), HEADER_END.size());
+        msync(this->mapping, headerSize, MS_SYNC);
+    }
+    this->doneAtOpen.assign(this->tileDone, this->tileDone + this->tilesX * this->tilesY);
+    this->lastFlush = std::chrono::steady_clock::now();
+}
+
+Checkpoint::~Checkpoint() {
+    this->flush();
+    munmap(this->mapping, this->mappingSize);
+    close(this->fileDescriptor);
+}
+
+void Checkpoint::validateHeader(const std::string &header) const {
+    std::string fileHeader, fileLine, line;
+    const char *end;
+
+    end = (const char *) memmem(this->mapping, this->tileDone - this->mapping, HEADER_END.data(), HEADER_END.size());
+    if (end == nullptr) {
+        throw std::runtime_error(this->fileName + " is not a checkpoint file");
+    }
+    fileHeader = std::string(this->mapping, end - this->mapping);
+
+    // Compare line by line, to tell which parameter differs.
+    std::istringstream fileLines(fileHeader), lines(header);
+    while (true) {
+        bool fileMore = (bool) std::getline(fileLines, fileLine);
+        bool more = (bool) std::getline(lines, line);
+        if (!fileMore && !more) {
+            return;
+        }
+        if (fileMore != more || fileLine != line) {
+            throw std::runtime_error("The checkpoint file " + this->fileName + " was created by a different render: it has \""
+                                     + (fileMore ? fileLine : "") + "\" instead of \"" + (more ? line : "") + "\"");
+        }
+    }
+}
+
+int Checkpoint::tileIndex(const TileScheduler::Tile &tile) const {
+    return (tile.y0 / this->tileSize) * this->tilesX + tile.x0 / this->tileSize;
+}
+
+bool Checkpoint::isDone(const TileScheduler::Tile &tile) const {
+    return this->doneAtOpen[this->tileIndex(tile)];
+}
+
+void Checkpoint::save(const TileScheduler::Tile &tile, const StepsBuffer &data, const std::vector<char> &fallback) {
+    std::size_t first, last;
+    bool flush;
+
+    for (int y = tile.y0; y < tile.y1; y++) {
+        first = (std::size_t) y * this->imgSizeX + tile.x0;
+        last = (std::size_t) y * this->imgSizeX + tile.x1;
+        data.copyTo(this->steps, first, last);
+        std::copy(fallback.begin() + first, fallback.begin() + last, this->fallback + first);
+    }
+    {
+        std::lock_guard<std::mutex> lock(this->pendingMutex);
+        this->pendingTiles.push_back(this->tileIndex(tile));
+        flush = std::chrono::steady_clock::now() - this->lastFlush > std::chrono::seconds(this->flushInterval);
+        if (flush) {
+            this->lastFlush = std::chrono::steady_clock::now();
+        }
+    }
+    if (flush) {
+        this->flush();
+    }
+}
+
+int Checkpoint::loadDone(StepsBuffer &data, std::vector<char> &fallback) const {
+    std::size_t first, last;
+    int done = 0;
+
+    for (int ty = 0; ty < this->tilesY; ty++) {
+        for (int tx = 0; tx < this->tilesX; tx++) {
+            if (!this->doneAtOpen[ty * this->tilesX + tx]) {
+                continue;
+            }
+            for (int y = ty * this->tileSize; y < std::min((ty + 1) * this->tileSize, this->imgSizeY); y++) {
+                first = (std::size_t) y * this->imgSizeX + tx * this->tileSize;
+                last = (std::size_t) y * this->imgSizeX + std::min((tx + 1) * this->tileSize, this->imgSizeX);
+                data.copyFrom(this->steps, first, last);
+                std::copy(this->fallback + first, this->fallback + last, fallback.begin() + first);
+            }
+            done++;
+        }
+    }
+    return done;
+}
+
+void Checkpoint::flush() {
+    std::lock_guard<std::mutex> flushLock(this->flushMutex);
+    std::vector<int> done;
+
+    // The data of these tiles are already in the mapping.
+    {
+        std::lock_guard<std::mutex> lock(this->pendingMutex);
+        done.swap(this->pendingTiles);
+    }
+    msync(this->steps, this->mapping + this->mappingSize - this->steps, MS_SYNC);
+    for (int index: done) {
+        this->tileDone[index] = 1;
+    }
+    msync(this->tileDone, this->steps - this->tileDone, MS_SYNC);
+}
@@ -0,0 +1,75 @@
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "StepsBuffer.hpp"
+#include "TileScheduler.hpp"
+
+/*
+ * Memory-mapped file holding the results of a render as they are computed,
+ * so that an interrupted render can be resumed computing only the missing
+ * tiles.
+ *
+ * The file contains, each part starting at a page boundary:
+ *  - the header lines describing the render (see UniformGrid::saveData()),
+ *    ended by a "#end" line;
+ *  - one byte per tile (in row-major order), set once the tile is done;
+ *  - the steps of all the pixels (in the StepsBuffer raw format);
+ *  - the fallback flag of all the pixels.
+ *
+ * The data are flushed to disk at most every flushInterval seconds and when
+ * the file is closed. The flags of the tiles done in the meantime are kept
+ * in memory, and only written (and flushed) once their data are on disk: a
+ * flag in the file always means that the data of the tile are there too.
+ */
+class Checkpoint {
+    private:
+        const std::string fileName;
+        const int imgSizeX, imgSizeY, tileSize, tilesX, tilesY;
+        int fileDescriptor;
+        char *mapping;
+        std::size_t mappingSize;
+        // Parts of the mapping.
+        char *tileDone, *steps, *fallback;
+        /*
+         * Flags of the tiles done when the file was opened, read by isDone()
+         * and loadDone() while the workers set the flags in the file.
+         */
+        std::vector<char> doneAtOpen;
+        // Tiles done since the last flush, whose flags are not in the file yet.
+        std::vector<int> pendingTiles;
+        std::mutex pendingMutex, flushMutex;
+        std::chrono::steady_clock::time_point lastFlush;
+
+        int tileIndex(const TileScheduler::Tile &tile) const;
+        // Check that the header in the file is the same as the expected one.
+        void validateHeader(const std::string &header) const;
+
+    public:
+        int flushInterval;
+
+        /*
+         * Create the file (or reopen it, if resume is true) for an image of
+         * the given size, evaluated in tiles of tileSize pixels.
+         * Throws std::runtime_error if the file cannot be used, e.g. when it
+         * was created with different parameters.
+         */
+        Checkpoint(const std::string fileName, const std::string &header, int imgSizeX, int imgSizeY,
+                   int tileSize, int bytesPerPixel, bool resume);
+        // Flushes the file to disk.
+        ~Checkpoint();
+
+        // Wether the tile was done when the file was opened.
+        bool isDone(const TileScheduler::Tile &tile) const;
+        // Store the pixels of the tile, then mark it as done at the next flush.
+        void save(const TileScheduler::Tile &tile, const StepsBuffer &data, const std::vector<char> &fallback);
+        // Copy the pixels of all the tiles done when the file was opened in data; returns their number.
+        int loadDone(StepsBuffer &data, std::vector<char> &fallback) const;
+        // Flush the data to disk, then the flags of the tiles done since the last flush.
+        void flush();
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cctype>
 #include <sstream>
 #include "ColorScale.hpp"
 
@@ -19,6 +20,20 @@ png::rgb_pixel ColorScale::hexCodeToRgbPixel(std::string hexCode) {
     return png::rgb_pixel(red, green, blue);
 }
 
+bool ColorScale::isHexCode(const std::string &hexCode) {
+    std::size_t start = !hexCode.empty() && hexCode[0] == '#' ? 1 : 0;
+
+    if (hexCode.size() - start != 6) {
+        return false;
+    }
+    for (std::size_t i = start; i < hexCode.size(); i++) {
+        if (!std::isxdigit((unsigned char) hexCode[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 
 ColorScale::ColorScale(std::vector<std::string> colorHexCodes, int shadesNum) {
     png::rgb_pixel startColor, endColor;
@@ -44,20 +59,21 @@ ColorScale::ColorScale(std::vector<std::string> colorHexCodes, int shadesNum) {
     }
 }
 
-// Default color scale.
-ColorScale::ColorScale() : ColorScale(
-    std::vector<std::string> {
+std::vector<std::string> ColorScale::defaultColorHexCodes() {
+    return std::vector<std::string> {
         "#000000", "#000000", // Black      x < 1
         "#040085", "#47a9ff", // Blue       x in (1; 10]
         "#00631e", "#47d171", // Green      x in (10; 100]
         "#8f0000", "#ff8080", // Red        x in (100; 1000]
         "#4b0066", "#e18fff", // Purple     x > 1000
         "#FFFFFF"             // White      x out of scale
-    },
-    100
-) {};
+    };
+}
+
+// Default color scale.
+ColorScale::ColorScale() : ColorScale(ColorScale::defaultColorHexCodes(), 100) {};
 
-png::rgb_pixel ColorScale::getColor(double value, double outOfScaleValue) {
+png::rgb_pixel ColorScale::getColor(double value, double outOfScaleValue) const {
     uint colorIndex;
     
     if (value == outOfScaleValue) {
@@ -39,8 +39,13 @@ class ColorScale {
         ColorScale();
         ColorScale(std::vector<std::string> colorHexCodes, int shadesNum = 100);
 
+        // Colors of the default scale, in the same form as the ones given to the constructor.
+        static std::vector<std::string> defaultColorHexCodes();
+        // Whether the string is a hex color code: an optional '#' and 6 hex digits.
+        static bool isHexCode(const std::string &hexCode);
+
         // Assign a color to the value.
-        png::rgb_pixel getColor(double value, double outOfScaleValue);
+        png::rgb_pixel getColor(double value, double outOfScaleValue) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef COLOR_TABLE
+#define COLOR_TABLE
+
+#include <vector>
+#include <future>
+#include <algorithm>
+#include <png++/rgb_pixel.hpp>
+#include "ColorScale.hpp"
+#include "Fractal.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ * The colors of a ColorScale for each number of steps up to nStepMax,
+ * computed once: coloring a pixel is then a lookup, instead of the log10
+ * and the division of ColorScale::getColor().
+ *
+ * The number of steps is scaled by baseSteps, the steps of the natural
+ * period of the pendulum, as the grids do.
+ */
+class ColorTable {
+    private:
+        ColorScale colorScale;
+        float baseSteps;
+        std::vector<png::rgb_pixel> colors;
+
+        // Smallest number of pixels colored by a task.
+        static constexpr std::size_t MIN_TASK_PIXELS = 1 << 16;
+
+    public:
+        ColorTable(const ColorScale &colorScale, float baseSteps, int nStepMax) :
+            colorScale{colorScale}, baseSteps{baseSteps}
+        {
+            this->colors.resize(std::max(nStepMax, 0) + 1);
+            for (std::size_t steps = 0; steps < this->colors.size(); steps++) {
+                this->colors[steps] = colorScale.getColor((int) steps / baseSteps, Fractal::STEPS_OUT_OF_SCALE);
+            }
+        }
+
+        png::rgb_pixel getColor(int steps) const {
+            if (steps >= 0 && (std::size_t) steps < this->colors.size()) {
+                return this->colors[steps];
+            }
+            // Beyond the table: same color as the scale.
+            return this->colorScale.getColor(steps / this->baseSteps, Fractal::STEPS_OUT_OF_SCALE);
+        }
+
+        /*
+         * Write in out the colors of the pixels [0, pixelsNum), given by
+         * steps(i) the number of steps of pixel i. The pixels are split among
+         * the threads of ThreadPool::shared().
+         */
+        template<typename Steps>
+        void colorPixels(std::size_t pixelsNum, Steps steps, png::rgb_pixel *out) const {
+            ThreadPool &pool = ThreadPool::shared();
+            std::size_t taskPixels = std::max(MIN_TASK_PIXELS, (pixelsNum + pool.getSize() - 1) / pool.getSize());
+            std::vector<std::future<void>> tasks;
+
+            for (std::size_t first = 0; first < pixelsNum; first += taskPixels) {
+                tasks.push_back(pool.submit([this, &steps, out, first, last = std::min(first + taskPixels, pixelsNum)]() {
+                    for (std::size_t i = first; i < last; i++) {
+                        out[i] = this->getColor(steps(i));
+                    }
+                }));
+            }
+            for (auto &task: tasks) {
+                task.get();
+            }
+        }
+};
+
+#endif
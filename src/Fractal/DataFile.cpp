@@ -0,0 +1,376 @@
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "DataFile.hpp"
+#include "Fractal.hpp"
+
+static_assert(sizeof(DataFile::Header) == 64, "DataFile::Header is not packed");
+
+const char DataFile::MAGIC[8] = {'D', 'P', 'F', 'R', 'A', 'C', 'T', '\0'};
+const uint32_t DataFile::VERSION = 2;
+const uint32_t DataFile::FLAG_FALLBACK = 1;
+const int DataFile::MIN_RUN = 16;
+const int DataFile::MAX_LITERALS = 1 << 16;
+
+std::string DataFile::encodingToString(DataFile::Encoding encoding) {
+    switch (encoding) {
+        case DataFile::Encoding::Dense:
+            return "dense";
+        case DataFile::Encoding::RunLength:
+            return "rle";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool DataFile::stringToEncoding(const std::string &name, DataFile::Encoding &encoding) {
+    for (auto candidate: {DataFile::Encoding::Dense, DataFile::Encoding::RunLength}) {
+        if (name == DataFile::encodingToString(candidate)) {
+            encoding = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t DataFile::fallbackPlaneSize(std::size_t pixelsNum) {
+    return (pixelsNum + 7) / 8;
+}
+
+// Round up to a multiple of the page size.
+static std::size_t pageAlign(std::size_t size) {
+    std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+DataFileWriter::DataFileWriter(const std::string fileName, const std::string &parameters, int imgSizeX, int imgSizeY,
+                               bool compact, DataFile::Encoding encoding, bool fallback) :
+    fileName{fileName}, outRun{0}, pendingOut{0}, pixelsWritten{0}, partialByte{0}
+{
+    std::memset(&this->header, 0, sizeof(this->header));
+    std::memcpy(this->header.magic, DataFile::MAGIC, sizeof(DataFile::MAGIC));
+    this->header.version = DataFile::VERSION;
+    this->header.bitsPerPixel = compact ? 16 : 32;
+    this->header.encoding = (uint32_t) encoding;
+    this->header.imgSizeX = imgSizeX;
+    this->header.imgSizeY = imgSizeY;
+    this->header.parametersSize = parameters.size();
+    this->header.dataOffset = pageAlign(sizeof(this->header) + parameters.size());
+    if (fallback) {
+        this->header.flags |= DataFile::FLAG_FALLBACK;
+        this->header.fallbackOffset = this->header.dataOffset;
+        this->header.dataOffset = pageAlign(this->header.fallbackOffset + DataFile::fallbackPlaneSize((std::size_t) imgSizeX * imgSizeY));
+    }
+
+    this->file.open(fileName, std::ios::binary);
+    if (!this->file) {
+        throw std::runtime_error("Cannot open " + fileName + " for writing");
+    }
+    // The header is written again by close(), with the size of the data.
+    this->file.write((const char *) &this->header, sizeof(this->header));
+    this->file << parameters;
+    this->file.seekp(this->header.dataOffset);
+    this->checkStream();
+}
+
+DataFileWriter::~DataFileWriter() {
+    if (this->file.is_open()) {
+        try {
+            this->close();
+        } catch (const std::runtime_error &error) {
+            // A destructor cannot throw: close() must be called to know whether the file was written.
+        }
+    }
+}
+
+void DataFileWriter::checkStream() {
+    if (!this->file) {
+        throw std::runtime_error("Cannot write " + this->fileName);
+    }
+}
+
+void DataFileWriter::writeRecord() {
+    uint32_t literalsNum = this->literals.size();
+    uint16_t value16;
+    int32_t value32;
+
+    this->file.write((const char *) &this->outRun, sizeof(this->outRun));
+    this->file.write((const char *) &literalsNum, sizeof(literalsNum));
+    for (int value: this->literals) {
+        if (this->header.bitsPerPixel == 16) {
+            value16 = value;
+            this->file.write((const char *) &value16, sizeof(value16));
+        } else {
+            value32 = value;
+            this->file.write((const char *) &value32, sizeof(value32));
+        }
+    }
+    this->outRun = 0;
+    this->literals.clear();
+}
+
+void DataFileWriter::endRun() {
+    if (this->pendingOut >= (uint32_t) DataFile::MIN_RUN) {
+        if (this->outRun > 0 || !this->literals.empty()) {
+            this->writeRecord();
+        }
+        this->outRun = this->pendingOut;
+    } else {
+        this->literals.insert(this->literals.end(), this->pendingOut, Fractal::STEPS_OUT_OF_SCALE);
+    }
+    this->pendingOut = 0;
+}
+
+void DataFileWriter::writeFallback(const char *fallback, std::size_t first, std::size_t last) {
+    std::vector<uint8_t> bytes;
+    std::size_t pixel, firstByte;
+    std::streampos position;
+
+    if (this->pixelsWritten + (last - first) > (std::size_t) this->header.imgSizeX * this->header.imgSizeY) {
+        throw std::runtime_error("More pixels than the data file holds");
+    }
+    // The bytes of the plane completed by these pixels, starting with the partial one.
+    firstByte = this->pixelsWritten / 8;
+    bytes.assign((this->pixelsWritten + (last - first)) / 8 - firstByte, 0);
+    for (std::size_t i = first; i < last; i++, this->pixelsWritten++) {
+        pixel = this->pixelsWritten;
+        if (fallback[i]) {
+            this->partialByte |= 1 << (pixel % 8);
+        }
+        if (pixel % 8 == 7) {
+            bytes[pixel / 8 - firstByte] = this->partialByte;
+            this->partialByte = 0;
+        }
+    }
+    if (bytes.empty()) {
+        return;
+    }
+    position = this->file.tellp();
+    this->file.seekp(this->header.fallbackOffset + firstByte);
+    this->file.write((const char *) bytes.data(), bytes.size());
+    this->file.seekp(position);
+}
+
+void DataFileWriter::write(const StepsBuffer &data, std::size_t first, std::size_t last, const char *fallback) {
+    int steps;
+
+    if ((uint32_t) data.bytesPerPixel() * 8 != this->header.bitsPerPixel) {
+        throw std::runtime_error("The data do not match the storage of the data file");
+    }
+    if (this->header.flags & DataFile::FLAG_FALLBACK) {
+        if (fallback == nullptr) {
+            throw std::runtime_error("The data file needs the fallback flags of the pixels");
+        }
+        this->writeFallback(fallback, first, last);
+    }
+    if (this->header.encoding == (uint32_t) DataFile::Encoding::Dense) {
+        data.write(this->file, first, last);
+        this->checkStream();
+        return;
+    }
+
+    for (std::size_t i = first; i < last; i++) {
+        steps = data.get(i);
+        if (steps == Fractal::STEPS_OUT_OF_SCALE) {
+            // The length of a run is stored in 32 bits: a longer one continues in the next record.
+            if (++this->pendingOut == UINT32_MAX) {
+                this->endRun();
+            }
+            continue;
+        }
+        this->endRun();
+        this->literals.push_back(steps);
+        if (this->literals.size() >= (std::size_t) DataFile::MAX_LITERALS) {
+            this->writeRecord();
+        }
+    }
+    this->checkStream();
+}
+
+void DataFileWriter::close() {
+    if (this->header.encoding == (uint32_t) DataFile::Encoding::RunLength) {
+        this->endRun();
+        if (this->outRun > 0 || !this->literals.empty()) {
+            this->writeRecord();
+        }
+    }
+
+    this->header.dataSize = (uint64_t) this->file.tellp() - this->header.dataOffset;
+    if ((this->header.flags & DataFile::FLAG_FALLBACK) && this->pixelsWritten % 8 != 0) {
+        this->file.seekp(this->header.fallbackOffset + this->pixelsWritten / 8);
+        this->file.write((const char *) &this->partialByte, sizeof(this->partialByte));
+    }
+    this->file.seekp(0);
+    this->file.write((const char *) &this->header, sizeof(this->header));
+    this->file.close();
+    this->checkStream();
+}
+
+DataFileReader::DataFileReader(const std::string fileName) :
+    fileDescriptor{-1}, mapping{nullptr}, mappingSize{0}, data16{nullptr}, data32{nullptr}, fallbackPlane{nullptr}
+{
+    struct stat fileStat;
+    std::string line;
+    std::size_t equal, pixelsNum, fallbackSize;
+
+    this->fileDescriptor = open(fileName.c_str(), O_RDONLY);
+    if (this->fileDescriptor < 0) {
+        throw std::runtime_error("Cannot open " + fileName);
+    }
+    if (fstat(this->fileDescriptor, &fileStat) != 0) {
+        close(this->fileDescriptor);
+        throw std::runtime_error("Cannot open " + fileName);
+    }
+    this->mappingSize = fileStat.st_size;
+    if (this->mappingSize < sizeof(this->header)) {
+        close(this->fileDescriptor);
+        throw std::runtime_error(fileName + " is not a data file");
+    }
+    this->mapping = (const char *) mmap(nullptr, this->mappingSize, PROT_READ, MAP_SHARED, this->fileDescriptor, 0);
+    if (this->mapping == MAP_FAILED) {
+        close(this->fileDescriptor);
+        throw std::runtime_error("Cannot map " + fileName);
+    }
+
+    std::memcpy(&this->header, this->mapping, sizeof(this->header));
+    // The flags of version 1 were reserved, and always 0.
+    pixelsNum = (std::size_t) this->header.imgSizeX * this->header.imgSizeY;
+    fallbackSize = (this->header.flags & DataFile::FLAG_FALLBACK) ? DataFile::fallbackPlaneSize(pixelsNum) : 0;
+    if (std::memcmp(this->header.magic, DataFile::MAGIC, sizeof(DataFile::MAGIC)) != 0
+        || this->header.version < 1 || this->header.version > DataFile::VERSION
+        || (this->header.flags & ~DataFile::FLAG_FALLBACK) != 0
+        || (this->header.bitsPerPixel != 16 && this->header.bitsPerPixel != 32)
+        || this->header.encoding > (uint32_t) DataFile::Encoding::RunLength
+        || sizeof(this->header) + this->header.parametersSize > this->header.dataOffset
+        || (fallbackSize > 0 && (this->header.fallbackOffset < sizeof(this->header) + this->header.parametersSize
+                                 || this->header.fallbackOffset + fallbackSize > this->header.dataOffset))
+        || this->header.dataOffset + this->header.dataSize != this->mappingSize
+        || (this->header.encoding == (uint32_t) DataFile::Encoding::Dense
+            && this->header.dataSize != (uint64_t) pixelsNum * this->header.bitsPerPixel / 8)) {
+        munmap((void *) this->mapping, this->mappingSize);
+        close(this->fileDescriptor);
+        throw std::runtime_error(fileName + " is not a valid data file (version up to " + std::to_string(DataFile::VERSION) + ")");
+    }
+
+    std::istringstream lines(std::string(this->mapping + sizeof(this->header), this->header.parametersSize));
+    while (std::getline(lines, line)) {
+        equal = line.find('=');
+        if (!line.empty() && line[0] == '#' && equal != std::string::npos) {
+            this->parameters[line.substr(1, equal - 1)] = line.substr(equal + 1);
+        }
+    }
+
+    if (fallbackSize > 0) {
+        this->fallbackPlane = (const uint8_t *) (this->mapping + this->header.fallbackOffset);
+    }
+    if (this->header.encoding == (uint32_t) DataFile::Encoding::Dense) {
+        this->data16 = (const uint16_t *) (this->mapping + this->header.dataOffset);
+        this->data32 = (const int32_t *) (this->mapping + this->header.dataOffset);
+    } else {
+        try {
+            this->decodeRunLength();
+        } catch (const std::runtime_error &) {
+            munmap((void *) this->mapping, this->mappingSize);
+            close(this->fileDescriptor);
+            throw;
+        }
+    }
+}
+
+DataFileReader::~DataFileReader() {
+    munmap((void *) this->mapping, this->mappingSize);
+    close(this->fileDescriptor);
+}
+
+void DataFileReader::decodeRunLength() {
+    const char *position, *end;
+    uint32_t outRun, literalsNum;
+    std::size_t pixel, pixelsNum;
+    int bytesPerPixel;
+    uint16_t value16;
+    int32_t value32;
+
+    pixelsNum = (std::size_t) this->header.imgSizeX * this->header.imgSizeY;
+    bytesPerPixel = this->header.bitsPerPixel / 8;
+    this->decoded.assign(pixelsNum, bytesPerPixel == 2, Fractal::STEPS_OUT_OF_SCALE);
+
+    position = this->mapping + this->header.dataOffset;
+    end = position + this->header.dataSize;
+    pixel = 0;
+    while (position < end) {
+        if (end - position < 8) {
+            throw std::runtime_error("Truncated run-length data");
+        }
+        std::memcpy(&outRun, position, sizeof(outRun));
+        std::memcpy(&literalsNum, position + 4, sizeof(literalsNum));
+        position += 8;
+        if (pixel + outRun + literalsNum > pixelsNum || (std::size_t) (end - position) < (std::size_t) literalsNum * bytesPerPixel) {
+            throw std::runtime_error("Corrupted run-length data");
+        }
+        // The buffer is already filled with STEPS_OUT_OF_SCALE.
+        pixel += outRun;
+        for (uint32_t i = 0; i < literalsNum; i++, pixel++, position += bytesPerPixel) {
+            if (bytesPerPixel == 2) {
+                std::memcpy(&value16, position, sizeof(value16));
+                this->decoded.set(pixel, value16);
+            } else {
+                std::memcpy(&value32, position, sizeof(value32));
+                this->decoded.set(pixel, value32);
+            }
+        }
+    }
+    if (pixel != pixelsNum) {
+        throw std::runtime_error("Truncated run-length data");
+    }
+}
+
+int DataFileReader::getImgSizeX() const {
+    return this->header.imgSizeX;
+}
+
+int DataFileReader::getImgSizeY() const {
+    return this->header.imgSizeY;
+}
+
+DataFile::Encoding DataFileReader::getEncoding() const {
+    return (DataFile::Encoding) this->header.encoding;
+}
+
+std::string DataFileReader::getParameter(const std::string &name) const {
+    auto parameter = this->parameters.find(name);
+    if (parameter == this->parameters.end()) {
+        throw std::runtime_error("Missing parameter " + name + " in the data file");
+    }
+    return parameter->second;
+}
+
+const std::map<std::string, std::string> &DataFileReader::getParameters() const {
+    return this->parameters;
+}
+
+int DataFileReader::getSteps(int x, int y) const {
+    return this->getSteps((std::size_t) y * this->header.imgSizeX + x);
+}
+
+int DataFileReader::getSteps(std::size_t index) const {
+    if (this->header.encoding == (uint32_t) DataFile::Encoding::RunLength) {
+        return this->decoded.get(index);
+    }
+    return this->header.bitsPerPixel == 16 ? this->data16[index] : this->data32[index];
+}
+
+bool DataFileReader::hasFallback() const {
+    return this->fallbackPlane != nullptr;
+}
+
+bool DataFileReader::getFallback(int x, int y) const {
+    return this->getFallback((std::size_t) y * this->header.imgSizeX + x);
+}
+
+bool DataFileReader::getFallback(std::size_t index) const {
+    return this->fallbackPlane != nullptr && (this->fallbackPlane[index / 8] >> (index % 8)) & 1;
+}
@@ -0,0 +1,157 @@
+#ifndef DATA_FILE
+#define DATA_FILE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include "StepsBuffer.hpp"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The binary data files are little-endian and mapped as they are: a little-endian host is needed"
+#endif
+
+/*
+ * Binary file holding the number of steps of each pixel of a UniformGrid,
+ * which can be mapped in memory and read without parsing.
+ *
+ * The file starts with a fixed header (DataFile::Header), followed by the
+ * simulation parameters as text lines in the form "#name=value" (the same
+ * header lines as UniformGrid::saveData()). The data start at the next page
+ * boundary, with one of two encodings:
+ *  - Dense: the steps of all the pixels row by row, in 16 or 32 bits each
+ *    (see StepsBuffer);
+ *  - RunLength: a sequence of records, each made of the number of pixels
+ *    which never flip (STEPS_OUT_OF_SCALE) and the number of pixels which
+ *    follow them literally, both as 32 bits integers, and then those pixels.
+ *    Only runs of at least MIN_RUN pixels are encoded.
+ * With FLAG_FALLBACK (version 2) the fallback plane comes before the data,
+ * at fallbackOffset (after the parameters, page aligned): one bit for each
+ * pixel row by row, least significant bit first, set for the pixels
+ * recomputed by the double precision fallback (see Fractal::Precision). Its
+ * size only depends on the image, so it is written band by band along with
+ * the data. Version 1 files have no flags.
+ * All numbers are little-endian.
+ */
+class DataFile {
+    public:
+        enum class Encoding {Dense, RunLength};
+        static std::string encodingToString(DataFile::Encoding encoding);
+        // Returns false if the name does not match any encoding.
+        static bool stringToEncoding(const std::string &name, DataFile::Encoding &encoding);
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t bitsPerPixel;
+            uint32_t encoding;
+            uint32_t imgSizeX, imgSizeY;
+            uint32_t parametersSize;
+            // Position and size in [bytes] of the data.
+            uint64_t dataOffset, dataSize;
+            uint32_t flags;
+            char reserved[4];
+            // Position in [bytes] of the fallback plane, 0 without FLAG_FALLBACK.
+            uint64_t fallbackOffset;
+        };
+
+        static const char MAGIC[8];
+        static const uint32_t VERSION;
+        // The file has a fallback plane.
+        static const uint32_t FLAG_FALLBACK;
+        // Size in [bytes] of the fallback plane of pixelsNum pixels.
+        static std::size_t fallbackPlaneSize(std::size_t pixelsNum);
+        // Shortest run of pixels not flipping encoded by RunLength.
+        static const int MIN_RUN;
+        // Longest sequence of literal pixels in a RunLength record.
+        static const int MAX_LITERALS;
+};
+
+// Write a data file sequentially, row by row.
+class DataFileWriter {
+    private:
+        std::string fileName;
+        std::ofstream file;
+        DataFile::Header header;
+        // With RunLength: the record being built, and the run of pixels not flipping after it.
+        uint32_t outRun;
+        std::vector<int> literals;
+        uint32_t pendingOut;
+        /*
+         * With FLAG_FALLBACK: the pixels written so far, and the bits of the
+         * last byte of the plane if they do not fill it yet, written when it
+         * is complete or by close().
+         */
+        std::size_t pixelsWritten;
+        uint8_t partialByte;
+
+        void writeRecord();
+        // Close the run of pixels not flipping: a long one starts a new record, a short one is kept literally.
+        void endRun();
+        // Add the fallback flags of the pixels [first, last) to the plane, writing the bytes they complete.
+        void writeFallback(const char *fallback, std::size_t first, std::size_t last);
+        // Throws std::runtime_error if a write failed.
+        void checkStream();
+
+    public:
+        // The parameters are text lines in the form "#name=value". With fallback the file has a fallback plane.
+        DataFileWriter(const std::string fileName, const std::string &parameters, int imgSizeX, int imgSizeY,
+                       bool compact, DataFile::Encoding encoding, bool fallback = false);
+        // Calls close() if needed, ignoring its errors.
+        ~DataFileWriter();
+
+        /*
+         * Append the pixels [first, last) of data, and their fallback flags
+         * (at the same indices) if the file has a fallback plane; throws
+         * std::runtime_error if the file cannot be written.
+         */
+        void write(const StepsBuffer &data, std::size_t first, std::size_t last, const char *fallback = nullptr);
+        // Complete the file; throws std::runtime_error if it cannot be written.
+        void close();
+};
+
+/*
+ * Read a data file mapping it in memory: with Dense encoding the pixels are
+ * read directly from the mapping, RunLength data are decoded at opening.
+ *
+ * Throws std::runtime_error if the file cannot be read.
+ */
+class DataFileReader {
+    private:
+        int fileDescriptor;
+        const char *mapping;
+        std::size_t mappingSize;
+        DataFile::Header header;
+        std::map<std::string, std::string> parameters;
+        // The dense data: in the mapping, or decoded in this->decoded.
+        const uint16_t *data16;
+        const int32_t *data32;
+        StepsBuffer decoded;
+        // In the mapping, nullptr without FLAG_FALLBACK.
+        const uint8_t *fallbackPlane;
+
+        void decodeRunLength();
+
+    public:
+        DataFileReader(const std::string fileName);
+        ~DataFileReader();
+
+        int getImgSizeX() const;
+        int getImgSizeY() const;
+        DataFile::Encoding getEncoding() const;
+        // Value of a simulation parameter (e.g. "L1"); throws std::runtime_error if missing.
+        std::string getParameter(const std::string &name) const;
+        const std::map<std::string, std::string> &getParameters() const;
+        // Number of steps of pixel (x, y).
+        int getSteps(int x, int y) const;
+        // Number of steps of the pixel of index y * imgSizeX + x.
+        int getSteps(std::size_t index) const;
+        // Whether the file has a fallback plane: only the ones saved with Mixed precision.
+        bool hasFallback() const;
+        // Whether pixel (x, y), or the one of the given index, went through the fallback (false without a fallback plane).
+        bool getFallback(int x, int y) const;
+        bool getFallback(std::size_t index) const;
+};
+
+#endif
@@ -1,42 +1,477 @@
 #define _USE_MATH_DEFINES
 #include <memory>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
 #include "Fractal.hpp"
-#include "../DoublePendulum/SimpleDoublePendulum.hpp"
-#include "../DoublePendulum/CompoundDoublePendulum.hpp"
+#include "../DoublePendulum/PendulumKernel.hpp"
+#include "../DoublePendulum/KernelDispatch.hpp"
+#include "../DoublePendulum/DormandPrince54.hpp"
+#include "../DoublePendulum/SymplecticIntegrators.hpp"
+#include "../DoublePendulum/LaneState.hpp"
+#include "RecurrenceDetector.hpp"
+#include "Instrumentation.hpp"
 
 const int Fractal::STEPS_OUT_OF_SCALE = 0;
 
 Fractal::Fractal(std::unique_ptr<DoublePendulum> pendulum) :
-    pendulum{std::move(pendulum)} {};
+    pendulum{std::move(pendulum)}, precision{Precision::Double}, fallbackFraction{0.5},
+    earlyExit{EarlyExit::Off}, recurrenceTolerance{0.001}, measureEnergyDrift{false} {
+    double restEnergy, rod1UpEnergy, rod2UpEnergy;
+
+    restEnergy = this->pendulum->getEnergy({0, 0, 0, 0});
+    rod1UpEnergy = this->pendulum->getEnergy({M_PI, 0, 0, 0});
+    rod2UpEnergy = this->pendulum->getEnergy({0, 0, M_PI, 0});
+    this->k1 = (rod1UpEnergy - restEnergy) / 2;
+    this->k2 = (rod2UpEnergy - restEnergy) / 2;
+    this->flipEnergy = std::min(rod1UpEnergy, rod2UpEnergy) - restEnergy;
+};
 
 // Copy operator.
 Fractal& Fractal::operator=(Fractal &&f) {
     if (this != &f)
     {
         this->pendulum = std::move(f.pendulum);
+        this->precision = f.precision;
+        this->fallbackFraction = f.fallbackFraction;
+        this->earlyExit = f.earlyExit;
+        this->recurrenceTolerance = f.recurrenceTolerance;
+        this->measureEnergyDrift = f.measureEnergyDrift;
+        this->k1 = f.k1;
+        this->k2 = f.k2;
+        this->flipEnergy = f.flipEnergy;
+        this->statistics = f.getStatistics();
     }
     return *this;
 };
 
 // Move constructor.
-Fractal::Fractal(Fractal &&f) : pendulum(std::move(f.pendulum)) {}
+Fractal::Fractal(Fractal &&f) :
+    pendulum(std::move(f.pendulum)), precision(f.precision), fallbackFraction(f.fallbackFraction),
+    earlyExit(f.earlyExit), recurrenceTolerance(f.recurrenceTolerance), measureEnergyDrift(f.measureEnergyDrift),
+    k1(f.k1), k2(f.k2), flipEnergy(f.flipEnergy), statistics(f.getStatistics()) {}
 
-bool Fractal::detectFlip(StateVector prevState, StateVector currState) {
+std::string Fractal::precisionToString(Fractal::Precision precision) {
+    switch (precision) {
+        case Fractal::Precision::Double:
+            return "double";
+        case Fractal::Precision::Mixed:
+            return "mixed";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool Fractal::stringToPrecision(const std::string &name, Fractal::Precision &precision) {
+    for (auto candidate: {Fractal::Precision::Double, Fractal::Precision::Mixed}) {
+        if (name == Fractal::precisionToString(candidate)) {
+            precision = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Fractal::earlyExitToString(Fractal::EarlyExit earlyExit) {
+    switch (earlyExit) {
+        case Fractal::EarlyExit::Off:
+            return "off";
+        case Fractal::EarlyExit::Measure:
+            return "measure";
+        case Fractal::EarlyExit::Recurrence:
+            return "recurrence";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool Fractal::stringToEarlyExit(const std::string &name, Fractal::EarlyExit &earlyExit) {
+    for (auto candidate: {Fractal::EarlyExit::Off, Fractal::EarlyExit::Measure, Fractal::EarlyExit::Recurrence}) {
+        if (name == Fractal::earlyExitToString(candidate)) {
+            earlyExit = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Fractal::Statistics::merge(const Fractal::Statistics &other) {
+    this->trajectories += other.trajectories;
+    this->energyDriftMax = std::max(this->energyDriftMax, other.energyDriftMax);
+    this->energyDriftSum += other.energyDriftSum;
+    this->energyDriftSamples += other.energyDriftSamples;
+    this->unconvergedSteps += other.unconvergedSteps;
+    this->fallbacks += other.fallbacks;
+    this->earlyExits += other.earlyExits;
+    this->stepsAfterDetection += other.stepsAfterDetection;
+    this->earlyExitsFlipped += other.earlyExitsFlipped;
+    this->steps += other.steps;
+    this->laneSteps += other.laneSteps;
+    this->ruledOut += other.ruledOut;
+    this->reachedMax += other.reachedMax;
+}
+
+Fractal::Statistics Fractal::getStatistics() {
+    std::lock_guard<std::mutex> lock(this->statisticsMutex);
+    return this->statistics;
+}
+
+void Fractal::report(RunReport &report) {
+    Statistics stats = this->getStatistics();
+
+    report.setNumber("trajectories", "integrated", stats.trajectories);
+    if (stats.energyDriftSamples > 0) {
+        report.setNumber("trajectories", "energyDriftMax", stats.energyDriftMax);
+        report.setNumber("trajectories", "energyDriftMean", stats.energyDriftSum / stats.energyDriftSamples);
+    }
+    if (this->pendulum->isSymplectic()) {
+        report.setNumber("trajectories", "unconvergedSteps", stats.unconvergedSteps);
+    }
+    if (this->precision == Fractal::Precision::Mixed) {
+        report.setNumber("trajectories", "fallbacks", stats.fallbacks);
+    }
+    if (this->earlyExit == Fractal::EarlyExit::Recurrence) {
+        report.setNumber("trajectories", "earlyExits", stats.earlyExits);
+        report.setNumber("trajectories", "stepsSaved", stats.stepsAfterDetection);
+    } else if (this->earlyExit == Fractal::EarlyExit::Measure) {
+        report.setNumber("trajectories", "detectedTrapped", stats.earlyExits);
+        report.setNumber("trajectories", "stepsAfterDetection", stats.stepsAfterDetection);
+        report.setNumber("trajectories", "flippedAfterDetection", stats.earlyExitsFlipped);
+    }
+    if constexpr (Instrumentation::ENABLED) {
+        report.setNumber("trajectories", "ruledOut", stats.ruledOut);
+        report.setNumber("trajectories", "reachedMax", stats.reachedMax);
+        report.setNumber("trajectories", "steps", stats.steps);
+        // Only the lanes of RK4 run idle.
+        if (stats.laneSteps > 0) {
+            report.setNumber("trajectories", "laneSteps", stats.laneSteps);
+            report.setNumber("trajectories", "laneUtilization", (double) stats.steps / stats.laneSteps);
+        }
+    }
+}
+
+void Fractal::addStatistics(const Fractal::Statistics &stats) {
+    std::lock_guard<std::mutex> lock(this->statisticsMutex);
+    this->statistics.merge(stats);
+}
+
+void Fractal::recordEnergyDrift(Fractal::Statistics &stats, double ai1, double ai2, const StateVector &finalState) {
+    double initialEnergy, drift;
+
+    stats.trajectories++;
+    if (!this->measureEnergyDrift && !Instrumentation::ENABLED) {
+        return;
+    }
+    initialEnergy = this->pendulum->getEnergy({ai1, 0, ai2, 0});
+    // The relative error is not defined.
+    if (initialEnergy == 0) {
+        return;
+    }
+    drift = std::abs((this->pendulum->getEnergy(finalState) - initialEnergy) / initialEnergy);
+    stats.energyDriftMax = std::max(stats.energyDriftMax, drift);
+    stats.energyDriftSum += drift;
+    stats.energyDriftSamples++;
+}
+
+void Fractal::recordEarlyExit(Fractal::Statistics &stats, int detectedAt, int steps, bool flipped) {
+    if (detectedAt < 0) {
+        return;
+    }
+    stats.earlyExits++;
+    stats.stepsAfterDetection += steps - detectedAt - 1;
+    if (flipped) {
+        stats.earlyExitsFlipped++;
+    }
+}
+
+void Fractal::recordSteps(Fractal::Statistics &stats, int steps, bool reachedMax) {
+    if constexpr (Instrumentation::ENABLED) {
+        stats.steps += steps;
+        stats.reachedMax += reachedMax;
+    }
+}
+
+void Fractal::recordRuledOut(Fractal::Statistics &stats) {
+    if constexpr (Instrumentation::ENABLED) {
+        stats.ruledOut++;
+    }
+}
+
+double Fractal::recurrenceTimeScale() {
+    return sqrt((this->pendulum->L1 + this->pendulum->L2) / this->pendulum->g);
+}
+
+/*
+ * One step of length dt with any of the fixed step integrators, with RK4
+ * if the iterations of a symplectic one do not converge (then returns false).
+ *
+ * The integrator does not change during a run, so the branch is always
+ * predicted correctly.
+ */
+template<typename Kernel, typename Math>
+static inline bool fixedStep(const Kernel &kernel, DoublePendulum::Integrator integrator,
+                             const StateVector &currState, StateVector &nextState, double dt, Math math) {
+    switch (integrator) {
+        case DoublePendulum::Integrator::ImplicitMidpoint:
+            if (implicitMidpointStep(kernel.hamiltonian, currState, nextState, dt, math)) {
+                return true;
+            }
+            break;
+        case DoublePendulum::Integrator::GaussLegendre4:
+            if (gaussLegendre4Step(kernel.hamiltonian, currState, nextState, dt, math)) {
+                return true;
+            }
+            break;
+        case DoublePendulum::Integrator::StormerVerlet:
+            if (stormerVerletStep(kernel.hamiltonian, currState, nextState, dt, math)) {
+                return true;
+            }
+            break;
+        default:
+            rungeKutta4(kernel, currState, nextState, dt, math);
+            return true;
+    }
+    rungeKutta4(kernel, currState, nextState, dt, math);
+    return false;
+}
+
+float Fractal::countRounds(double a) {
     // The offset by PI is to start counting rounds at the top (at an agle of PI radians
     // in the global reference system) instead of at the bottom (0 radians).
-    float nRoundsRod1PrevState = floor((prevState.a1 - M_PI) / (2 * M_PI));
-    float nRoundsRod1CurrState = floor((currState.a1 - M_PI) / (2 * M_PI));
-    float nRoundsRod2PrevState = floor((prevState.a2 - M_PI) / (2 * M_PI));
-    float nRoundsRod2CurrState = floor((currState.a2 - M_PI) / (2 * M_PI));
+    return floor((a - M_PI) / (2 * M_PI));
+}
+
+// Angle at the bottom of the circle the rod is making, given its number of rounds.
+static inline double roundCenter(float nRounds) {
+    return 2 * M_PI * (nRounds + 1);
+}
+
+bool Fractal::detectFlip(StateVector prevState, StateVector currState) {
+    float nRoundsRod1PrevState = Fractal::countRounds(prevState.a1);
+    float nRoundsRod1CurrState = Fractal::countRounds(currState.a1);
+    float nRoundsRod2PrevState = Fractal::countRounds(prevState.a2);
+    float nRoundsRod2CurrState = Fractal::countRounds(currState.a2);
 
     return (nRoundsRod1PrevState != nRoundsRod1CurrState) || (nRoundsRod2PrevState != nRoundsRod2CurrState);
 };
 
+bool Fractal::canFlip(double ai1, double ai2) {
+    // The energy of the pendulum is conserved: it can only reach the states
+    // whose potential energy does not exceed the initial one.
+    return this->k1 * (1 - cos(ai1)) + this->k2 * (1 - cos(ai2)) >= this->flipEnergy;
+}
+
+double Fractal::cannotFlipHalfWidth(double ai2) {
+    double cosLimit;
+
+    if (this->k1 <= 0) {
+        return 0;
+    }
+    // canFlip() is false where cos(ai1) > cosLimit.
+    cosLimit = 1 - (this->flipEnergy - this->k2 * (1 - cos(ai2))) / this->k1;
+    if (cosLimit >= 1) {
+        return 0;
+    }
+    if (cosLimit < -1) {
+        return INFINITY;
+    }
+    return acos(cosLimit);
+}
+
+bool Fractal::needsFallback(int steps, int nStepMax) {
+    // The trajectories which do not flip are trusted in float, and no flip
+    // happens after nStepMax steps: fallbackFraction = 1 disables the fallback.
+    return steps != Fractal::STEPS_OUT_OF_SCALE && steps > this->fallbackFraction * nStepMax;
+}
 
 int Fractal::stepsToFlip(double ai1, double ai2, int nStepMax) {
-    int count;
+    bool fallback;
+    return this->stepsToFlip(ai1, ai2, nStepMax, fallback);
+}
+
+int Fractal::stepsToFlip(double ai1, double ai2, int nStepMax, bool &fallback) {
+    int cost;
+    return this->evaluate(ai1, ai2, nStepMax, fallback, cost);
+}
+
+int Fractal::evaluate(double ai1, double ai2, int nStepMax, bool &fallback, int &cost) {
+    Statistics stats;
+    int steps;
+
+    fallback = false;
+    if (this->precision == Fractal::Precision::Mixed && this->pendulum->integrator == DoublePendulum::Integrator::RK4) {
+        // Mixed precision only exists on lanes.
+        this->stepsToFlip(&ai1, &ai2, &steps, 1, nStepMax, &fallback, &cost);
+        return steps;
+    }
+
+    steps = visitMath(this->pendulum->mathAccuracy, [&](auto math) {
+        return visitKernel(*this->pendulum, [&](const auto &kernel) {
+            if (this->pendulum->isAdaptive()) {
+                double time = this->timeToFlipKernel(kernel, math, ai1, ai2, nStepMax * this->pendulum->dt, stats, cost);
+                if (time == Fractal::STEPS_OUT_OF_SCALE) {
+                    return Fractal::STEPS_OUT_OF_SCALE;
+                }
+                // Same convention of the fixed step integration: the flip happened
+                // during the step which starts after count steps.
+                return (int) floor(time / this->pendulum->dt);
+            }
+            return this->stepsToFlipKernel(kernel, math, ai1, ai2, nStepMax, stats, cost);
+        });
+    });
+
+    this->addStatistics(stats);
+    return steps;
+}
+
+void Fractal::stepsToFlip(const double *ai1, const double *ai2, int *steps, int n, int nStepMax, bool *fallback, int *cost) {
+    bool scalarFallback;
+    int scalarCost;
+
+    if (fallback != nullptr) {
+        std::fill(fallback, fallback + n, false);
+    }
+    if (this->pendulum->integrator != DoublePendulum::Integrator::RK4) {
+        // Only RK4 is implemented on lanes (adaptive integrators also need
+        // different step sizes for each trajectory).
+        for (int i = 0; i < n; i++) {
+            steps[i] = this->evaluate(ai1[i], ai2[i], nStepMax, scalarFallback, scalarCost);
+            if (cost != nullptr) {
+                cost[i] = scalarCost;
+            }
+        }
+        return;
+    }
+
+    Statistics stats;
+    auto evaluateDouble = [&](const double *ai1, const double *ai2, int *steps, int n, int *cost) {
+        visitMath(this->pendulum->mathAccuracy, [&](auto math) {
+            visitKernel(*this->pendulum, [&](const auto &kernel) {
+                this->stepsToFlipKernel<LaneState>(kernel, math, ai1, ai2, steps, n, nStepMax, stats, cost);
+            });
+        });
+    };
+
+    if (this->precision == Fractal::Precision::Double) {
+        evaluateDouble(ai1, ai2, steps, n, cost);
+        this->addStatistics(stats);
+        return;
+    }
+
+    // First pass in float on all the initial conditions...
+    visitMath(this->pendulum->mathAccuracy, [&](auto math) {
+        visitKernel(*this->pendulum, [&](const auto &kernel) {
+            typedef std::decay_t<decltype(kernel)> Kernel;
+            const PendulumKernel<Kernel::VARIANT, float> floatKernel(
+                this->pendulum->M1, this->pendulum->M2, this->pendulum->L1, this->pendulum->L2, this->pendulum->g);
+            this->stepsToFlipKernel<LaneStateFloat>(floatKernel, math, ai1, ai2, steps, n, nStepMax, stats, cost);
+        });
+    });
+
+    // ... then the untrustworthy ones are gathered and recomputed in double.
+    std::vector<int> indices, stepsFallback, costFallback;
+    std::vector<double> ai1Fallback, ai2Fallback;
+    for (int i = 0; i < n; i++) {
+        if (this->canFlip(ai1[i], ai2[i]) && this->needsFallback(steps[i], nStepMax)) {
+            indices.push_back(i);
+            ai1Fallback.push_back(ai1[i]);
+            ai2Fallback.push_back(ai2[i]);
+        }
+    }
+    stepsFallback.resize(indices.size());
+    costFallback.resize(indices.size());
+    evaluateDouble(ai1Fallback.data(), ai2Fallback.data(), stepsFallback.data(), indices.size(), costFallback.data());
+    for (std::size_t j = 0; j < indices.size(); j++) {
+        steps[indices[j]] = stepsFallback[j];
+        if (fallback != nullptr) {
+            fallback[indices[j]] = true;
+        }
+        // The cost of both passes.
+        if (cost != nullptr) {
+            cost[indices[j]] += costFallback[j];
+        }
+    }
+    stats.fallbacks += indices.size();
+    this->addStatistics(stats);
+}
+
+double Fractal::timeToFlip(double ai1, double ai2, double tMax) {
+    Statistics stats;
+    double time;
+    int cost;
+
+    time = visitMath(this->pendulum->mathAccuracy, [&](auto math) {
+        return visitKernel(*this->pendulum, [&](const auto &kernel) {
+            return this->timeToFlipKernel(kernel, math, ai1, ai2, tMax, stats, cost);
+        });
+    });
+    this->addStatistics(stats);
+    return time;
+}
+
+template<typename Kernel, typename Math>
+double Fractal::timeToFlipKernel(const Kernel &kernel, Math math, double ai1, double ai2, double tMax, Statistics &stats, int &cost) {
+    // Flips in the first two steps of length dt are ignored, as in stepsToFlipKernel().
+    const double tMin = 2 * this->pendulum->dt;
+    DormandPrince54<Kernel, Math> solver(kernel, this->pendulum->rtol, this->pendulum->atol, math);
+    StateVector initialState, midState;
+    double tLow, tHigh, tMid;
+
+    cost = 0;
+    if (!this->canFlip(ai1, ai2)) {
+        Fractal::recordRuledOut(stats);
+        return Fractal::STEPS_OUT_OF_SCALE;
+    }
+
+    initialState.a1 = ai1;
+    initialState.w1 = 0;
+    initialState.a2 = ai2;
+    initialState.w2 = 0;
+    solver.reset(initialState, 0, this->pendulum->dt);
+
+    // Numerically solve the state equation.
+    while (solver.step(tMax)) {
+        cost++;
+        if (solver.getTime() <= tMin || !this->detectFlip(solver.getPrevState(), solver.getState())) {
+            continue;
+        }
+
+        /*
+         * The flip happened during the last step: locate it by bisection on
+         * the dense output, which does not need any further evaluation of
+         * the state equation.
+         */
+        tLow = solver.getPrevTime();
+        tHigh = solver.getTime();
+        for (int i = 0; i < 40 && tHigh - tLow > 1e-12; i++) {
+            tMid = (tLow + tHigh) / 2;
+            midState = solver.denseOutput(tMid);
+            if (this->detectFlip(solver.getPrevState(), midState)) {
+                tHigh = tMid;
+            } else {
+                tLow = tMid;
+            }
+        }
+        if (tHigh > tMin) {
+            this->recordEnergyDrift(stats, ai1, ai2, solver.getState());
+            Fractal::recordSteps(stats, cost, false);
+            return tHigh;
+        }
+    }
+    this->recordEnergyDrift(stats, ai1, ai2, solver.getState());
+    Fractal::recordSteps(stats, cost, true);
+    return Fractal::STEPS_OUT_OF_SCALE;
+};
+
+template<typename Kernel, typename Math>
+int Fractal::stepsToFlipKernel(const Kernel &kernel, Math math, double ai1, double ai2, int nStepMax, Statistics &stats, int &cost) {
+    const double dt = this->pendulum->dt;
+    const DoublePendulum::Integrator integrator = this->pendulum->integrator;
+    int count, detectedAt;
+    double center1, center2;
     StateVector currState, nextState;
+    RecurrenceDetector detector;
     
     // Initial state.
     currState.a1 = ai1;
@@ -44,23 +479,189 @@ int Fractal::stepsToFlip(double ai1, double ai2, int nStepMax) {
     currState.a2 = ai2;
     currState.w2 = 0;
 
-    // If this condition is not met then it is physically impossible for any rod to flip.
-    // See: http://csaapt.org/uploads/3/4/4/2/34425343/csaapt_maypalace_sp16.pdf
-    if (3 * this->pendulum->L1 * cos(currState[0]) + this->pendulum->L2 * cos(currState[2]) > 2) {
+    cost = 0;
+    if (!this->canFlip(currState.a1, currState.a2)) {
+        Fractal::recordRuledOut(stats);
         return Fractal::STEPS_OUT_OF_SCALE;
     }
+    detector.reset(this->recurrenceTolerance, this->recurrenceTimeScale());
+    detectedAt = -1;
 
     // Numerically solve the state equation.
     for (count = 0; count < nStepMax; count++) {
-        nextState = this->pendulum->calcNextState(currState);
+        if (!fixedStep(kernel, integrator, currState, nextState, dt, math)) {
+            stats.unconvergedSteps++;
+        }
 
         // Check if a flip happened between the last two states.
         if (count > 1 && this->detectFlip(currState, nextState)) {
+            this->recordEnergyDrift(stats, ai1, ai2, nextState);
+            Fractal::recordEarlyExit(stats, detectedAt, count + 1, true);
+            cost = count + 1;
+            Fractal::recordSteps(stats, cost, false);
             return count;
         }
 
+        // Check if the trajectory got trapped.
+        if (this->earlyExit != Fractal::EarlyExit::Off && detectedAt < 0) {
+            center1 = roundCenter(Fractal::countRounds(currState.a1));
+            center2 = roundCenter(Fractal::countRounds(currState.a2));
+            if (detector.update(currState.a1 - center1, currState.a2 - center2, currState.w2,
+                                nextState.a1 - center1, nextState.a2 - center2, nextState.w2)) {
+                detectedAt = count;
+                if (this->earlyExit == Fractal::EarlyExit::Recurrence) {
+                    this->recordEnergyDrift(stats, ai1, ai2, nextState);
+                    Fractal::recordEarlyExit(stats, detectedAt, nStepMax, false);
+                    cost = count + 1;
+                    Fractal::recordSteps(stats, cost, false);
+                    return Fractal::STEPS_OUT_OF_SCALE;
+                }
+            }
+        }
+
         // Update the current state.
         currState = nextState;
     }
+    this->recordEnergyDrift(stats, ai1, ai2, currState);
+    Fractal::recordEarlyExit(stats, detectedAt, nStepMax, false);
+    cost = nStepMax;
+    Fractal::recordSteps(stats, cost, true);
     return Fractal::STEPS_OUT_OF_SCALE;
+};
+
+template<typename State, typename Kernel, typename Math>
+void Fractal::stepsToFlipKernel(const Kernel &kernel, Math math, const double *ai1, const double *ai2, int *steps, int n, int nStepMax,
+                                Statistics &stats, int *cost) {
+    const int LANES = State::LANES;
+    const double dt = this->pendulum->dt;
+    State currState, nextState;
+    // Index of the initial condition assigned to each lane (-1 if the lane is idle).
+    int pixel[LANES];
+    // Number of steps performed so far by each lane.
+    int count[LANES];
+    // Number of rounds of each rod in the current state of each lane.
+    float nRoundsRod1[LANES], nRoundsRod2[LANES];
+    float nRoundsRod1Next, nRoundsRod2Next;
+    // Recurrence detection of each lane, and step at which the lane was found trapped (-1 if not yet).
+    RecurrenceDetector detector[LANES];
+    int detectedAt[LANES];
+    const double timeScale = this->recurrenceTimeScale();
+    double center1, center2;
+    int nextPixel, activeLanes;
+    // The trajectories recomputed by the double precision fallback are only recorded once, by the fallback.
+    auto recorded = [&](int steps) {
+        return !std::is_same_v<State, LaneStateFloat> || !this->needsFallback(steps, nStepMax);
+    };
+
+    // Load the next initial condition which can possibly flip in lane l.
+    nextPixel = 0;
+    auto refill = [&](int l) {
+        while (nextPixel < n) {
+            int i = nextPixel++;
+            if (nStepMax <= 0 || !this->canFlip(ai1[i], ai2[i])) {
+                steps[i] = Fractal::STEPS_OUT_OF_SCALE;
+                if (cost != nullptr) {
+                    cost[i] = 0;
+                }
+                Fractal::recordRuledOut(stats);
+                continue;
+            }
+            pixel[l] = i;
+            count[l] = 0;
+            currState.a1[l] = ai1[i];
+            currState.w1[l] = 0;
+            currState.a2[l] = ai2[i];
+            currState.w2[l] = 0;
+            nRoundsRod1[l] = Fractal::countRounds(currState.a1[l]);
+            nRoundsRod2[l] = Fractal::countRounds(currState.a2[l]);
+            detector[l].reset(this->recurrenceTolerance, timeScale);
+            detectedAt[l] = -1;
+            return true;
+        }
+        // Nothing left to do: the lane keeps integrating a still pendulum,
+        // but its results are ignored.
+        pixel[l] = -1;
+        currState.a1[l] = 0;
+        currState.w1[l] = 0;
+        currState.a2[l] = 0;
+        currState.w2[l] = 0;
+        return false;
+    };
+
+    activeLanes = 0;
+    for (int l = 0; l < LANES; l++) {
+        if (refill(l)) {
+            activeLanes++;
+        }
+    }
+
+    // Numerically solve the state equation of all the lanes together.
+    while (activeLanes > 0) {
+        rungeKutta4(kernel, currState, nextState, dt, math);
+        if constexpr (Instrumentation::ENABLED) {
+            stats.laneSteps += LANES;
+        }
+
+        for (int l = 0; l < LANES; l++) {
+            if (pixel[l] < 0) {
+                continue;
+            }
+
+            // Check if a flip happened between the last two states.
+            nRoundsRod1Next = Fractal::countRounds(nextState.a1[l]);
+            nRoundsRod2Next = Fractal::countRounds(nextState.a2[l]);
+            if (count[l] > 1 && (nRoundsRod1[l] != nRoundsRod1Next || nRoundsRod2[l] != nRoundsRod2Next)) {
+                steps[pixel[l]] = count[l];
+                if (recorded(count[l])) {
+                    this->recordEnergyDrift(stats, ai1[pixel[l]], ai2[pixel[l]],
+                                            {nextState.a1[l], nextState.w1[l], nextState.a2[l], nextState.w2[l]});
+                    Fractal::recordEarlyExit(stats, detectedAt[l], count[l] + 1, true);
+                }
+                if (cost != nullptr) {
+                    cost[pixel[l]] = count[l] + 1;
+                }
+                Fractal::recordSteps(stats, count[l] + 1, false);
+                if (!refill(l)) {
+                    activeLanes--;
+                }
+                continue;
+            }
+
+            // Check if the trajectory got trapped.
+            if (this->earlyExit != Fractal::EarlyExit::Off && detectedAt[l] < 0) {
+                center1 = roundCenter(nRoundsRod1[l]);
+                center2 = roundCenter(nRoundsRod2[l]);
+                if (detector[l].update(currState.a1[l] - center1, currState.a2[l] - center2, currState.w2[l],
+                                       nextState.a1[l] - center1, nextState.a2[l] - center2, nextState.w2[l])) {
+                    detectedAt[l] = count[l];
+                }
+            }
+
+            count[l]++;
+            if (count[l] >= nStepMax || (this->earlyExit == Fractal::EarlyExit::Recurrence && detectedAt[l] >= 0)) {
+                steps[pixel[l]] = Fractal::STEPS_OUT_OF_SCALE;
+                if (recorded(Fractal::STEPS_OUT_OF_SCALE)) {
+                    this->recordEnergyDrift(stats, ai1[pixel[l]], ai2[pixel[l]],
+                                            {nextState.a1[l], nextState.w1[l], nextState.a2[l], nextState.w2[l]});
+                    Fractal::recordEarlyExit(stats, detectedAt[l], nStepMax, false);
+                }
+                if (cost != nullptr) {
+                    cost[pixel[l]] = count[l];
+                }
+                Fractal::recordSteps(stats, count[l], count[l] >= nStepMax && recorded(Fractal::STEPS_OUT_OF_SCALE));
+                if (!refill(l)) {
+                    activeLanes--;
+                }
+                continue;
+            }
+
+            // Update the current state of the lane.
+            currState.a1[l] = nextState.a1[l];
+            currState.w1[l] = nextState.w1[l];
+            currState.a2[l] = nextState.a2[l];
+            currState.w2[l] = nextState.w2[l];
+            nRoundsRod1[l] = nRoundsRod1Next;
+            nRoundsRod2[l] = nRoundsRod2Next;
+        }
+    }
 };
\ No newline at end of file
@@ -2,8 +2,11 @@
 #define FRACTAL
 
 #include <memory>
+#include <mutex>
+#include <string>
 #include "../DoublePendulum/DoublePendulum.hpp"
 #include "../DoublePendulum/StateVector.hpp"
+#include "RunReport.hpp"
 
 /*
  * It is possible to draw a fractal by evaluating after how much time a double
@@ -18,8 +21,98 @@
 class Fractal {
     public:
         static const int STEPS_OUT_OF_SCALE;
+
+        // Floating point precision of the batched evaluations with RK4.
+        enum class Precision {Double, Mixed};
+        static std::string precisionToString(Fractal::Precision precision);
+        // Returns false if the name does not match any precision.
+        static bool stringToPrecision(const std::string &name, Fractal::Precision &precision);
+
+        // Early termination of the trajectories which never flip (see earlyExit).
+        enum class EarlyExit {Off, Measure, Recurrence};
+        static std::string earlyExitToString(Fractal::EarlyExit earlyExit);
+        // Returns false if the name does not match any mode.
+        static bool stringToEarlyExit(const std::string &name, Fractal::EarlyExit &earlyExit);
+
+        // Statistics collected over the evaluations, to be reported at the end of a run.
+        struct Statistics {
+            // Number of trajectories which were integrated (not ruled out beforehand).
+            long trajectories = 0;
+            /*
+             * Relative energy error |E - E0| / |E0| at the end of the
+             * trajectories, only measured with measureEnergyDrift or by
+             * instrumented builds, over energyDriftSamples trajectories
+             * (those starting from E0 = 0 are left out).
+             */
+            double energyDriftMax = 0, energyDriftSum = 0;
+            long energyDriftSamples = 0;
+            // Steps of the symplectic integrators which did not converge, done with RK4 instead.
+            long unconvergedSteps = 0;
+            // Number of initial conditions recomputed in double precision (Mixed precision only).
+            long fallbacks = 0;
+            /*
+             * Trajectories detected as trapped and steps after the detection
+             * up to the flip or nStepMax (see earlyExit): the steps saved with
+             * Recurrence, only counted with Measure.
+             */
+            long earlyExits = 0, stepsAfterDetection = 0;
+            // Trajectories detected as trapped which flipped afterwards (EarlyExit::Measure only).
+            long earlyExitsFlipped = 0;
+            /*
+             * Only counted by instrumented builds (see Instrumentation): the
+             * steps integrated by the trajectories (in float and in double
+             * with Mixed precision), and by all the lanes including the idle
+             * ones; the initial conditions ruled out by canFlip(), and the
+             * trajectories which reached nStepMax without flipping.
+             */
+            long steps = 0, laneSteps = 0;
+            long ruledOut = 0, reachedMax = 0;
+
+            void merge(const Statistics &other);
+        };
+
         // Pointer to the double pendulum to observe.
         std::unique_ptr<DoublePendulum> pendulum;
+        /*
+         * With Mixed precision the initial conditions are first integrated
+         * in float, on twice as many lanes (see LaneStateFloat), and only the
+         * ones which flip after more than fallbackFraction * nStepMax steps
+         * are recomputed in double: there the chaotic motion has amplified
+         * the rounding errors of float the most, and the flip may fall on the
+         * other side of nStepMax. The trajectories which do not flip are
+         * trusted in float: they are most of the integrated steps, so that
+         * recomputing them made Mixed slower than Double, and a few of them
+         * flip late in double.
+         * On the compound pendulum over [-3, 3] x [-3, 3] with gridSize = 0.02,
+         * dt = 0.01 and fallbackFraction = 0.5 (default build, one thread):
+         * with nStepMax = 1500 5.8% of the evaluated pixels fall back, 0.2% of
+         * the pixels differ from Double precision (0.02% flip in double only)
+         * and the run is 1.4x faster; with nStepMax = 3000 3.3% fall back, 1%
+         * differ (0.1% flip in double only) and it is 1.5x faster.
+         * fallbackFraction = 1 disables the fallback.
+         * Only RK4 supports Mixed precision, other integrators always use double.
+         */
+        Precision precision;
+        double fallbackFraction;
+        /*
+         * Trajectories which never flip are integrated up to nStepMax, and
+         * dominate the run time when nStepMax is large. With Recurrence they
+         * are ended as soon as a RecurrenceDetector (with the given
+         * recurrenceTolerance) finds them trapped in a regular region of the
+         * phase space: this is a heuristic, and a few of them might have
+         * flipped later on.
+         * Measure runs the same detector without acting on it, so the results
+         * are unchanged and nothing is saved: the statistics report how many
+         * steps Recurrence would save and how many of its detections are wrong.
+         * On the full domain of the compound pendulum with nStepMax = 10000
+         * and recurrenceTolerance = 0.001, 330 trajectories are ended early
+         * and 2 of them would have flipped.
+         * Only the fixed step integrators support the early exit.
+         */
+        EarlyExit earlyExit;
+        double recurrenceTolerance;
+        // Measure the energy drift of each trajectory (two DoublePendulum::getEnergy() calls) in the statistics.
+        bool measureEnergyDrift;
 
         Fractal(std::unique_ptr<DoublePendulum> pendulum);
 
@@ -41,8 +134,96 @@ class Fractal {
         /*
          * Count how many steps it takes for the pendulum to "flip" from the
          * given initial condition.
+         *
+         * With an adaptive integrator the flip time is measured with
+         * timeToFlip() and converted to the equivalent number of steps of
+         * length dt, so that it can be used with the same color scale.
          */
         int stepsToFlip(double ai1, double ai2, int nStepMax);
+        // Same as above, also reporting wether the result comes from the double precision fallback.
+        int stepsToFlip(double ai1, double ai2, int nStepMax, bool &fallback);
+        /*
+         * Simulated time in [s] it takes for the pendulum to "flip" from the
+         * given initial condition, solving the motion with the adaptive
+         * integrator of the pendulum up to tMax.
+         * Returns STEPS_OUT_OF_SCALE if the pendulum does not flip.
+         */
+        double timeToFlip(double ai1, double ai2, double tMax);
+        /*
+         * Batched version of stepsToFlip(): evaluate n initial conditions
+         * (ai1[i], ai2[i]) storing the results in steps[i].
+         *
+         * The initial conditions are advanced LaneState::LANES at a time: as
+         * soon as a lane flips (or reaches nStepMax) it is refilled with the
+         * next initial condition, so that no lane sits idle while the others
+         * are still running.
+         *
+         * If fallback is not null, fallback[i] reports wether the result of
+         * the i-th initial condition was recomputed in double precision.
+         * If cost is not null, cost[i] is the number of steps integrated for
+         * the i-th initial condition (0 if it was ruled out by canFlip()).
+         */
+        void stepsToFlip(const double *ai1, const double *ai2, int *steps, int n, int nStepMax, bool *fallback = nullptr,
+                         int *cost = nullptr);
+
+        /*
+         * Check wether it is physically possible for any rod to flip starting
+         * still from (ai1, ai2): the potential energy of the initial state
+         * must reach the minimum energy of a state with a rod vertical
+         * upwards, which is either (pi, 0) or (0, pi).
+         *
+         * The potential energy of a still pendulum always has the form
+         *
+         *     V(a1, a2) = V(0, 0) + k1 (1 - cos(a1)) + k2 (1 - cos(a2))
+         *
+         * so k1 and k2 are measured once with DoublePendulum::getEnergy(),
+         * which makes the check exact for any variant and any M1, M2, L1, L2.
+         */
+        bool canFlip(double ai1, double ai2);
+        /*
+         * Along a line of constant ai2 the initial conditions which cannot
+         * flip are the ai1 within halfWidth of any multiple of 2 pi, i.e.
+         * cos(ai1) > cos(halfWidth). Returns 0 if all of them can flip and
+         * INFINITY if none can.
+         */
+        double cannotFlipHalfWidth(double ai2);
+
+        // Statistics of all the evaluations performed so far (thread safe).
+        Statistics getStatistics();
+        // Add the statistics to the "trajectories" section of the report.
+        void report(RunReport &report);
+
+    private:
+        // Coefficients of the potential energy and energy needed to flip, relative to V(0, 0) (see canFlip()).
+        double k1, k2, flipEnergy;
+        Statistics statistics;
+        std::mutex statisticsMutex;
+
+        // Merge the statistics of an evaluation into the global ones.
+        void addStatistics(const Statistics &stats);
+        // Count a trajectory which started still in (ai1, ai2), recording its energy error if measured.
+        void recordEnergyDrift(Statistics &stats, double ai1, double ai2, const StateVector &finalState);
+        // Number of complete circles made by a rod, counted from the top.
+        static float countRounds(double a);
+        // Account for a trajectory detected as trapped after detectedAt steps (if any), which integrated steps in total.
+        static void recordEarlyExit(Statistics &stats, int detectedAt, int steps, bool flipped);
+        // Count (if instrumented) a trajectory which integrated steps, and an initial condition ruled out.
+        static void recordSteps(Statistics &stats, int steps, bool reachedMax);
+        static void recordRuledOut(Statistics &stats);
+        // Characteristic time of the pendulum in [s], to compare angular velocities in the RecurrenceDetector.
+        double recurrenceTimeScale();
+        // Wether a result of the float integration (flipping or not) must be recomputed in double.
+        bool needsFallback(int steps, int nStepMax);
+        // stepsToFlip() of a single initial condition, also giving the number of steps integrated.
+        int evaluate(double ai1, double ai2, int nStepMax, bool &fallback, int &cost);
+        // Implementations of stepsToFlip() instantiated for each kernel and Math tier.
+        template<typename Kernel, typename Math>
+        int stepsToFlipKernel(const Kernel &kernel, Math math, double ai1, double ai2, int nStepMax, Statistics &stats, int &cost);
+        template<typename Kernel, typename Math>
+        double timeToFlipKernel(const Kernel &kernel, Math math, double ai1, double ai2, double tMax, Statistics &stats, int &cost);
+        template<typename State, typename Kernel, typename Math>
+        void stepsToFlipKernel(const Kernel &kernel, Math math, const double *ai1, const double *ai2, int *steps, int n, int nStepMax,
+                               Statistics &stats, int *cost);
 
 };
 
@@ -0,0 +1,36 @@
+#ifndef INSTRUMENTATION
+#define INSTRUMENTATION
+
+#include <chrono>
+
+// Set by the makefile, e.g. `make INSTRUMENT=1`.
+#ifndef INSTRUMENT
+#define INSTRUMENT 0
+#endif
+
+/*
+ * Switch of the counters and timings taken on the hot paths: the steps
+ * integrated and the outcome of each trajectory (see Fractal::Statistics),
+ * and the time each thread of a UniformGrid spends evaluating tiles.
+ *
+ * The code guarded by `if constexpr (Instrumentation::ENABLED)` is compiled
+ * out unless the program is built with INSTRUMENT=1. The counters are kept
+ * in variables local to each call or thread, and merged once at the end, so
+ * that the threads never write to shared memory while counting.
+ *
+ * The phase timings of the grids (compute, render, encode, save) are taken
+ * once per phase, and are always available.
+ */
+class Instrumentation {
+    public:
+        static constexpr bool ENABLED = INSTRUMENT != 0;
+
+        typedef std::chrono::steady_clock Clock;
+
+        // Time in [s] elapsed since start.
+        static double secondsSince(Clock::time_point start) {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdexcept>
+#include <algorithm>
+#include <future>
+#include <zlib.h>
+#include "PngWriter.hpp"
+#include "ThreadPool.hpp"
+
+// The rows are read as they are, 3 bytes per pixel.
+static_assert(sizeof(png::rgb_pixel) == 3, "png::rgb_pixel is not packed");
+
+const int PngWriter::DEFAULT_LEVEL = 6;
+const int PngWriter::MAX_LEVEL = 9;
+
+// Size of the deflate window, and so of the data priming each segment.
+static const std::size_t WINDOW_SIZE = 32768;
+// Smallest segment in [bytes]: smaller ones compress worse and are not worth a task.
+static const std::size_t MIN_SEGMENT_SIZE = 1 << 17;
+static const int BYTES_PER_PIXEL = 3;
+
+static void writeUint32(unsigned char *out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+// Write in out the filter type followed by the filtered row.
+static void filterRow(const unsigned char *row, const unsigned char *prior, std::size_t rowBytes, PngWriter::Filter filter,
+                      unsigned char *out) {
+    if (filter == PngWriter::Filter::Up) {
+        out[0] = 2;
+        for (std::size_t i = 0; i < rowBytes; i++) {
+            out[i + 1] = row[i] - prior[i];
+        }
+    } else {
+        out[0] = 0;
+        std::copy(row, row + rowBytes, out + 1);
+    }
+}
+
+/*
+ * Raw deflate of [data, data + size), able to refer to the dictionarySize
+ * bytes before it. The stream is ended by a sync flush, so that another one
+ * can follow, or finished if last.
+ */
+static std::vector<unsigned char> deflateSegment(const unsigned char *data, std::size_t size, std::size_t dictionarySize,
+                                                 int level, bool last) {
+    z_stream stream = {};
+    std::vector<unsigned char> out;
+    int result;
+
+    // A negative number of window bits gives a raw stream, without zlib header and checksum.
+    if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Cannot initialize zlib");
+    }
+    if (dictionarySize > 0) {
+        deflateSetDictionary(&stream, data - dictionarySize, dictionarySize);
+    }
+    // Room for the sync flush marker too.
+    out.resize(deflateBound(&stream, size) + 16);
+    stream.next_in = (Bytef *) data;
+    stream.avail_in = size;
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    while (true) {
+        result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (result == Z_STREAM_ERROR) {
+            deflateEnd(&stream);
+            throw std::runtime_error("zlib compression failed");
+        }
+        if (last ? result == Z_STREAM_END : stream.avail_out > 0) {
+            break;
+        }
+        out.resize(out.size() * 2);
+        stream.next_out = out.data() + stream.total_out;
+        stream.avail_out = out.size() - stream.total_out;
+    }
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+PngWriter::PngWriter(const std::string fileName, int width, int height, int compressionLevel, PngWriter::Filter filter) :
+    width{width}, height{height}, compressionLevel{compressionLevel}, filter{filter}, rowsWritten{0},
+    previousRow((std::size_t) width * BYTES_PER_PIXEL, 0), adler{(uint32_t) adler32(0, nullptr, 0)}
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    unsigned char header[13];
+
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        throw std::runtime_error("Invalid PNG compression level " + std::to_string(compressionLevel));
+    }
+    this->file.open(fileName, std::ios::binary);
+    if (!this->file) {
+        throw std::runtime_error("Cannot open " + fileName + " for writing");
+    }
+    this->file.write((const char *) signature, sizeof(signature));
+
+    // 8 bits RGB, not interlaced.
+    writeUint32(header, width);
+    writeUint32(header + 4, height);
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    this->writeChunk("IHDR", header, sizeof(header));
+}
+
+void PngWriter::writeChunk(const char *type, const unsigned char *data, std::size_t size) {
+    unsigned char field[4];
+    uLong crc;
+
+    writeUint32(field, size);
+    this->file.write((const char *) field, sizeof(field));
+    this->file.write(type, 4);
+    this->file.write((const char *) data, size);
+    crc = crc32(0, (const Bytef *) type, 4);
+    // With no data (a null pointer) crc32() would restart.
+    if (size > 0) {
+        crc = crc32(crc, data, size);
+    }
+    writeUint32(field, crc);
+    this->file.write((const char *) field, sizeof(field));
+    if (!this->file) {
+        throw std::runtime_error("Cannot write the PNG image");
+    }
+}
+
+void PngWriter::writeRows(const png::rgb_pixel *rows, int rowsNum) {
+    const unsigned char *raw = (const unsigned char *) rows;
+    std::size_t rowBytes, scanlineBytes, offset, bandSize;
+    int segmentRows, segmentsNum;
+    bool lastBand;
+    std::vector<unsigned char> scanlines;
+    std::vector<std::future<void>> filtering;
+    std::vector<std::future<std::vector<unsigned char>>> compressing;
+    std::vector<unsigned char> compressed;
+
+    if (rowsNum <= 0) {
+        return;
+    }
+    if (this->rowsWritten + rowsNum > this->height) {
+        throw std::runtime_error("Too many rows written to the PNG image");
+    }
+    rowBytes = (std::size_t) this->width * BYTES_PER_PIXEL;
+    scanlineBytes = rowBytes + 1;
+    lastBand = this->rowsWritten + rowsNum == this->height;
+
+    // One segment for each thread, unless too small.
+    ThreadPool &pool = ThreadPool::shared();
+    segmentRows = (rowsNum + pool.getSize() - 1) / pool.getSize();
+    segmentRows = std::max(segmentRows, (int) ((MIN_SEGMENT_SIZE + scanlineBytes - 1) / scanlineBytes));
+    segmentRows = std::min(segmentRows, rowsNum);
+    segmentsNum = (rowsNum + segmentRows - 1) / segmentRows;
+
+    // The segments follow the data priming the first one.
+    offset = this->window.size();
+    scanlines.resize(offset + rowsNum * scanlineBytes);
+    std::copy(this->window.begin(), this->window.end(), scanlines.begin());
+
+    // The scanlines: each row preceded by its filter type.
+    for (int s = 0; s < segmentsNum; s++) {
+        filtering.push_back(pool.submit([&, s]() {
+            const unsigned char *prior;
+
+            for (int y = s * segmentRows; y < std::min((s + 1) * segmentRows, rowsNum); y++) {
+                prior = y == 0 ? this->previousRow.data() : raw + (y - 1) * rowBytes;
+                filterRow(raw + y * rowBytes, prior, rowBytes, this->filter, scanlines.data() + offset + y * scanlineBytes);
+            }
+        }));
+    }
+    for (auto &task: filtering) {
+        task.get();
+    }
+
+    // Each segment can refer to the data before it, whichever segment they are in.
+    for (int s = 0; s < segmentsNum; s++) {
+        compressing.push_back(pool.submit([&, s]() {
+            std::size_t first = offset + s * segmentRows * scanlineBytes;
+            std::size_t last = offset + std::min((s + 1) * segmentRows, rowsNum) * scanlineBytes;
+
+            return deflateSegment(scanlines.data() + first, last - first, std::min(first, WINDOW_SIZE),
+                                  this->compressionLevel, lastBand && s == segmentsNum - 1);
+        }));
+    }
+
+    bandSize = rowsNum * scanlineBytes;
+    this->adler = adler32_combine(this->adler, adler32(adler32(0, nullptr, 0), scanlines.data() + offset, bandSize), bandSize);
+    for (int s = 0; s < segmentsNum; s++) {
+        compressed = compressing[s].get();
+        if (this->rowsWritten == 0 && s == 0) {
+            // zlib header: deflate with a 32 KiB window, and the hint of the compression level.
+            unsigned char cmf = 0x78, flg;
+            flg = (this->compressionLevel < 2 ? 0 : this->compressionLevel < 6 ? 1 : this->compressionLevel == 6 ? 2 : 3) << 6;
+            flg += 31 - (cmf * 256 + flg) % 31;
+            compressed.insert(compressed.begin(), {cmf, flg});
+        }
+        if (lastBand && s == segmentsNum - 1) {
+            compressed.resize(compressed.size() + 4);
+            writeUint32(compressed.data() + compressed.size() - 4, this->adler);
+        }
+        this->writeChunk("IDAT", compressed.data(), compressed.size());
+    }
+
+    std::copy(raw + (rowsNum - 1) * rowBytes, raw + rowsNum * rowBytes, this->previousRow.begin());
+    this->window.assign(scanlines.end() - std::min(scanlines.size(), WINDOW_SIZE), scanlines.end());
+    this->rowsWritten += rowsNum;
+    if (lastBand) {
+        this->writeChunk("IEND", nullptr, 0);
+        this->file.close();
+    }
+}
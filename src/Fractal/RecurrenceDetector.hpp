@@ -0,0 +1,84 @@
+#ifndef RECURRENCE_DETECTOR
+#define RECURRENCE_DETECTOR
+
+#include <cmath>
+#include <algorithm>
+
+/*
+ * Empirical detection of trajectories trapped in a regular (non-chaotic)
+ * region of the phase space, which are never going to flip.
+ *
+ * The trajectory is observed on a Poincare section: every time rod 1 passes
+ * through the bottom of its circle (a1 = 0) moving anticlockwise, the state
+ * is fully determined by (a2, w2), since the energy fixes w1. A regular
+ * trajectory lies on a torus and keeps returning close to the points it
+ * already visited on the section, while a chaotic one wanders around.
+ *
+ * The trajectory is deemed trapped as soon as a section point falls within
+ * tolerance of one of the first MAX_POINTS ones, provided that neither rod
+ * got closer than EXCURSION_MARGIN to the vertical upwards position so far.
+ * Distances are |delta a2| + |delta w2| * timeScale, with timeScale a
+ * characteristic time of the pendulum to make w2 an angle.
+ *
+ * This is a heuristic: a chaotic trajectory sticking to a regular island can
+ * return close to itself and still flip later on. Fractal::EarlyExit::Measure
+ * only counts the detections without acting on them, to measure how often
+ * this happens.
+ */
+class RecurrenceDetector {
+    public:
+        static const int MAX_POINTS = 64;
+        // Minimum distance in [rad] from the vertical upwards position.
+        static constexpr double EXCURSION_MARGIN = 0.5;
+
+        void reset(double tolerance, double timeScale) {
+            this->tolerance = tolerance;
+            this->timeScale = timeScale;
+            this->nPoints = 0;
+            this->excursion = 0;
+        }
+
+        /*
+         * Observe a step of the trajectory, from (a1Prev, a2Prev, w2Prev) to
+         * (a1Next, a2Next, w2Next), and return wether it is trapped.
+         * The angles are measured from the bottom of the current round of each
+         * rod, so that they are in (-pi, pi) (no flip happened in the step).
+         */
+        bool update(double a1Prev, double a2Prev, double w2Prev, double a1Next, double a2Next, double w2Next) {
+            double t, a2, w2;
+
+            this->excursion = std::max(this->excursion, std::max(std::abs(a1Next), std::abs(a2Next)));
+            if (!(a1Prev < 0 && a1Next >= 0)) {
+                return false;
+            }
+
+            // Linear interpolation of the crossing of the section.
+            t = - a1Prev / (a1Next - a1Prev);
+            a2 = a2Prev + t * (a2Next - a2Prev);
+            w2 = (w2Prev + t * (w2Next - w2Prev)) * this->timeScale;
+
+            if (this->excursion < M_PI - RecurrenceDetector::EXCURSION_MARGIN) {
+                for (int i = 0; i < this->nPoints; i++) {
+                    if (std::abs(this->a2[i] - a2) + std::abs(this->w2[i] - w2) < this->tolerance) {
+                        return true;
+                    }
+                }
+            }
+            if (this->nPoints < RecurrenceDetector::MAX_POINTS) {
+                this->a2[this->nPoints] = a2;
+                this->w2[this->nPoints] = w2;
+                this->nPoints++;
+            }
+            return false;
+        }
+
+    private:
+        double tolerance, timeScale;
+        // Section points visited so far.
+        double a2[MAX_POINTS], w2[MAX_POINTS];
+        int nPoints;
+        // Maximum angle reached by either rod so far.
+        double excursion;
+};
+
+#endif
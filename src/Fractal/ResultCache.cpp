@@ -0,0 +1,277 @@
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <sstream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "ResultCache.hpp"
+#include "Fractal.hpp"
+
+const int ResultCache::TILE_BITS = 6;
+const int ResultCache::TILE_SIZE = 1 << ResultCache::TILE_BITS;
+const std::size_t ResultCache::MAX_TILES = 1024;
+
+static const std::string HEADER_END = "#end\n";
+// Lattice, tile x, tile y, offset.
+static const std::size_t RECORD_SIZE = sizeof(int32_t) + 3 * sizeof(int64_t);
+
+// FNV-1a hash of the key, naming its files.
+static std::string hashKey(const std::string &key) {
+    uint64_t hash = 14695981039346656037ULL;
+    std::ostringstream name;
+
+    for (unsigned char c: key) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    name << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return name.str();
+}
+
+// The mantissa of the grid size is part of the key, its exponent selects the lattice.
+static std::string latticeKey(const std::string &key, double gridSize) {
+    std::ostringstream lines;
+    int exponent;
+
+    lines << key << "#gridMantissa=" << std::hexfloat << frexp(gridSize, &exponent) << std::endl;
+    return lines.str();
+}
+
+ResultCache::ResultCache(const std::string directory, const std::string &key, double gridSize) :
+    indexFileName{directory + "/" + hashKey(latticeKey(key, gridSize)) + ".index"},
+    tilesFileName{directory + "/" + hashKey(latticeKey(key, gridSize)) + ".tiles"},
+    indexDescriptor{-1}, tilesDescriptor{-1}, tilesFileSize{0}, indexFileSize{0}, hits{0}, misses{0}
+{
+    struct stat fileStat;
+    int64_t tileBytes;
+
+    frexp(gridSize, &this->exponent);
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Cannot create the cache directory " + directory);
+    }
+    this->indexDescriptor = open(this->indexFileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->indexDescriptor < 0) {
+        throw std::runtime_error("Cannot open the cache file " + this->indexFileName);
+    }
+    if (flock(this->indexDescriptor, LOCK_EX | LOCK_NB) != 0) {
+        close(this->indexDescriptor);
+        throw std::runtime_error("The cache " + directory + " is in use by another run");
+    }
+    this->tilesDescriptor = open(this->tilesFileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->tilesDescriptor < 0) {
+        close(this->indexDescriptor);
+        throw std::runtime_error("Cannot open the cache file " + this->tilesFileName);
+    }
+    try {
+        this->readIndex(latticeKey(key, gridSize));
+    } catch (const std::runtime_error &) {
+        close(this->tilesDescriptor);
+        close(this->indexDescriptor);
+        throw;
+    }
+    // A tile cut short by an interrupted run is not in the index, and is overwritten.
+    if (fstat(this->tilesDescriptor, &fileStat) == 0) {
+        tileBytes = (int64_t) ResultCache::TILE_SIZE * ResultCache::TILE_SIZE * (sizeof(int32_t) + 1);
+        this->tilesFileSize = fileStat.st_size / tileBytes * tileBytes;
+    }
+}
+
+ResultCache::~ResultCache() {
+    try {
+        this->flush();
+    } catch (const std::runtime_error &) {
+        // The results not written are lost, the files stay consistent.
+    }
+    close(this->tilesDescriptor);
+    close(this->indexDescriptor);
+}
+
+void ResultCache::readIndex(const std::string &key) {
+    std::string contents;
+    std::size_t headerSize, recordsNum;
+    std::vector<char> buffer(1 << 16);
+    ssize_t size;
+    TileKey tileKey;
+    int32_t lattice;
+    int64_t tileX, tileY, offset;
+
+    while ((size = read(this->indexDescriptor, buffer.data(), buffer.size())) > 0) {
+        contents.append(buffer.data(), size);
+    }
+    if (size < 0) {
+        throw std::runtime_error("Cannot read the cache file " + this->indexFileName);
+    }
+
+    if (contents.empty()) {
+        // New cache.
+        contents = key + HEADER_END;
+        if (write(this->indexDescriptor, contents.data(), contents.size()) != (ssize_t) contents.size()) {
+            throw std::runtime_error("Cannot write the cache file " + this->indexFileName);
+        }
+        this->indexFileSize = contents.size();
+        return;
+    }
+    if (contents.compare(0, key.size() + HEADER_END.size(), key + HEADER_END) != 0) {
+        throw std::runtime_error("The cache file " + this->indexFileName + " belongs to different parameters");
+    }
+
+    headerSize = key.size() + HEADER_END.size();
+    recordsNum = (contents.size() - headerSize) / RECORD_SIZE;
+    for (std::size_t r = 0; r < recordsNum; r++) {
+        const char *record = contents.data() + headerSize + r * RECORD_SIZE;
+        std::memcpy(&lattice, record, sizeof(lattice));
+        std::memcpy(&tileX, record + sizeof(int32_t), sizeof(tileX));
+        std::memcpy(&tileY, record + sizeof(int32_t) + sizeof(int64_t), sizeof(tileY));
+        std::memcpy(&offset, record + sizeof(int32_t) + 2 * sizeof(int64_t), sizeof(offset));
+        tileKey = TileKey(lattice, tileX, tileY);
+        this->offsets[tileKey] = offset;
+    }
+    // Drop a record cut short by an interrupted run.
+    this->indexFileSize = headerSize + recordsNum * RECORD_SIZE;
+    if ((std::size_t) this->indexFileSize != contents.size() && ftruncate(this->indexDescriptor, this->indexFileSize) != 0) {
+        throw std::runtime_error("Cannot repair the cache file " + this->indexFileName);
+    }
+}
+
+void ResultCache::locate(const ResultCache::Point &point, ResultCache::TileKey &key, int &position) const {
+    long i = point.i, j = point.j;
+    int lattice = this->exponent;
+
+    if (i == 0 && j == 0) {
+        // The origin belongs to every lattice.
+        lattice = 0;
+    } else {
+        // Halving the indices doubles the step of the lattice.
+        while ((i & 1) == 0 && (j & 1) == 0) {
+            i >>= 1;
+            j >>= 1;
+            lattice++;
+        }
+    }
+    key = TileKey(lattice, i >> ResultCache::TILE_BITS, j >> ResultCache::TILE_BITS);
+    position = (j & (ResultCache::TILE_SIZE - 1)) * ResultCache::TILE_SIZE + (i & (ResultCache::TILE_SIZE - 1));
+}
+
+ResultCache::Tile &ResultCache::getTile(const ResultCache::TileKey &key) {
+    std::size_t pointsNum = ResultCache::TILE_SIZE * ResultCache::TILE_SIZE;
+    std::size_t stepsSize = pointsNum * sizeof(int32_t);
+
+    auto found = this->tiles.find(key);
+    if (found != this->tiles.end()) {
+        return found->second;
+    }
+    if (this->tiles.size() >= ResultCache::MAX_TILES) {
+        this->writeBack();
+        this->tiles.clear();
+    }
+
+    Tile &tile = this->tiles[key];
+    tile.steps.assign(pointsNum, 0);
+    tile.fallback.assign(pointsNum, 0);
+    tile.offset = -1;
+    tile.dirty = false;
+    auto offset = this->offsets.find(key);
+    if (offset != this->offsets.end()) {
+        tile.offset = offset->second;
+        if (pread(this->tilesDescriptor, tile.steps.data(), stepsSize, tile.offset) != (ssize_t) stepsSize
+            || pread(this->tilesDescriptor, tile.fallback.data(), pointsNum, tile.offset + stepsSize) != (ssize_t) pointsNum) {
+            throw std::runtime_error("Cannot read the cache file " + this->tilesFileName);
+        }
+    }
+    return tile;
+}
+
+void ResultCache::lookup(const ResultCache::Point *points, std::size_t n, int nStepMax, int *steps, bool *fallback, bool *hit) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    TileKey key;
+    int position, value;
+
+    for (std::size_t k = 0; k < n; k++) {
+        this->locate(points[k], key, position);
+        Tile &tile = this->getTile(key);
+        value = tile.steps[position];
+        // A flip after nStepMax steps or more is out of scale.
+        hit[k] = value > 0 || (value < 0 && nStepMax <= -value);
+        if (hit[k]) {
+            steps[k] = value > 0 && value < nStepMax ? value : Fractal::STEPS_OUT_OF_SCALE;
+            fallback[k] = tile.fallback[position];
+            this->hits++;
+        } else {
+            this->misses++;
+        }
+    }
+}
+
+void ResultCache::store(const ResultCache::Point *points, std::size_t n, int nStepMax, const int *steps, const bool *fallback) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    TileKey key;
+    int position;
+
+    for (std::size_t k = 0; k < n; k++) {
+        this->locate(points[k], key, position);
+        Tile &tile = this->getTile(key);
+        tile.steps[position] = steps[k] == Fractal::STEPS_OUT_OF_SCALE ? -nStepMax : steps[k];
+        tile.fallback[position] = fallback[k];
+        tile.dirty = true;
+    }
+}
+
+void ResultCache::writeBack() {
+    std::size_t pointsNum = ResultCache::TILE_SIZE * ResultCache::TILE_SIZE;
+    std::size_t stepsSize = pointsNum * sizeof(int32_t);
+    std::string records;
+    char record[RECORD_SIZE];
+    int32_t lattice;
+    int64_t tileX, tileY;
+
+    // The data of the new tiles are written before their records.
+    for (auto &entry: this->tiles) {
+        Tile &tile = entry.second;
+        if (!tile.dirty) {
+            continue;
+        }
+        if (tile.offset < 0) {
+            tile.offset = this->tilesFileSize;
+            this->tilesFileSize += stepsSize + pointsNum;
+            this->offsets[entry.first] = tile.offset;
+            lattice = std::get<0>(entry.first);
+            tileX = std::get<1>(entry.first);
+            tileY = std::get<2>(entry.first);
+            std::memcpy(record, &lattice, sizeof(lattice));
+            std::memcpy(record + sizeof(int32_t), &tileX, sizeof(tileX));
+            std::memcpy(record + sizeof(int32_t) + sizeof(int64_t), &tileY, sizeof(tileY));
+            std::memcpy(record + sizeof(int32_t) + 2 * sizeof(int64_t), &tile.offset, sizeof(tile.offset));
+            records.append(record, RECORD_SIZE);
+        }
+        if (pwrite(this->tilesDescriptor, tile.steps.data(), stepsSize, tile.offset) != (ssize_t) stepsSize
+            || pwrite(this->tilesDescriptor, tile.fallback.data(), pointsNum, tile.offset + stepsSize) != (ssize_t) pointsNum) {
+            throw std::runtime_error("Cannot write the cache file " + this->tilesFileName);
+        }
+        tile.dirty = false;
+    }
+    if (!records.empty()) {
+        if (pwrite(this->indexDescriptor, records.data(), records.size(), this->indexFileSize) != (ssize_t) records.size()) {
+            throw std::runtime_error("Cannot write the cache file " + this->indexFileName);
+        }
+        this->indexFileSize += records.size();
+    }
+}
+
+void ResultCache::flush() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->writeBack();
+}
+
+long ResultCache::getHits() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->hits;
+}
+
+long ResultCache::getMisses() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->misses;
+}
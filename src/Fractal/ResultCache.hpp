@@ -0,0 +1,108 @@
+#ifndef RESULT_CACHE
+#define RESULT_CACHE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+
+/*
+ * On-disk cache of the number of steps to flip of the points of a grid, so
+ * that zooming into a region or rendering it again only evaluates the points
+ * which were never evaluated before.
+ *
+ * The points are the vertices of a lattice: point (i, j) has the initial
+ * angles (i * gridSize, j * gridSize), computed exactly this way by the
+ * callers, so that the same point always has the same coordinates. Lattices
+ * whose sizes differ by a power of 2 share their common points (e.g. zooming
+ * in by 2 reuses a quarter of the points): each point is stored once, on the
+ * coarsest of these lattices it belongs to.
+ *
+ * The results depend on the simulation parameters given as key: the cache in
+ * a directory holds the results of any number of keys, each in a pair of
+ * files named after the hash of the key:
+ *  - <hash>.tiles: the tiles of TILE_SIZE x TILE_SIZE points, each the steps
+ *    of all the points followed by their fallback flags;
+ *  - <hash>.index: the key lines ended by a "#end" line, followed by a record
+ *    (lattice, tile x, tile y, offset in the tiles file) for each tile.
+ *
+ * A stored value tells that the point flipped after that number of steps,
+ * or that it did not flip within some number of steps. The former answers
+ * any nStepMax, the latter any nStepMax up to that number: a render with a
+ * larger nStepMax evaluates again only the points which did not flip.
+ *
+ * The tiles are loaded when first needed, and written back by flush() or
+ * when more than MAX_TILES are in memory. The files are locked while open:
+ * a cache cannot be shared by concurrent runs.
+ */
+class ResultCache {
+    public:
+        // Lattice coordinates of a point.
+        struct Point { long i; long j; };
+
+    private:
+        static const int TILE_BITS;
+        static const int TILE_SIZE;
+        // Tiles held in memory at most, 20 KiB each.
+        static const std::size_t MAX_TILES;
+
+        // Lattice (the binary exponent of its step), tile x, tile y.
+        typedef std::tuple<int, long, long> TileKey;
+        struct Tile {
+            /*
+             * 0 if not evaluated, the steps to flip if positive, minus the
+             * number of steps without flipping if negative.
+             */
+            std::vector<int32_t> steps;
+            std::vector<char> fallback;
+            // Offset in the tiles file, -1 if not there yet.
+            int64_t offset;
+            bool dirty;
+        };
+
+        const std::string indexFileName, tilesFileName;
+        int indexDescriptor, tilesDescriptor;
+        // Binary exponent of the grid size.
+        int exponent;
+        std::map<TileKey, int64_t> offsets;
+        std::map<TileKey, Tile> tiles;
+        int64_t tilesFileSize, indexFileSize;
+        long hits, misses;
+        std::mutex mutex;
+
+        // Tile and position in the tile of the point, on the coarsest lattice it belongs to.
+        void locate(const ResultCache::Point &point, ResultCache::TileKey &key, int &position) const;
+        // The tile, loaded or created if not in memory.
+        ResultCache::Tile &getTile(const ResultCache::TileKey &key);
+        // Read the key and the records of the index file.
+        void readIndex(const std::string &key);
+        void writeBack();
+
+    public:
+        /*
+         * Open (or create) the cache of the results with the given key in
+         * directory, for a lattice of step gridSize.
+         * Throws std::runtime_error if the files cannot be used.
+         */
+        ResultCache(const std::string directory, const std::string &key, double gridSize);
+        // Flushes the cache.
+        ~ResultCache();
+
+        /*
+         * For each of the n points, set hit if the cache gives its result
+         * with nStepMax steps at most, and in that case steps and fallback.
+         */
+        void lookup(const ResultCache::Point *points, std::size_t n, int nStepMax, int *steps, bool *fallback, bool *hit);
+        // Store the results of the n points, evaluated with nStepMax steps at most.
+        void store(const ResultCache::Point *points, std::size_t n, int nStepMax, const int *steps, const bool *fallback);
+        // Write the modified tiles to the files.
+        void flush();
+
+        // Points found and not found in the cache by lookup().
+        long getHits();
+        long getMisses();
+};
+
+#endif
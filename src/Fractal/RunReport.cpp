@@ -0,0 +1,96 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <stdexcept>
+#include "RunReport.hpp"
+
+// A JSON number (JSON has no infinity or NaN).
+static std::string formatNumber(double value) {
+    std::ostringstream text;
+
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    text << std::setprecision(15) << value;
+    return text.str();
+}
+
+static std::string formatString(const std::string &value) {
+    std::ostringstream text;
+
+    text << '"';
+    for (char c: value) {
+        if (c == '"' || c == '\\') {
+            text << '\\' << c;
+        } else if ((unsigned char) c < 0x20) {
+            text << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec;
+        } else {
+            text << c;
+        }
+    }
+    text << '"';
+    return text.str();
+}
+
+void RunReport::set(const std::string &section, const std::string &name, const std::string &json) {
+    auto found = this->sections.begin();
+    while (found != this->sections.end() && found->first != section) {
+        found++;
+    }
+    if (found == this->sections.end()) {
+        this->sections.push_back({section, {}});
+        found = std::prev(this->sections.end());
+    }
+    for (auto &value: found->second) {
+        if (value.first == name) {
+            value.second = json;
+            return;
+        }
+    }
+    found->second.push_back({name, json});
+}
+
+void RunReport::setNumber(const std::string &section, const std::string &name, double value) {
+    this->set(section, name, formatNumber(value));
+}
+
+void RunReport::setString(const std::string &section, const std::string &name, const std::string &value) {
+    this->set(section, name, formatString(value));
+}
+
+void RunReport::setBool(const std::string &section, const std::string &name, bool value) {
+    this->set(section, name, value ? "true" : "false");
+}
+
+void RunReport::setNumbers(const std::string &section, const std::string &name, const std::vector<double> &values) {
+    std::string json = "[";
+
+    for (std::size_t i = 0; i < values.size(); i++) {
+        json += (i > 0 ? ", " : "") + formatNumber(values[i]);
+    }
+    this->set(section, name, json + "]");
+}
+
+void RunReport::save(const std::string fileName) const {
+    std::ofstream outFile(fileName);
+
+    if (!outFile) {
+        throw std::runtime_error("Cannot open " + fileName + " for writing");
+    }
+    outFile << "{" << std::endl;
+    for (std::size_t s = 0; s < this->sections.size(); s++) {
+        const Section &section = this->sections[s].second;
+        outFile << "  " << formatString(this->sections[s].first) << ": {" << std::endl;
+        for (std::size_t v = 0; v < section.size(); v++) {
+            outFile << "    " << formatString(section[v].first) << ": " << section[v].second
+                    << (v + 1 < section.size() ? "," : "") << std::endl;
+        }
+        outFile << "  }" << (s + 1 < this->sections.size() ? "," : "") << std::endl;
+    }
+    outFile << "}" << std::endl;
+    if (!outFile) {
+        throw std::runtime_error("Cannot write " + fileName);
+    }
+}
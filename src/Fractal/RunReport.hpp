@@ -0,0 +1,33 @@
+#ifndef RUN_REPORT
+#define RUN_REPORT
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/*
+ * Report of a run in JSON: an object of sections, each an object of named
+ * values, written in the order they were first set.
+ *
+ * The grids fill in their own sections (see UniformGrid::report() and
+ * AdaptiveGrid::report()), the binaries add the ones of the run.
+ */
+class RunReport {
+    private:
+        // Name and JSON text of each value, by section.
+        typedef std::vector<std::pair<std::string, std::string>> Section;
+        std::vector<std::pair<std::string, Section>> sections;
+
+        void set(const std::string &section, const std::string &name, const std::string &json);
+
+    public:
+        void setNumber(const std::string &section, const std::string &name, double value);
+        void setString(const std::string &section, const std::string &name, const std::string &value);
+        void setBool(const std::string &section, const std::string &name, bool value);
+        void setNumbers(const std::string &section, const std::string &name, const std::vector<double> &values);
+
+        // Throws std::runtime_error if the file cannot be written.
+        void save(const std::string fileName) const;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include <sstream>
+#include "Shard.hpp"
+
+std::string Shard::modeToString(Shard::Mode mode) {
+    switch (mode) {
+        case Shard::Mode::Rows:
+            return "rows";
+        case Shard::Mode::Tiles:
+            return "tiles";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool Shard::stringToMode(const std::string &name, Shard::Mode &mode) {
+    for (auto candidate: {Shard::Mode::Rows, Shard::Mode::Tiles}) {
+        if (name == Shard::modeToString(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Shard::Shard() : Shard(0, 1, Shard::Mode::Rows) {};
+
+Shard::Shard(int index, int num, Shard::Mode mode) : index{index}, num{num}, mode{mode} {};
+
+bool Shard::parse(const std::string &spec, Shard::Mode mode, Shard &shard) {
+    std::istringstream stream(spec);
+    int index, num;
+    char slash;
+
+    if (!(stream >> index >> slash >> num) || slash != '/' || !stream.eof()) {
+        return false;
+    }
+    if (num < 1 || index < 0 || index >= num) {
+        return false;
+    }
+    shard = Shard(index, num, mode);
+    return true;
+}
+
+std::string Shard::toString() const {
+    return std::to_string(this->index) + "/" + std::to_string(this->num);
+}
+
+bool Shard::ownsTile(int tileX, int tileY, int tilesX, int tilesY) const {
+    if (this->mode == Shard::Mode::Rows) {
+        return tileY >= (long) tilesY * this->index / this->num && tileY < (long) tilesY * (this->index + 1) / this->num;
+    }
+    return ((long) tileY * tilesX + tileX) % this->num == this->index;
+}
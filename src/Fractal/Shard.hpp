@@ -0,0 +1,41 @@
+#ifndef SHARD
+#define SHARD
+
+#include <string>
+
+/*
+ * Part of the tiles of a UniformGrid computed by one of several processes.
+ *
+ * The image is divided in square tiles of tileSize pixels (as by
+ * TileScheduler). Shard index of num gets either a contiguous range of tile
+ * rows (Rows), or one tile every num in row-major order (Tiles), which
+ * spreads the expensive areas of the fractal more evenly among the shards.
+ *
+ * The data of a shard are saved tile by tile in row-major order, each tile
+ * row by row (see UniformGrid::saveShard()), so that the shards can be
+ * stitched by reading each file sequentially.
+ */
+class Shard {
+    public:
+        enum class Mode {Rows, Tiles};
+        static std::string modeToString(Shard::Mode mode);
+        // Returns false if the name does not match any mode.
+        static bool stringToMode(const std::string &name, Shard::Mode &mode);
+
+        int index, num;
+        Mode mode;
+
+        // The whole image.
+        Shard();
+        Shard(int index, int num, Shard::Mode mode);
+
+        // Parse a specification in the form "index/num"; returns false if invalid.
+        static bool parse(const std::string &spec, Shard::Mode mode, Shard &shard);
+        // In the form "index/num".
+        std::string toString() const;
+
+        // Whether tile (tileX, tileY) of a grid of tilesX x tilesY tiles belongs to this shard.
+        bool ownsTile(int tileX, int tileY, int tilesX, int tilesY) const;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef STEPS_BUFFER
+#define STEPS_BUFFER
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <ostream>
+#include <cstring>
+
+/*
+ * Number of steps to flip of a set of pixels, stored in 16 bits per pixel
+ * when the maximum number of steps allows it (see fitsCompact()), in 32 bits
+ * otherwise.
+ *
+ * In compact storage larger values saturate to the largest one representable.
+ */
+class StepsBuffer {
+    private:
+        bool compact;
+        // Only one of the two is used, depending on compact.
+        std::vector<uint16_t> data16;
+        std::vector<int32_t> data32;
+
+        char *bytes() {
+            return this->compact ? (char *) this->data16.data() : (char *) this->data32.data();
+        }
+        const char *bytes() const {
+            return this->compact ? (const char *) this->data16.data() : (const char *) this->data32.data();
+        }
+
+    public:
+        StepsBuffer() : compact{false} {};
+
+        // Whether all the step counts up to nStepMax fit in the compact storage.
+        static bool fitsCompact(int nStepMax) {
+            return nStepMax <= UINT16_MAX;
+        }
+
+        // Resize to n pixels with the given value, releasing the previous storage.
+        void assign(std::size_t n, bool compact, int steps) {
+            this->compact = compact;
+            if (compact) {
+                std::vector<int32_t>().swap(this->data32);
+                this->data16.assign(n, std::min(steps, (int) UINT16_MAX));
+            } else {
+                std::vector<uint16_t>().swap(this->data16);
+                this->data32.assign(n, steps);
+            }
+        }
+
+        std::size_t size() const {
+            return this->compact ? this->data16.size() : this->data32.size();
+        }
+
+        int bytesPerPixel() const {
+            return this->compact ? sizeof(uint16_t) : sizeof(int32_t);
+        }
+
+        int get(std::size_t i) const {
+            return this->compact ? this->data16[i] : this->data32[i];
+        }
+
+        void set(std::size_t i, int steps) {
+            if (this->compact) {
+                this->data16[i] = std::min(steps, (int) UINT16_MAX);
+            } else {
+                this->data32[i] = steps;
+            }
+        }
+
+        // Set the pixels [first, last) to the same value.
+        void fill(std::size_t first, std::size_t last, int steps) {
+            if (this->compact) {
+                std::fill(this->data16.begin() + first, this->data16.begin() + last, std::min(steps, (int) UINT16_MAX));
+            } else {
+                std::fill(this->data32.begin() + first, this->data32.begin() + last, steps);
+            }
+        }
+
+        /*
+         * Copy the raw values of the pixels [first, last) in host byte order
+         * to/from the same positions of a raw array of pixels.
+         */
+        void copyTo(char *raw, std::size_t first, std::size_t last) const {
+            std::memcpy(raw + first * this->bytesPerPixel(), this->bytes() + first * this->bytesPerPixel(), (last - first) * this->bytesPerPixel());
+        }
+        void copyFrom(const char *raw, std::size_t first, std::size_t last) {
+            std::memcpy(this->bytes() + first * this->bytesPerPixel(), raw + first * this->bytesPerPixel(), (last - first) * this->bytesPerPixel());
+        }
+
+        // Write the raw values of the pixels [first, last) in host byte order.
+        void write(std::ostream &out, std::size_t first, std::size_t last) const {
+            out.write(this->bytes() + first * this->bytesPerPixel(), (last - first) * this->bytesPerPixel());
+        }
+};
+
+#endif
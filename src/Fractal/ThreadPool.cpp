@@ -0,0 +1,56 @@
+#include <algorithm>
+#include "ThreadPool.hpp"
+
+int ThreadPool::sharedSize = 0;
+
+ThreadPool::ThreadPool(int size) : stopping{false} {
+    if (size <= 0) {
+        size = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < size; i++) {
+        this->workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->condition.notify_all();
+    for (auto &worker: this->workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::getSize() const {
+    return this->workers.size();
+}
+
+void ThreadPool::work() {
+    std::function<void()> task;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->condition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+            // Stop only once all the queued tasks are done.
+            if (this->tasks.empty()) {
+                return;
+            }
+            task = std::move(this->tasks.front());
+            this->tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::setSharedSize(int size) {
+    ThreadPool::sharedSize = size;
+}
+
+ThreadPool &ThreadPool::shared() {
+    // Created on first use, destroyed at the exit of the program.
+    static ThreadPool pool(ThreadPool::sharedSize);
+    return pool;
+}
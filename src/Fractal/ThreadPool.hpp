@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/*
+ * A fixed set of worker threads executing the tasks submitted to them in
+ * FIFO order.
+ *
+ * The grids submit their work to the process-wide pool returned by shared(),
+ * so that threads are created once per process instead of once per render
+ * (or per cycle of an AdaptiveGrid), and a UniformGrid and an AdaptiveGrid
+ * used in the same process never run more threads than the pool size.
+ *
+ * A task must not wait for other tasks of the same pool, which could be
+ * queued behind it.
+ */
+class ThreadPool {
+    public:
+        // A size of 0 means std::thread::hardware_concurrency().
+        ThreadPool(int size = 0);
+        // Waits for the queued tasks to be executed.
+        ~ThreadPool();
+
+        int getSize() const;
+
+        // Queue f() for execution: the future gives its result (or rethrows its exception).
+        template<typename F>
+        auto submit(F f) -> std::future<decltype(f())> {
+            typedef decltype(f()) Result;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::move(f));
+            std::future<Result> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->tasks.push([task]() { (*task)(); });
+            }
+            this->condition.notify_one();
+            return result;
+        }
+
+        /*
+         * Size of the shared pool: it only has effect if called before the
+         * first call to shared(), which creates the pool.
+         */
+        static void setSharedSize(int size);
+        // The pool shared by the whole process.
+        static ThreadPool &shared();
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+        static int sharedSize;
+
+        // Main loop of each worker thread.
+        void work();
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include <vector>
+#include <algorithm>
+#include "TileScheduler.hpp"
+
+std::string TileScheduler::orderToString(TileScheduler::Order order) {
+    switch (order) {
+        case TileScheduler::Order::RowMajor:
+            return "row-major";
+        case TileScheduler::Order::Morton:
+            return "morton";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool TileScheduler::stringToOrder(const std::string &name, TileScheduler::Order &order) {
+    for (auto candidate: {TileScheduler::Order::RowMajor, TileScheduler::Order::Morton}) {
+        if (name == TileScheduler::orderToString(candidate)) {
+            order = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Interleave the bits of x and y: y3 x3 y2 x2 y1 x1 y0 x0.
+static unsigned long mortonCode(unsigned int x, unsigned int y) {
+    unsigned long code = 0;
+    for (int bit = 0; bit < 32; bit++) {
+        code |= (unsigned long) ((x >> bit) & 1) << (2 * bit);
+        code |= (unsigned long) ((y >> bit) & 1) << (2 * bit + 1);
+    }
+    return code;
+}
+
+TileScheduler::TileScheduler(int imgSizeX, int imgSizeY, int tileSize, TileScheduler::Order order, int threadsNum) :
+    threadsNum{threadsNum}, queues{new Queue[threadsNum]} {
+    std::vector<Tile> tiles;
+    std::vector<unsigned long> codes;
+    std::vector<int> indices;
+    int tilesX, tilesY, first, last;
+
+    tilesX = (imgSizeX + tileSize - 1) / tileSize;
+    tilesY = (imgSizeY + tileSize - 1) / tileSize;
+
+    // List the tiles in row-major order...
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            tiles.push_back({tx * tileSize, ty * tileSize,
+                             std::min((tx + 1) * tileSize, imgSizeX), std::min((ty + 1) * tileSize, imgSizeY)});
+            codes.push_back(mortonCode(tx, ty));
+            indices.push_back(indices.size());
+        }
+    }
+    // ... then reorder them if needed.
+    if (order == TileScheduler::Order::Morton) {
+        std::sort(indices.begin(), indices.end(), [&codes](int a, int b) { return codes[a] < codes[b]; });
+    }
+
+    // Each thread starts from a contiguous share of the list.
+    for (int t = 0; t < threadsNum; t++) {
+        first = (long) tiles.size() * t / threadsNum;
+        last = (long) tiles.size() * (t + 1) / threadsNum;
+        for (int i = first; i < last; i++) {
+            this->queues[t].tiles.push_back(tiles[indices[i]]);
+        }
+    }
+}
+
+bool TileScheduler::next(int threadIndex, TileScheduler::Tile &tile) {
+    {
+        std::lock_guard<std::mutex> lock(this->queues[threadIndex].mutex);
+        if (!this->queues[threadIndex].tiles.empty()) {
+            tile = this->queues[threadIndex].tiles.front();
+            this->queues[threadIndex].tiles.pop_front();
+            return true;
+        }
+    }
+
+    // Own queue is empty: look for a victim, starting from the next thread.
+    // The tiles are never added back, so once all the queues are found empty
+    // the work is over.
+    for (int i = 1; i < this->threadsNum; i++) {
+        if (this->steal((threadIndex + i) % this->threadsNum, tile)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TileScheduler::steal(int victimIndex, TileScheduler::Tile &tile) {
+    std::lock_guard<std::mutex> lock(this->queues[victimIndex].mutex);
+    if (this->queues[victimIndex].tiles.empty()) {
+        return false;
+    }
+    tile = this->queues[victimIndex].tiles.back();
+    this->queues[victimIndex].tiles.pop_back();
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef TILE_SCHEDULER
+#define TILE_SCHEDULER
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*
+ * Dynamic distribution of the pixels of an image among multiple threads.
+ *
+ * The image is divided in square tiles of tileSize pixels, listed in the
+ * given traversal order: row-major, or Morton (Z-order) which keeps nearby
+ * tiles close in the list also across rows.
+ * Each thread receives its own contiguous share of the list in a deque and
+ * takes the tiles from its front. A thread which runs out of tiles steals
+ * them from the back of the deque of another thread, so that a thread which
+ * drew cheap tiles (e.g. pixels which cannot flip) helps the ones stuck in
+ * the chaotic areas instead of sitting idle at the end of the render.
+ *
+ * Each thread writes whole tiles, so different threads only share the cache
+ * lines at the borders of the tiles.
+ */
+class TileScheduler {
+    public:
+        enum class Order {RowMajor, Morton};
+        static std::string orderToString(TileScheduler::Order order);
+        // Returns false if the name does not match any order.
+        static bool stringToOrder(const std::string &name, TileScheduler::Order &order);
+
+        // Pixels [x0, x1) x [y0, y1) of the image.
+        struct Tile {
+            int x0, y0, x1, y1;
+        };
+
+        TileScheduler(int imgSizeX, int imgSizeY, int tileSize, TileScheduler::Order order, int threadsNum);
+
+        /*
+         * Get the next tile for the given thread, stealing it from another
+         * thread if needed. Returns false when all the tiles are taken.
+         */
+        bool next(int threadIndex, TileScheduler::Tile &tile);
+
+    private:
+        // Aligned to keep the queues of different threads in different cache lines.
+        struct alignas(64) Queue {
+            std::mutex mutex;
+            std::deque<Tile> tiles;
+        };
+
+        int threadsNum;
+        std::unique_ptr<Queue[]> queues;
+
+        // Take a tile from the back of the queue of the victim thread.
+        bool steal(int victimIndex, TileScheduler::Tile &tile);
+};
+
+#endif
@@ -1,91 +1,909 @@
 #include <memory>
 #include <cmath>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
-#include <thread>
-#include <png++/image.hpp>
+#include <future>
+#include <algorithm>
+#include <limits>
 #include <png++/rgb_pixel.hpp>
 #include "UniformGrid.hpp"
 #include "ColorScale.hpp"
+#include "ThreadPool.hpp"
+#include "PngWriter.hpp"
+#include "ColorTable.hpp"
+#include "Instrumentation.hpp"
 
 const char UniformGrid::textComment = '#';
+const int UniformGrid::MAX_TILE_SIZE = 4096;
+
+/*
+ * Wether the position (in pixels) falls on a pixel center, index, within
+ * 1e-9 pixels whatever its magnitude: the bounds of the domain must be given
+ * in double precision, those rounded to single precision are off by up to
+ * 1e-7 times the index.
+ */
+static bool isPixelIndex(double position, long &index) {
+    if (!(std::abs(position) < std::numeric_limits<int>::max())) {
+        index = 0;
+        return false;
+    }
+    index = std::lround(position);
+    return std::abs(position - index) < 1e-9;
+}
 
 UniformGrid::UniformGrid(std::shared_ptr<Fractal> fractal, int nStepMax, double ai1Min, double ai1Max, double ai2Min, double ai2Max, double gridSize) :
-    fractal{fractal}, ai1Min{ai1Min}, ai1Max{ai1Max}, ai2Min{ai2Min}, ai2Max{ai2Max}, gridSize{gridSize}, nStepMax{nStepMax}
+    fractal{fractal}, ai1Min{ai1Min}, ai1Max{ai1Max}, ai2Min{ai2Min}, ai2Max{ai2Max}, gridSize{gridSize}, nStepMax{nStepMax},
+    bandY0{0}, bandRows{0}, useMirror{false}, shard{nullptr}, renderMode{RenderMode::Full}, boundaryTolerance{0},
+    tileSize{32}, tileOrder{TileScheduler::Order::Morton}, memoryBudget{0}, compressionLevel{PngWriter::DEFAULT_LEVEL}, dataEncoding{DataFile::Encoding::Dense}, resume{false}, checkpointInterval{60}
 {
+    long mirrorX = 0, mirrorY = 0, latticeX = 0, latticeY = 0;
+
     this->imgSize.x = (int) ceil((this->ai1Max - this->ai1Min) / this->gridSize);
     this->imgSize.y = (int) ceil((this->ai2Max - this->ai2Min) / this->gridSize);
 
-    data.resize(this->imgSize.x * this->imgSize.y, Fractal::STEPS_OUT_OF_SCALE);
+    // The mirror of the pixel centers must fall on pixel centers as well.
+    this->symmetric = isPixelIndex(-2 * this->ai1Min / this->gridSize, mirrorX)
+                      && isPixelIndex(2 * this->ai2Max / this->gridSize, mirrorY);
+    this->mirror.x = (int) mirrorX;
+    this->mirror.y = (int) mirrorY;
+
+    // Same for the pixel centers on the lattice of the cache.
+    this->aligned = isPixelIndex(this->ai1Min / this->gridSize, latticeX)
+                    && isPixelIndex(this->ai2Max / this->gridSize, latticeY);
+    this->lattice.x = latticeX;
+    this->lattice.y = latticeY;
+    this->cacheHits = 0;
+    this->cacheMisses = 0;
 };
 
-void UniformGrid::calcThreaded(int threadsNum, int threadIndex) {
+bool UniformGrid::isMirrored(int img_x, int img_y) {
+    int mirror_x, mirror_y;
+
+    if (!this->useMirror) {
+        return false;
+    }
+    mirror_x = this->mirror.x - img_x;
+    mirror_y = this->mirror.y - img_y;
+    if (mirror_x < 0 || mirror_x >= this->imgSize.x || mirror_y < 0 || mirror_y >= this->imgSize.y) {
+        return false;
+    }
+    // Of each pair the pixel which comes first in the image is evaluated.
+    return mirror_y < img_y || (mirror_y == img_y && mirror_x < img_x);
+}
+
+void UniformGrid::fillMirrored() {
+    int mirrorIndex;
+
+    for (int img_y = 0; img_y < this->imgSize.y; img_y++) {
+        for (int img_x = 0; img_x < this->imgSize.x; img_x++) {
+            if (this->isMirrored(img_x, img_y)) {
+                mirrorIndex = (this->mirror.y - img_y) * this->imgSize.x + this->mirror.x - img_x;
+                this->data.set(img_y * this->imgSize.x + img_x, this->data.get(mirrorIndex));
+                this->fallback[img_y * this->imgSize.x + img_x] = this->fallback[mirrorIndex];
+            }
+        }
+    }
+}
+
+std::string UniformGrid::renderModeToString(UniformGrid::RenderMode renderMode) {
+    switch (renderMode) {
+        case UniformGrid::RenderMode::Full:
+            return "full";
+        case UniformGrid::RenderMode::Boundary:
+            return "boundary";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool UniformGrid::stringToRenderMode(const std::string &name, UniformGrid::RenderMode &renderMode) {
+    for (auto candidate: {UniformGrid::RenderMode::Full, UniformGrid::RenderMode::Boundary}) {
+        if (name == UniformGrid::renderModeToString(candidate)) {
+            renderMode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool UniformGrid::isTileSkipped(const TileScheduler::Tile &tile) {
+    if (this->checkpoint && this->checkpoint->isDone(tile)) {
+        return true;
+    }
+    // The bands of a shard start at a tile row.
+    return this->shard && !this->shard->ownsTile(tile.x0 / this->tileSize, (this->bandY0 + tile.y0) / this->tileSize,
+                                                 (this->imgSize.x + this->tileSize - 1) / this->tileSize,
+                                                 (this->imgSize.y + this->tileSize - 1) / this->tileSize);
+}
+
+void UniformGrid::markCannotFlip(double ai2, int x0, int x1, const std::vector<double> &ai1, std::vector<char> &cannotFlip) {
+    double halfWidth;
+    int xFirst, xLast;
+
+    std::fill(cannotFlip.begin() + x0, cannotFlip.begin() + x1, false);
+    halfWidth = this->fractal->cannotFlipHalfWidth(ai2);
+    if (std::isinf(halfWidth)) {
+        std::fill(cannotFlip.begin() + x0, cannotFlip.begin() + x1, true);
+        return;
+    }
+    if (halfWidth <= 0) {
+        return;
+    }
+    for (int k = (int) ceil((ai1[x0] - halfWidth) / (2 * M_PI)); 2 * M_PI * k - halfWidth <= ai1[x1 - 1]; k++) {
+        xFirst = std::max(x0, (int) ceil((2 * M_PI * k - halfWidth - this->ai1Min) / this->gridSize));
+        xLast = std::min(x1 - 1, (int) floor((2 * M_PI * k + halfWidth - this->ai1Min) / this->gridSize));
+        // The ends of each interval are checked with Fractal::canFlip()
+        // itself, so that rounding never makes the two disagree.
+        while (xFirst <= xLast && this->fractal->canFlip(ai1[xFirst], ai2)) {
+            xFirst++;
+        }
+        while (xLast >= xFirst && this->fractal->canFlip(ai1[xLast], ai2)) {
+            xLast--;
+        }
+        if (xFirst <= xLast) {
+            std::fill(cannotFlip.begin() + xFirst, cannotFlip.begin() + xLast + 1, true);
+        }
+    }
+}
+
+double UniformGrid::getAi1(int img_x) {
+    if (this->cache) {
+        return (this->lattice.x + img_x) * this->gridSize;
+    }
+    return this->ai1Min + img_x * this->gridSize;
+}
+
+double UniformGrid::getAi2(int img_y) {
+    // NOTE: Image and user coordinate systems have inverted y axis.
+    if (this->cache) {
+        return (this->lattice.y - img_y) * this->gridSize;
+    }
+    return this->ai2Max - img_y * this->gridSize;
+}
+
+void UniformGrid::stepsToFlip(const std::vector<int> &pixels, const std::vector<double> &ai1, const std::vector<double> &ai2,
+                              int *steps, bool *fallback) {
+    std::vector<ResultCache::Point> points, missedPoints;
+    std::vector<double> missedAi1, missedAi2;
+    std::vector<int> missed, missedSteps, cost;
+    std::unique_ptr<bool[]> hit(new bool[pixels.size()]);
+    bool costMap = this->cost.size() > 0;
+
+    if (!this->cache) {
+        cost.resize(costMap ? pixels.size() : 0);
+        this->fractal->stepsToFlip(ai1.data(), ai2.data(), steps, pixels.size(), this->nStepMax, fallback,
+                                   costMap ? cost.data() : nullptr);
+        for (std::size_t i = 0; i < cost.size(); i++) {
+            this->cost.set(pixels[i], cost[i]);
+        }
+        return;
+    }
+
+    for (int pixel: pixels) {
+        points.push_back({this->lattice.x + pixel % this->imgSize.x, this->lattice.y - (this->bandY0 + pixel / this->imgSize.x)});
+    }
+    this->cache->lookup(points.data(), points.size(), this->nStepMax, steps, fallback, hit.get());
+
+    // Evaluate the rest in a single batch.
+    for (std::size_t i = 0; i < pixels.size(); i++) {
+        if (!hit[i]) {
+            missed.push_back(i);
+            missedPoints.push_back(points[i]);
+            missedAi1.push_back(ai1[i]);
+            missedAi2.push_back(ai2[i]);
+        }
+    }
+    if (missed.empty()) {
+        return;
+    }
+    missedSteps.resize(missed.size());
+    cost.resize(costMap ? missed.size() : 0);
+    std::unique_ptr<bool[]> missedFallback(new bool[missed.size()]);
+    this->fractal->stepsToFlip(missedAi1.data(), missedAi2.data(), missedSteps.data(), missed.size(), this->nStepMax, missedFallback.get(),
+                               costMap ? cost.data() : nullptr);
+    this->cache->store(missedPoints.data(), missedPoints.size(), this->nStepMax, missedSteps.data(), missedFallback.get());
+    for (std::size_t i = 0; i < missed.size(); i++) {
+        steps[missed[i]] = missedSteps[i];
+        fallback[missed[i]] = missedFallback[i];
+    }
+    for (std::size_t i = 0; i < cost.size(); i++) {
+        this->cost.set(pixels[missed[i]], cost[i]);
+    }
+}
+
+void UniformGrid::openCache() {
+    this->cacheHits = 0;
+    this->cacheMisses = 0;
+    if (this->cacheDirectory.empty()) {
+        return;
+    }
+    if (!this->aligned) {
+        throw std::runtime_error("The domain is not aligned with the grid: the results cannot be cached");
+    }
+    this->cache = std::make_unique<ResultCache>(this->cacheDirectory, this->getCacheKey(), this->gridSize);
+}
+
+void UniformGrid::closeCache() {
+    if (this->cache) {
+        this->cacheHits = this->cache->getHits();
+        this->cacheMisses = this->cache->getMisses();
+        // Closing the cache flushes it.
+        this->cache.reset();
+    }
+}
+
+std::string UniformGrid::getCacheKey() {
+    std::ostringstream key;
+
+    // Exact values: any difference gives different results.
+    key << std::hexfloat;
+    key << this->textComment << "type" << "=" << DoublePendulum::variantToString(this->fractal->pendulum->variant) << std::endl;
+    key << this->textComment << "M1" << "=" << this->fractal->pendulum->M1 << std::endl;
+    key << this->textComment << "M2" << "=" << this->fractal->pendulum->M2 << std::endl;
+    key << this->textComment << "L1" << "=" << this->fractal->pendulum->L1 << std::endl;
+    key << this->textComment << "L2" << "=" << this->fractal->pendulum->L2 << std::endl;
+    key << this->textComment << "g" << "=" << this->fractal->pendulum->g << std::endl;
+    key << this->textComment << "dt" << "=" << this->fractal->pendulum->dt << std::endl;
+    key << this->textComment << "integrator" << "=" << DoublePendulum::integratorToString(this->fractal->pendulum->integrator) << std::endl;
+    if (this->fractal->pendulum->isAdaptive()) {
+        key << this->textComment << "rtol" << "=" << this->fractal->pendulum->rtol << std::endl;
+        key << this->textComment << "atol" << "=" << this->fractal->pendulum->atol << std::endl;
+    }
+    key << this->textComment << "math" << "=" << DoublePendulum::mathAccuracyToString(this->fractal->pendulum->mathAccuracy) << std::endl;
+    key << this->textComment << "precision" << "=" << Fractal::precisionToString(this->fractal->precision) << std::endl;
+    if (this->fractal->precision == Fractal::Precision::Mixed) {
+        // The fallback depends on the fraction of nStepMax, and so do the results.
+        key << this->textComment << "fallbackFraction" << "=" << this->fractal->fallbackFraction << std::endl;
+        key << this->textComment << "nStepMax" << "=" << this->nStepMax << std::endl;
+    }
+    key << this->textComment << "earlyExit" << "=" << Fractal::earlyExitToString(this->fractal->earlyExit) << std::endl;
+    if (this->fractal->earlyExit != Fractal::EarlyExit::Off) {
+        key << this->textComment << "recurrenceTolerance" << "=" << this->fractal->recurrenceTolerance << std::endl;
+    }
+    return key.str();
+}
+
+void UniformGrid::calcThreaded(TileScheduler &scheduler, int threadIndex, double &busy) {
     // Pixel coordinates in the image pixel reference system (origin top left,
     // x positive to the right, y positive to the bottom).
-    int img_x, img_y;
-    // Initial conditions in the user reference system (origin in the center, x
-    // positive to the right, y positive to the top)
-    double ai1, ai2;
-
-    // Each thread starts at an offset so as not to overlap with other threads.
-    img_y = 0;
-    img_x = threadIndex;
-
-    // Check that we are still inside the image boundaries.
-    if (img_x >= this->imgSize.x) {
-        img_y += (int) (img_x / this->imgSize.x);
-        img_x = img_x % this->imgSize.x;
-    }
-    // Loop until the (img_x, img_y) coordinates point outside the image.
-    while (img_y < this->imgSize.y) {
-        // Convert (img_x, img_y) pixel position to (ai1, ai2) values.
-        // NOTE: Image and user coordinate systems have inverted y axis.
-        ai1 = this->ai1Min + img_x * this->gridSize;
-        ai2 = this->ai2Max - img_y * this->gridSize;
-
-        // Evaluate.
-        this->data[img_y * this->imgSize.x + img_x] = this->fractal->stepsToFlip(ai1, ai2, this->nStepMax);
-        
-        // Step to the next pixel, skipping all the pixels other threads are working on.
-        img_x += threadsNum;
-        // If the pixel was out of the row switch to the next row.
-        if (img_x >= this->imgSize.x) {
-            img_y += (int) (img_x / this->imgSize.x);
-            img_x = img_x % this->imgSize.x;
+    int img_x, img_y, index;
+    // Initial conditions in the user reference system (origin in the center,
+    // x positive to the right, y positive to the top): ai1 is the same for all rows.
+    std::vector<double> ai1(this->imgSize.x);
+    double ai2;
+    std::vector<char> cannotFlip(this->imgSize.x);
+    // The initial conditions of the tile which can flip, gathered for the batch.
+    std::vector<double> ai1Batch, ai2Batch;
+    std::vector<int> pixelBatch, stepsBatch;
+    std::unique_ptr<bool[]> fallbackBatch(new bool[(std::size_t) this->tileSize * this->tileSize]);
+    TileScheduler::Tile tile;
+    Instrumentation::Clock::time_point tileStart;
+    long evaluated = 0, ruledOut = 0;
+
+    for (img_x = 0; img_x < this->imgSize.x; img_x++) {
+        ai1[img_x] = this->getAi1(img_x);
+    }
+
+    while (scheduler.next(threadIndex, tile)) {
+        if (this->isTileSkipped(tile)) {
+            continue;
+        }
+        if constexpr (Instrumentation::ENABLED) {
+            tileStart = Instrumentation::Clock::now();
+        }
+        ai1Batch.clear();
+        ai2Batch.clear();
+        pixelBatch.clear();
+
+        // The tiles are in the rows of the band.
+        for (img_y = this->bandY0 + tile.y0; img_y < this->bandY0 + tile.y1; img_y++) {
+            // Convert img_y pixel position to ai2 value.
+            // NOTE: Image and user coordinate systems have inverted y axis.
+            ai2 = this->getAi2(img_y);
+            this->markCannotFlip(ai2, tile.x0, tile.x1, ai1, cannotFlip);
+
+            // Gather the rest of the row, leaving out the mirrored pixels.
+            for (img_x = tile.x0; img_x < tile.x1; img_x++) {
+                index = (img_y - this->bandY0) * this->imgSize.x + img_x;
+                this->data.set(index, Fractal::STEPS_OUT_OF_SCALE);
+                this->fallback[index] = false;
+                if (this->isMirrored(img_x, img_y)) {
+                    continue;
+                }
+                if (cannotFlip[img_x]) {
+                    ruledOut++;
+                    continue;
+                }
+                pixelBatch.push_back(index);
+                ai1Batch.push_back(ai1[img_x]);
+                ai2Batch.push_back(ai2);
+            }
+        }
+
+        stepsBatch.resize(pixelBatch.size());
+        this->stepsToFlip(pixelBatch, ai1Batch, ai2Batch, stepsBatch.data(), fallbackBatch.get());
+        for (std::size_t i = 0; i < pixelBatch.size(); i++) {
+            this->data.set(pixelBatch[i], stepsBatch[i]);
+            this->fallback[pixelBatch[i]] = fallbackBatch[i];
+        }
+        evaluated += pixelBatch.size();
+        if (this->checkpoint) {
+            this->checkpoint->save(tile, this->data, this->fallback);
+        }
+        if constexpr (Instrumentation::ENABLED) {
+            busy += Instrumentation::secondsSince(tileStart);
         }
     }
+
+    std::lock_guard<std::mutex> lock(this->pixelCountsMutex);
+    this->evaluatedPixels += evaluated;
+    this->ruledOutPixels += ruledOut;
 };
 
-void UniformGrid::calcData(int forceThreadNum) {
-    // Multiple threads can be used to calculate the pixel data in parallel.
-    int nThreads;
-    if (forceThreadNum == 0) {
-        nThreads = std::thread::hardware_concurrency();
+void UniformGrid::evaluatePixels(const std::vector<int> &pixels, long &evaluated, long &ruledOut) {
+    std::vector<double> ai1, ai2;
+    std::vector<int> batch, steps;
+    std::unique_ptr<bool[]> fallback(new bool[pixels.size()]);
+    double a1, a2;
+
+    for (int pixel: pixels) {
+        a1 = this->getAi1(pixel % this->imgSize.x);
+        a2 = this->getAi2(this->bandY0 + pixel / this->imgSize.x);
+        this->data.set(pixel, Fractal::STEPS_OUT_OF_SCALE);
+        this->fallback[pixel] = false;
+        if (this->fractal->canFlip(a1, a2)) {
+            batch.push_back(pixel);
+            ai1.push_back(a1);
+            ai2.push_back(a2);
+        }
+    }
+    steps.resize(batch.size());
+    this->stepsToFlip(batch, ai1, ai2, steps.data(), fallback.get());
+    for (std::size_t i = 0; i < batch.size(); i++) {
+        this->data.set(batch[i], steps[i]);
+        this->fallback[batch[i]] = fallback[i];
+    }
+    evaluated += batch.size();
+    ruledOut += pixels.size() - batch.size();
+}
+
+bool UniformGrid::isBorderUniform(int x0, int y0, int x1, int y1, int &value) {
+    int steps, minSteps, maxSteps, count;
+    long sum;
+    bool anyOut;
+
+    minSteps = std::numeric_limits<int>::max();
+    maxSteps = 0;
+    sum = 0;
+    count = 0;
+    anyOut = false;
+    auto visit = [&](int x, int y) {
+        steps = this->data.get(y * this->imgSize.x + x);
+        if (steps == Fractal::STEPS_OUT_OF_SCALE) {
+            anyOut = true;
+        } else {
+            minSteps = std::min(minSteps, steps);
+            maxSteps = std::max(maxSteps, steps);
+            sum += steps;
+        }
+        count++;
+    };
+    for (int x = x0; x <= x1; x++) {
+        visit(x, y0);
+        visit(x, y1);
+    }
+    for (int y = y0 + 1; y < y1; y++) {
+        visit(x0, y);
+        visit(x1, y);
+    }
+
+    // Either all out of scale...
+    if (anyOut) {
+        value = Fractal::STEPS_OUT_OF_SCALE;
+        return sum == 0;
+    }
+    // ... or all flipping after about the same number of steps.
+    value = (int) round((double) sum / count);
+    return maxSteps - minSteps <= this->boundaryTolerance * minSteps;
+}
+
+void UniformGrid::traceRectangle(int x0, int y0, int x1, int y1, long &evaluated, long &ruledOut, long &filled) {
+    std::vector<int> pixels;
+    int value, middle;
+
+    // Nothing inside the border.
+    if (x1 - x0 < 2 || y1 - y0 < 2) {
+        return;
+    }
+
+    if (this->isBorderUniform(x0, y0, x1, y1, value)) {
+        for (int y = y0 + 1; y < y1; y++) {
+            this->data.fill(y * this->imgSize.x + x0 + 1, y * this->imgSize.x + x1, value);
+            std::fill(this->fallback.begin() + y * this->imgSize.x + x0 + 1, this->fallback.begin() + y * this->imgSize.x + x1, false);
+        }
+        filled += (x1 - x0 - 1) * (y1 - y0 - 1);
+        return;
+    }
+
+    // Evaluate the line splitting the longer side, which completes the borders of the two halves.
+    if (x1 - x0 >= y1 - y0) {
+        middle = (x0 + x1) / 2;
+        for (int y = y0 + 1; y < y1; y++) {
+            pixels.push_back(y * this->imgSize.x + middle);
+        }
+        this->evaluatePixels(pixels, evaluated, ruledOut);
+        this->traceRectangle(x0, y0, middle, y1, evaluated, ruledOut, filled);
+        this->traceRectangle(middle, y0, x1, y1, evaluated, ruledOut, filled);
     } else {
-        nThreads = forceThreadNum;
+        middle = (y0 + y1) / 2;
+        for (int x = x0 + 1; x < x1; x++) {
+            pixels.push_back(middle * this->imgSize.x + x);
+        }
+        this->evaluatePixels(pixels, evaluated, ruledOut);
+        this->traceRectangle(x0, y0, x1, middle, evaluated, ruledOut, filled);
+        this->traceRectangle(x0, middle, x1, y1, evaluated, ruledOut, filled);
     }
-    std::vector<std::thread> threads;
+}
 
-    // Create N-1 new threds since the main which is already in execution
-    // is one of the N threads.
-    for (int i = 0; i < nThreads - 1; i++) {
-        threads.push_back(std::thread(&UniformGrid::calcThreaded, this, nThreads, i));
+void UniformGrid::calcTraced(TileScheduler &scheduler, int threadIndex, double &busy) {
+    std::vector<int> pixels;
+    TileScheduler::Tile tile;
+    Instrumentation::Clock::time_point tileStart;
+    long evaluated, ruledOut, filled;
+
+    evaluated = 0;
+    ruledOut = 0;
+    filled = 0;
+    while (scheduler.next(threadIndex, tile)) {
+        if (this->isTileSkipped(tile)) {
+            continue;
+        }
+        if constexpr (Instrumentation::ENABLED) {
+            tileStart = Instrumentation::Clock::now();
+        }
+        for (auto &part: this->tracedParts(tile)) {
+            // Evaluate the border of the part...
+            pixels.clear();
+            for (int y = part.y0; y < part.y1; y++) {
+                for (int x = part.x0; x < part.x1; x++) {
+                    if (y == part.y0 || y == part.y1 - 1 || x == part.x0 || x == part.x1 - 1) {
+                        pixels.push_back(y * this->imgSize.x + x);
+                    }
+                }
+            }
+            this->evaluatePixels(pixels, evaluated, ruledOut);
+            // ... then trace its interior.
+            this->traceRectangle(part.x0, part.y0, part.x1 - 1, part.y1 - 1, evaluated, ruledOut, filled);
+        }
+        if (this->checkpoint) {
+            this->checkpoint->save(tile, this->data, this->fallback);
+        }
+        if constexpr (Instrumentation::ENABLED) {
+            busy += Instrumentation::secondsSince(tileStart);
+        }
     }
-    // No need for std::thread() to execute code on the main thread.
-    this->calcThreaded(nThreads, nThreads - 1);
 
-    // Wait for all the threads to finish.
-    for (auto &t: threads) {
-        t.join();
+    std::lock_guard<std::mutex> lock(this->pixelCountsMutex);
+    this->evaluatedPixels += evaluated;
+    this->ruledOutPixels += ruledOut;
+    this->filledPixels += filled;
+}
+
+std::vector<TileScheduler::Tile> UniformGrid::tracedParts(const TileScheduler::Tile &tile) {
+    std::vector<TileScheduler::Tile> parts;
+    int x0, y0, x1, y1, partsBorder;
+
+    if (!this->useMirror) {
+        return {tile};
+    }
+    /*
+     * The mirrored pixels are those past the middle row of the mirror whose
+     * mirror is in the image (the second half of the middle row is also
+     * mirrored, but it is traced with the rows above).
+     */
+    y0 = std::max(tile.y0, this->mirror.y / 2 + 1);
+    y1 = std::min(tile.y1, std::min(this->mirror.y, this->imgSize.y - 1) + 1);
+    x0 = std::max(tile.x0, this->mirror.x - this->imgSize.x + 1);
+    x1 = std::min(tile.x1, this->mirror.x + 1);
+    if (y0 >= y1 || x0 >= x1) {
+        return {tile};
+    }
+    if (tile.y0 < y0) {
+        parts.push_back({tile.x0, tile.y0, tile.x1, y0});
     }
+    if (y1 < tile.y1) {
+        parts.push_back({tile.x0, y1, tile.x1, tile.y1});
+    }
+    if (tile.x0 < x0) {
+        parts.push_back({tile.x0, y0, x0, y1});
+    }
+    if (x1 < tile.x1) {
+        parts.push_back({x1, y0, tile.x1, y1});
+    }
+    /*
+     * Each part adds its own border to evaluate: when the parts have more
+     * border than the tile, as for a thin strip of mirrored pixels, the
+     * strip is traced with the rest of the tile instead (its pixels are
+     * then overwritten by their mirrors, see fillMirrored()).
+     */
+    auto borderPixels = [](const TileScheduler::Tile &part) {
+        int width = part.x1 - part.x0, height = part.y1 - part.y0;
+        return width < 3 || height < 3 ? width * height : 2 * (width + height) - 4;
+    };
+    partsBorder = 0;
+    for (auto &part: parts) {
+        partsBorder += borderPixels(part);
+    }
+    if (partsBorder > borderPixels(tile)) {
+        return {tile};
+    }
+    return parts;
 }
 
-void UniformGrid::saveData(const std::string fileName, const std::string separator) {
-    std::ofstream outFile(fileName);
+void UniformGrid::calcBand(int nTasks) {
+    // The pixel data are calculated in parallel by the threads of the pool.
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::future<void>> tasks;
+    // Time each task spent on its tiles.
+    std::vector<double> busy(nTasks, 0);
+    Instrumentation::Clock::time_point bandStart = Instrumentation::Clock::now();
+
+    if (this->renderMode == UniformGrid::RenderMode::Full) {
+        TileScheduler scheduler(this->imgSize.x, this->bandRows, this->tileSize, this->tileOrder, nTasks);
+        for (int i = 0; i < nTasks; i++) {
+            tasks.push_back(pool.submit([this, &scheduler, &busy, i]() {
+                this->calcThreaded(scheduler, i, busy[i]);
+            }));
+        }
+        for (auto &task: tasks) {
+            task.get();
+        }
+    } else {
+        // The mirrored pixels are left out of the tiles (see tracedParts()).
+        TileScheduler scheduler(this->imgSize.x, this->bandRows, this->tileSize, this->tileOrder, nTasks);
+        for (int i = 0; i < nTasks; i++) {
+            tasks.push_back(pool.submit([this, &scheduler, &busy, i]() {
+                this->calcTraced(scheduler, i, busy[i]);
+            }));
+        }
+        for (auto &task: tasks) {
+            task.get();
+        }
+    }
+
+    // The tasks which finished earlier, or started later, waited for the others.
+    if constexpr (Instrumentation::ENABLED) {
+        double bandSeconds = Instrumentation::secondsSince(bandStart);
+        for (int i = 0; i < nTasks; i++) {
+            this->threadTimes[i].busy += busy[i];
+            this->threadTimes[i].idle += bandSeconds - busy[i];
+        }
+    }
+}
+
+void UniformGrid::resetCounters(int nTasks) {
+    this->evaluatedPixels = 0;
+    this->ruledOutPixels = 0;
+    this->filledPixels = 0;
+    this->timings = Timings();
+    this->threadTimes.assign(nTasks, ThreadTimes());
+}
+
+void UniformGrid::calcData(int forceThreadNum) {
+    int nTasks = forceThreadNum == 0 ? ThreadPool::shared().getSize() : forceThreadNum;
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+
+    this->resetCounters(nTasks);
+
+    // The whole image is a single band.
+    this->useMirror = this->symmetric;
+    this->bandY0 = 0;
+    this->bandRows = this->imgSize.y;
+    this->data.assign((std::size_t) this->imgSize.x * this->imgSize.y, StepsBuffer::fitsCompact(this->nStepMax), Fractal::STEPS_OUT_OF_SCALE);
+    this->fallback.assign((std::size_t) this->imgSize.x * this->imgSize.y, false);
+    this->cost.assign(this->costMapFileName.empty() ? 0 : (std::size_t) this->imgSize.x * this->imgSize.y,
+                      StepsBuffer::fitsCompact(2 * this->nStepMax), 0);
+
+    this->resumedTiles = 0;
+    if (!this->checkpointFileName.empty()) {
+        std::ostringstream header;
+        this->writeRawHeader(header);
+        header << this->textComment << "tileSize" << "=" << this->tileSize << std::endl;
+        this->checkpoint = std::make_unique<Checkpoint>(this->checkpointFileName, header.str(), this->imgSize.x, this->imgSize.y,
+                                                        this->tileSize, this->data.bytesPerPixel(), this->resume);
+        this->checkpoint->flushInterval = this->checkpointInterval;
+        this->resumedTiles = this->checkpoint->loadDone(this->data, this->fallback);
+    }
+
+    this->openCache();
+    this->calcBand(nTasks);
+    this->closeCache();
+    // Closing the checkpoint flushes it.
+    this->checkpoint.reset();
+    this->fillMirrored();
+    this->timings.compute = Instrumentation::secondsSince(start);
+
+    if (!this->costMapFileName.empty()) {
+        start = Instrumentation::Clock::now();
+        auto costMap = this->openCostMap();
+        costMap->write(this->cost, 0, this->cost.size());
+        costMap->close();
+        this->cost.assign(0, false, 0);
+        this->timings.save += Instrumentation::secondsSince(start);
+    }
+}
+
+std::unique_ptr<DataFileWriter> UniformGrid::openCostMap() {
+    std::ostringstream parameters;
+
+    this->writeHeader(parameters);
+    parameters << this->textComment << "contents" << "=" << "cost" << std::endl;
+    // With Mixed precision the cost is up to twice nStepMax.
+    return std::make_unique<DataFileWriter>(this->costMapFileName, parameters.str(), this->imgSize.x, this->imgSize.y,
+                                            StepsBuffer::fitsCompact(2 * this->nStepMax), this->dataEncoding);
+}
+
+int UniformGrid::getSteps(int img_x, int img_y) {
+    return this->data.get((std::size_t) img_y * this->imgSize.x + img_x);
+}
+
+int UniformGrid::getResumedTiles() {
+    return this->resumedTiles;
+}
+
+void UniformGrid::streamImage(const std::string imageFileName, const std::string dataFileName, int forceThreadNum) {
+    int nTasks = forceThreadNum == 0 ? ThreadPool::shared().getSize() : forceThreadNum;
+    bool compact;
+    long rowBytes;
+    int maxBandRows;
+    ColorTable colorTable = this->getColorTable();
+    std::vector<png::rgb_pixel> pixels;
+    std::unique_ptr<DataFileWriter> dataFile, costMap;
+    bool mixed = this->fractal->precision == Fractal::Precision::Mixed;
+    Instrumentation::Clock::time_point start;
+
+    this->resetCounters(nTasks);
+
+    // Steps, fallback flag, color and cost of each pixel.
+    compact = StepsBuffer::fitsCompact(this->nStepMax);
+    rowBytes = (long) this->imgSize.x * ((compact ? sizeof(uint16_t) : sizeof(int32_t)) + sizeof(char) + sizeof(png::rgb_pixel));
+    if (!this->costMapFileName.empty()) {
+        rowBytes += (long) this->imgSize.x * (StepsBuffer::fitsCompact(2 * this->nStepMax) ? sizeof(uint16_t) : sizeof(int32_t));
+    }
+    // The bytes of the fallback plane of the data file completed by the band (see DataFileWriter).
+    if (!dataFileName.empty() && mixed) {
+        rowBytes += (this->imgSize.x + 7) / 8;
+    }
+    maxBandRows = (int) std::max(1L, std::min((long) this->imgSize.y, this->memoryBudget / rowBytes));
+
+    // No band yet: the header describes the storage, but no data.
+    this->useMirror = false;
+    this->bandRows = 0;
+    this->data.assign(0, compact, Fractal::STEPS_OUT_OF_SCALE);
+
+    PngWriter image(imageFileName, this->imgSize.x, this->imgSize.y, this->compressionLevel);
+    if (!dataFileName.empty()) {
+        dataFile = std::make_unique<DataFileWriter>(dataFileName, this->getParameters(), this->imgSize.x, this->imgSize.y,
+                                                    compact, this->dataEncoding, mixed);
+    }
+    if (!this->costMapFileName.empty()) {
+        costMap = this->openCostMap();
+    }
+
+    this->openCache();
+    for (this->bandY0 = 0; this->bandY0 < this->imgSize.y; this->bandY0 += this->bandRows) {
+        start = Instrumentation::Clock::now();
+        this->bandRows = std::min(maxBandRows, this->imgSize.y - this->bandY0);
+        this->data.assign((std::size_t) this->imgSize.x * this->bandRows, compact, Fractal::STEPS_OUT_OF_SCALE);
+        this->fallback.assign((std::size_t) this->imgSize.x * this->bandRows, false);
+        this->cost.assign(costMap ? (std::size_t) this->imgSize.x * this->bandRows : 0, StepsBuffer::fitsCompact(2 * this->nStepMax), 0);
+        this->calcBand(nTasks);
+        this->timings.compute += Instrumentation::secondsSince(start);
+
+        // Write the band before moving on to the next one.
+        start = Instrumentation::Clock::now();
+        pixels.resize(this->data.size());
+        colorTable.colorPixels(this->data.size(), [this](std::size_t i) { return this->data.get(i); }, pixels.data());
+        this->timings.render += Instrumentation::secondsSince(start);
+        start = Instrumentation::Clock::now();
+        image.writeRows(pixels.data(), this->bandRows);
+        this->timings.encode += Instrumentation::secondsSince(start);
+        start = Instrumentation::Clock::now();
+        if (dataFile) {
+            dataFile->write(this->data, 0, this->data.size(), this->fallback.data());
+        }
+        if (costMap) {
+            costMap->write(this->cost, 0, this->cost.size());
+        }
+        this->timings.save += Instrumentation::secondsSince(start);
+    }
+    if (dataFile) {
+        dataFile->close();
+    }
+    if (costMap) {
+        costMap->close();
+    }
+    this->closeCache();
+
+    // Release the last band.
+    this->data.assign(0, compact, Fractal::STEPS_OUT_OF_SCALE);
+    this->cost.assign(0, false, 0);
+    std::vector<char>().swap(this->fallback);
+    this->bandY0 = 0;
+    this->bandRows = 0;
+}
+
+void UniformGrid::saveShard(const std::string fileName, const Shard &shard, int forceThreadNum) {
+    int nTasks = forceThreadNum == 0 ? ThreadPool::shared().getSize() : forceThreadNum;
+    bool compact;
+    long tileRowBytes;
+    int tilesX, tilesY, bandTileRows;
+    std::ofstream outFile;
+    std::ostringstream shardLines;
+    bool mixed = this->fractal->precision == Fractal::Precision::Mixed;
+    std::size_t first, last;
+    Instrumentation::Clock::time_point start;
+
+    this->resetCounters(nTasks);
+
+    compact = StepsBuffer::fitsCompact(this->nStepMax);
+    tilesX = (this->imgSize.x + this->tileSize - 1) / this->tileSize;
+    tilesY = (this->imgSize.y + this->tileSize - 1) / this->tileSize;
+    // Steps and fallback flag of each pixel of a row of tiles.
+    tileRowBytes = (long) this->imgSize.x * this->tileSize * ((compact ? sizeof(uint16_t) : sizeof(int32_t)) + sizeof(char));
+    bandTileRows = tilesY;
+    if (this->memoryBudget > 0) {
+        bandTileRows = (int) std::max(1L, std::min((long) tilesY, this->memoryBudget / tileRowBytes));
+    }
+
+    this->useMirror = false;
+    this->bandRows = 0;
+    this->data.assign(0, compact, Fractal::STEPS_OUT_OF_SCALE);
+    outFile.open(fileName, std::ios::binary);
+    if (!outFile) {
+        throw std::runtime_error("Cannot open " + fileName + " for writing");
+    }
+    shardLines << this->textComment << "tileSize" << "=" << this->tileSize << std::endl;
+    shardLines << this->textComment << "shard" << "=" << shard.toString() << std::endl;
+    shardLines << this->textComment << "shardBy" << "=" << Shard::modeToString(shard.mode) << std::endl;
+    this->writeRawHeader(outFile, shardLines.str());
+
+    this->shard = &shard;
+    this->openCache();
+    for (int bandTileY = 0; bandTileY < tilesY; bandTileY += bandTileRows) {
+        // Skip the bands without tiles of the shard.
+        bool owned = false;
+        for (int ty = bandTileY; ty < std::min(bandTileY + bandTileRows, tilesY) && !owned; ty++) {
+            for (int tx = 0; tx < tilesX && !owned; tx++) {
+                owned = shard.ownsTile(tx, ty, tilesX, tilesY);
+            }
+        }
+        if (!owned) {
+            continue;
+        }
+
+        this->bandY0 = bandTileY * this->tileSize;
+        this->bandRows = std::min(bandTileRows * this->tileSize, this->imgSize.y - this->bandY0);
+        this->data.assign((std::size_t) this->imgSize.x * this->bandRows, compact, Fractal::STEPS_OUT_OF_SCALE);
+        this->fallback.assign((std::size_t) this->imgSize.x * this->bandRows, false);
+        start = Instrumentation::Clock::now();
+        this->calcBand(nTasks);
+        this->timings.compute += Instrumentation::secondsSince(start);
+
+        // Write the tiles of the shard in row-major order.
+        start = Instrumentation::Clock::now();
+        for (int ty = bandTileY; ty < std::min(bandTileY + bandTileRows, tilesY); ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                if (!shard.ownsTile(tx, ty, tilesX, tilesY)) {
+                    continue;
+                }
+                for (int y = ty * this->tileSize - this->bandY0; y < std::min((ty + 1) * this->tileSize, this->imgSize.y) - this->bandY0; y++) {
+                    first = (std::size_t) y * this->imgSize.x + tx * this->tileSize;
+                    last = (std::size_t) y * this->imgSize.x + std::min((tx + 1) * this->tileSize, this->imgSize.x);
+                    this->data.write(outFile, first, last);
+                }
+                // Then the fallback flags of the tile, in the same order.
+                if (mixed) {
+                    for (int y = ty * this->tileSize - this->bandY0; y < std::min((ty + 1) * this->tileSize, this->imgSize.y) - this->bandY0; y++) {
+                        first = (std::size_t) y * this->imgSize.x + tx * this->tileSize;
+                        last = (std::size_t) y * this->imgSize.x + std::min((tx + 1) * this->tileSize, this->imgSize.x);
+                        outFile.write(this->fallback.data() + first, last - first);
+                    }
+                }
+            }
+        }
+        this->timings.save += Instrumentation::secondsSince(start);
+    }
+    this->closeCache();
+    this->shard = nullptr;
+
+    // Release the last band.
+    this->data.assign(0, compact, Fractal::STEPS_OUT_OF_SCALE);
+    std::vector<char>().swap(this->fallback);
+    this->bandY0 = 0;
+    this->bandRows = 0;
+}
+
+long UniformGrid::getEvaluatedPixels() {
+    std::lock_guard<std::mutex> lock(this->pixelCountsMutex);
+    return this->evaluatedPixels;
+}
+
+long UniformGrid::getRuledOutPixels() {
+    std::lock_guard<std::mutex> lock(this->pixelCountsMutex);
+    return this->ruledOutPixels;
+}
+
+long UniformGrid::getFilledPixels() {
+    std::lock_guard<std::mutex> lock(this->pixelCountsMutex);
+    return this->filledPixels;
+}
+
+long UniformGrid::getCacheHits() {
+    return this->cacheHits;
+}
+
+long UniformGrid::getCacheMisses() {
+    return this->cacheMisses;
+}
+
+UniformGrid::Timings UniformGrid::getTimings() {
+    return this->timings;
+}
+
+void UniformGrid::report(RunReport &report) {
+    std::vector<double> busy, idle;
+    double busySum, totalSum;
+    long pixelsNum = (long) this->imgSize.x * this->imgSize.y;
+
+    report.setNumber("image", "sizeX", this->imgSize.x);
+    report.setNumber("image", "sizeY", this->imgSize.y);
+    report.setNumber("image", "nStepMax", this->nStepMax);
+    report.setString("image", "render", UniformGrid::renderModeToString(this->renderMode));
+
+    report.setNumber("pixels", "total", pixelsNum);
+    report.setNumber("pixels", "evaluated", this->getEvaluatedPixels());
+    report.setNumber("pixels", "ruledOut", this->getRuledOutPixels());
+    report.setNumber("pixels", "filled", this->getFilledPixels());
+    if (!this->cacheDirectory.empty()) {
+        report.setNumber("pixels", "cacheHits", this->getCacheHits());
+        report.setNumber("pixels", "cacheMisses", this->getCacheMisses());
+    }
+
+    report.setNumber("phases", "compute", this->timings.compute);
+    report.setNumber("phases", "render", this->timings.render);
+    report.setNumber("phases", "encode", this->timings.encode);
+    report.setNumber("phases", "save", this->timings.save);
+
+    report.setNumber("throughput", "pixelsPerSecond", pixelsNum / this->timings.compute);
+    report.setNumber("throughput", "evaluatedPixelsPerSecond", this->getEvaluatedPixels() / this->timings.compute);
+    if constexpr (Instrumentation::ENABLED) {
+        report.setNumber("throughput", "megaStepsPerSecond", this->fractal->getStatistics().steps / this->timings.compute / 1e6);
+
+        busySum = 0;
+        totalSum = 0;
+        for (auto &times: this->threadTimes) {
+            busy.push_back(times.busy);
+            idle.push_back(times.idle);
+            busySum += times.busy;
+            totalSum += times.busy + times.idle;
+        }
+        report.setNumbers("threads", "busy", busy);
+        report.setNumbers("threads", "idle", idle);
+        report.setNumber("threads", "utilization", busySum / totalSum);
+    }
+
+    this->fractal->report(report);
+}
+
+void UniformGrid::writeHeader(std::ostream &outFile) {
     std::string systemTypeStr;
-    StateVector currState, nextState;
+    bool mixed;
 
     systemTypeStr = DoublePendulum::variantToString(this->fractal->pendulum->variant);
+    mixed = this->fractal->precision == Fractal::Precision::Mixed;
 
     // Write simulation parameters in the header.
     outFile << this->textComment << "M1" << "=" << this->fractal->pendulum->M1 << std::endl;
@@ -102,39 +920,97 @@ void UniformGrid::saveData(const std::string fileName, const std::string separat
     outFile << this->textComment << "gridSize" << "=" << this->gridSize << std::endl;
     outFile << this->textComment << "dt" << "=" << this->fractal->pendulum->dt << std::endl;
     outFile << this->textComment << "g" << "=" << this->fractal->pendulum->g << std::endl;
+    outFile << this->textComment << "integrator" << "=" << DoublePendulum::integratorToString(this->fractal->pendulum->integrator) << std::endl;
+    outFile << this->textComment << "rtol" << "=" << this->fractal->pendulum->rtol << std::endl;
+    outFile << this->textComment << "atol" << "=" << this->fractal->pendulum->atol << std::endl;
+    outFile << this->textComment << "math" << "=" << DoublePendulum::mathAccuracyToString(this->fractal->pendulum->mathAccuracy) << std::endl;
+    outFile << this->textComment << "precision" << "=" << Fractal::precisionToString(this->fractal->precision) << std::endl;
+    if (mixed) {
+        outFile << this->textComment << "fallbackFraction" << "=" << this->fractal->fallbackFraction << std::endl;
+    }
+    outFile << this->textComment << "earlyExit" << "=" << Fractal::earlyExitToString(this->fractal->earlyExit) << std::endl;
+    if (this->fractal->earlyExit != Fractal::EarlyExit::Off) {
+        outFile << this->textComment << "recurrenceTolerance" << "=" << this->fractal->recurrenceTolerance << std::endl;
+    }
+    outFile << this->textComment << "render" << "=" << UniformGrid::renderModeToString(this->renderMode) << std::endl;
+    if (this->renderMode == UniformGrid::RenderMode::Boundary) {
+        outFile << this->textComment << "boundaryTolerance" << "=" << this->boundaryTolerance << std::endl;
+    }
     outFile << this->textComment << "nStepMax" << "=" << this->nStepMax << std::endl;
     
     outFile << this->textComment << "imgSizeX" << "=" << this->imgSize.x << std::endl;
     outFile << this->textComment << "imgSizeY" << "=" << this->imgSize.y << std::endl;
     
     outFile << this->textComment << "renderType" << "=" << "uniform" << std::endl;
+}
 
-    // Output data.
-    int x, y;
-    for (uint i = 0; i < this->data.size(); i++) {
-        x = i % this->imgSize.x;
-        y = i / this->imgSize.x;
-        outFile << x << separator << y << separator << this->data[i] << std::endl;
+std::string UniformGrid::getParameters() {
+    std::ostringstream parameters;
+
+    this->writeHeader(parameters);
+    return parameters.str();
+}
+
+void UniformGrid::writeRawHeader(std::ostream &outFile, const std::string &extraLines) {
+    this->writeHeader(outFile);
+    outFile << extraLines;
+    outFile << this->textComment << "dataType" << "=" << (this->data.bytesPerPixel() == sizeof(uint16_t) ? "uint16" : "int32") << std::endl;
+}
+
+void UniformGrid::saveData(const std::string fileName, const std::string separator) {
+    std::ofstream outFile(fileName);
+    bool mixed;
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+
+    mixed = this->fractal->precision == Fractal::Precision::Mixed;
+    this->writeHeader(outFile);
+    if (mixed) {
+        outFile << this->textComment << "fallbackPixels" << "=" << std::count(this->fallback.begin(), this->fallback.end(), true) << std::endl;
     }
-};
 
-std::unique_ptr<png::image<png::rgb_pixel>> UniformGrid::render() {
-    auto img = std::make_unique<png::image<png::rgb_pixel>>(this->imgSize.x, this->imgSize.y);
-    ColorScale colorScale = ColorScale();
-    float baseSteps = sqrt(this->fractal->pendulum->L1 / this->fractal->pendulum->g) / this->fractal->pendulum->dt;
-    
     // Output data.
     int x, y;
     for (uint i = 0; i < this->data.size(); i++) {
         x = i % this->imgSize.x;
         y = i / this->imgSize.x;
-        img->set_pixel(x, y, colorScale.getColor(data[this->imgSize.x * y + x] / baseSteps, Fractal::STEPS_OUT_OF_SCALE));
+        outFile << x << separator << y << separator << this->data.get(i);
+        if (mixed) {
+            outFile << separator << (int) this->fallback[i];
+        }
+        // Flushed only at the end.
+        outFile << '\n';
     }
-    
-    return img;
+    outFile.flush();
+    this->timings.save += Instrumentation::secondsSince(start);
 };
 
+void UniformGrid::saveBinaryData(const std::string fileName) {
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+    {
+        DataFileWriter dataFile(fileName, this->getParameters(), this->imgSize.x, this->imgSize.y,
+                                this->data.bytesPerPixel() == sizeof(uint16_t), this->dataEncoding,
+                                this->fractal->precision == Fractal::Precision::Mixed);
+
+        dataFile.write(this->data, 0, this->data.size(), this->fallback.data());
+        dataFile.close();
+    }
+    this->timings.save += Instrumentation::secondsSince(start);
+}
+
+ColorTable UniformGrid::getColorTable() {
+    float baseSteps = sqrt(this->fractal->pendulum->L1 / this->fractal->pendulum->g) / this->fractal->pendulum->dt;
+
+    return ColorTable(ColorScale(), baseSteps, this->nStepMax);
+}
+
 void UniformGrid::saveImage(const std::string fileName) {
-    auto img = this->render();
-    img->write(fileName);
-}
\ No newline at end of file
+    std::vector<png::rgb_pixel> pixels(this->data.size());
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+
+    this->getColorTable().colorPixels(this->data.size(), [this](std::size_t i) { return this->data.get(i); }, pixels.data());
+    this->timings.render += Instrumentation::secondsSince(start);
+    start = Instrumentation::Clock::now();
+    PngWriter image(fileName, this->imgSize.x, this->imgSize.y, this->compressionLevel);
+    image.writeRows(pixels.data(), this->imgSize.y);
+    this->timings.encode += Instrumentation::secondsSince(start);
+}
@@ -3,7 +3,19 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <ostream>
+#include <png++/rgb_pixel.hpp>
 #include "Fractal.hpp"
+#include "ColorTable.hpp"
+#include "TileScheduler.hpp"
+#include "StepsBuffer.hpp"
+#include "Checkpoint.hpp"
+#include "Shard.hpp"
+#include "DataFile.hpp"
+#include "ResultCache.hpp"
+#include "RunReport.hpp"
 
 /*
  * Simplest way to sample the values to draw the fractal: with a uniform grid.
@@ -12,6 +24,21 @@
  * the target function is evaluated at the vertices of these squares.
  */
 class UniformGrid {
+    public:
+        // Wall clock time in [s] spent in each phase of the computations and of the savings so far.
+        struct Timings {
+            // Evaluating the pixels.
+            double compute = 0;
+            // Coloring the pixels, compressing and writing the PNG image.
+            double render = 0, encode = 0;
+            // Writing the data files.
+            double save = 0;
+        };
+        // Time in [s] a task of the computation spent on its tiles, and waiting for the other tasks.
+        struct ThreadTimes {
+            double busy = 0, idle = 0;
+        };
+
     private:
         const std::shared_ptr<Fractal> fractal;
         // Domain of the fractal.
@@ -24,36 +51,274 @@ class UniformGrid {
         struct { int x; int y; } imgSize;
         // Text output lines starting with this character will be interpreted as comments, not data.
         static const char textComment;
-        // 1D data vector actually containing the 2D data.
-        std::vector<int> data;
+        /*
+         * 1D data vector actually containing the 2D data of the rows
+         * [bandY0, bandY0 + bandRows) of the image: all of them after
+         * calcData(), a band at a time in streamImage().
+         */
+        StepsBuffer data;
+        int bandY0, bandRows;
+        // Wether each pixel was recomputed by the double precision fallback (see Fractal::Precision).
+        std::vector<char> fallback;
+        /*
+         * With zero initial velocities the motion from (-ai1, -ai2) is the
+         * mirror image of the one from (ai1, ai2), so they flip after the same
+         * number of steps. If the grid is aligned with its own mirror image,
+         * pixel (x, y) mirrors pixel (mirror.x - x, mirror.y - y): only one of
+         * the two is evaluated and the other is copied (see isMirrored()).
+         */
+        bool symmetric;
+        struct { int x; int y; } mirror;
+        // Whether the mirror is used by the current computation (see isMirrored()).
+        bool useMirror;
+        /*
+         * Pixels evaluated with Fractal::stepsToFlip(), ruled out beforehand
+         * because they cannot flip, and filled by boundary tracing (see
+         * RenderMode).
+         */
+        long evaluatedPixels, ruledOutPixels, filledPixels;
+        std::mutex pixelCountsMutex;
+        // Steps integrated for each pixel of the band, only with a costMapFileName.
+        StepsBuffer cost;
+        // Only while calcData() runs with a checkpointFileName.
+        std::unique_ptr<Checkpoint> checkpoint;
+        int resumedTiles;
+        // Only while saveShard() runs.
+        const Shard *shard;
+        /*
+         * If the domain is aligned with the grid, pixel (x, y) is the point
+         * (lattice.x + x, lattice.y - y) of the lattice of the cache (see
+         * ResultCache).
+         */
+        bool aligned;
+        struct { long x; long y; } lattice;
+        // Only while a computation runs with a cacheDirectory.
+        std::unique_ptr<ResultCache> cache;
+        long cacheHits, cacheMisses;
+        Timings timings;
+        // Only counted by instrumented builds (see Instrumentation), for each task of calcBand().
+        std::vector<ThreadTimes> threadTimes;
 
+        // Reset the counters and the timings before a computation with nTasks tasks.
+        void resetCounters(int nTasks);
+        /*
+         * Each thread evaluates the tiles given by the scheduler to its
+         * threadIndex until none is left, each tile in a single batch.
+         * busy is the time spent on the tiles (instrumented builds only).
+         */
+        void calcThreaded(TileScheduler &scheduler, int threadIndex, double &busy);
+        // Whether the tile of the band is already done (see Checkpoint) or belongs to another shard.
+        bool isTileSkipped(const TileScheduler::Tile &tile);
+        /*
+         * Initial conditions of the pixels of column img_x and row img_y.
+         * With the cache they are computed from the lattice coordinates, so
+         * that a point has the same ones in any run.
+         */
+        double getAi1(int img_x);
+        double getAi2(int img_y);
+        /*
+         * this->fractal->stepsToFlip() of the pixels (indices in this->data)
+         * with the given initial conditions. With the cache only the pixels
+         * not found in it are evaluated, and then stored. The cost map, if
+         * any, is set for the pixels evaluated.
+         */
+        void stepsToFlip(const std::vector<int> &pixels, const std::vector<double> &ai1, const std::vector<double> &ai2,
+                         int *steps, bool *fallback);
+        // Open the cache before a computation, if any, and close it afterwards.
+        void openCache();
+        void closeCache();
+        // The parameters the results depend on, except the grid size (see ResultCache).
+        std::string getCacheKey();
+        // Evaluate the rows of the current band with nTasks tasks of the pool.
+        void calcBand(int nTasks);
+        /*
+         * Mark the pixels [x0, x1) of the row at ai2 whose initial conditions
+         * cannot flip: they form an interval around each multiple of 2 pi
+         * (see Fractal::cannotFlipHalfWidth()).
+         */
+        void markCannotFlip(double ai2, int x0, int x1, const std::vector<double> &ai1, std::vector<char> &cannotFlip);
+        // Same as calcThreaded() for the Boundary render mode: each tile is traced with traceRectangle().
+        void calcTraced(TileScheduler &scheduler, int threadIndex, double &busy);
+        /*
+         * The rectangles of the tile to trace: with the mirror the pixels
+         * copied from their mirrors form a rectangle (see isMirrored()),
+         * which is cut out of the tile leaving up to 4 rectangles.
+         */
+        std::vector<TileScheduler::Tile> tracedParts(const TileScheduler::Tile &tile);
+        /*
+         * Evaluate the given pixels (indices in this->data) in a single batch,
+         * except the ones which cannot flip. Adds the number of pixels
+         * evaluated and ruled out to the counts.
+         */
+        void evaluatePixels(const std::vector<int> &pixels, long &evaluated, long &ruledOut);
+        /*
+         * Mariani-Silver algorithm on the rectangle with corners (x0, y0) and
+         * (x1, y1) included, whose border is already evaluated: if the border
+         * is uniform the interior is filled, otherwise the rectangle is split
+         * in two along its longer side and each half is traced recursively.
+         */
+        void traceRectangle(int x0, int y0, int x1, int y1, long &evaluated, long &ruledOut, long &filled);
+        // Whether the border of the rectangle is uniform within boundaryTolerance, and the value to fill it with.
+        bool isBorderUniform(int x0, int y0, int x1, int y1, int &value);
+        /*
+         * Wether the pixel is copied from its mirror instead of being evaluated.
+         * Only when the whole image is in memory: when streaming the mirror of
+         * a band is computed at a different time, and a shard may not have it.
+         */
+        bool isMirrored(int img_x, int img_y);
+        // Copy the data of the evaluated pixels to their mirrors.
+        void fillMirrored();
+        // Colors of the default scale for each number of steps.
+        ColorTable getColorTable();
+        // Write the simulation parameters, shared by the text and the binary data files.
+        void writeHeader(std::ostream &outFile);
+        // The simulation parameters of the binary data files (see DataFile).
+        std::string getParameters();
+        // The binary data file of the cost map (see costMapFileName).
+        std::unique_ptr<DataFileWriter> openCostMap();
         /*
-         * Each thread, through the threadsNum and threadIndex arguments, is
-         * assigned a different, non-intersecting set of pixels to calculate
-         * autonomously.
+         * Write the header of a raw data file, followed by the binary data in
+         * host byte order (see saveShard()). The extra header lines are written
+         * before the last one, which gives the storage of the data.
          */
-        void calcThreaded(int threadsNum, int threadIndex);
-        // Renders the data into a in-memory PNG image of the fractal.
-        std::unique_ptr<png::image<png::rgb_pixel>> render();
+        void writeRawHeader(std::ostream &outFile, const std::string &extraLines = "");
 
     public:
+        /*
+         * Full evaluates every pixel. Boundary traces the borders of the flat
+         * areas (see traceRectangle()) and fills their interior without
+         * evaluating it: a rectangle whose border is uniform is assumed to be
+         * uniform inside, which misses any island of different values entirely
+         * contained in it.
+         */
+        enum class RenderMode {Full, Boundary};
+        static std::string renderModeToString(UniformGrid::RenderMode renderMode);
+        // Returns false if the name does not match any mode.
+        static bool stringToRenderMode(const std::string &name, UniformGrid::RenderMode &renderMode);
+
+        RenderMode renderMode;
+        /*
+         * A border is uniform if all its pixels do not flip, or if they all
+         * flip and the largest number of steps exceeds the smallest by at most
+         * boundaryTolerance times the smallest. The interior is then filled
+         * with the mean of the border. With 0 the steps must be all equal.
+         */
+        double boundaryTolerance;
+        // Side of the square tiles in [pixels] and order in which they are evaluated (see TileScheduler).
+        int tileSize;
+        // Largest tileSize: the pixel offsets within a tile and across a row of tiles must fit an int.
+        static const int MAX_TILE_SIZE;
+        TileScheduler::Order tileOrder;
+        /*
+         * Upper bound in [bytes] for the pixel data (steps and colors) held in
+         * memory by streamImage(), which sets the height of the bands. The
+         * memory used by the rest of the program (e.g. the compressed band of
+         * the PNG writer) is not included.
+         */
+        long memoryBudget;
+        // zlib compression level of the PNG images, from 0 to 9 (see PngWriter).
+        int compressionLevel;
+        // Encoding of the binary data files (see DataFile).
+        DataFile::Encoding dataEncoding;
+        /*
+         * If not empty, calcData() stores each tile in this file as soon as
+         * it is done (see Checkpoint), flushing it every checkpointInterval
+         * seconds. With resume the file of an interrupted render with the
+         * same parameters is reopened, and only the missing tiles are
+         * computed.
+         */
+        std::string checkpointFileName;
+        bool resume;
+        int checkpointInterval;
+        /*
+         * If not empty, the results are looked up in the cache in this
+         * directory before evaluating them, and stored in it afterwards (see
+         * ResultCache), so that rendering again or zooming into a domain
+         * computed before is mostly read from the cache. The domain must be
+         * aligned with the grid: ai1Min and ai2Max multiples of gridSize.
+         */
+        std::string cacheDirectory;
+        /*
+         * If not empty, calcData() and streamImage() save the cost map in
+         * this binary data file (see DataFile): the number of steps
+         * integrated for each pixel, 0 for the pixels which were not
+         * evaluated (ruled out, mirrored, filled by boundary tracing, read
+         * from the cache or the checkpoint). fractalRender draws it with the
+         * same scale of the steps to flip.
+         */
+        std::string costMapFileName;
+
         UniformGrid(std::shared_ptr<Fractal> fractal, int nStepMax,
                     double ai1Min, double ai1Max, double ai2Min, double ai2Max, double gridSize);
 
-        // Evaluate this->fractal->stepsToFlip() for each pixel of the grid.
+        /*
+         * Evaluate this->fractal->stepsToFlip() for each pixel of the grid.
+         *
+         * The work is submitted to ThreadPool::shared() as forceThreadNum
+         * tasks, each drawing tiles from the TileScheduler. If it is 0 there
+         * is one task for each thread of the pool.
+         */
         void calcData(int forceThreadNum = 0);
+        /*
+         * Evaluate the fractal and save the image in a PNG file (and the raw
+         * data in dataFileName, if not empty) without ever holding the whole
+         * image in memory: the image is computed in bands of rows fitting in
+         * memoryBudget, each one written as soon as it is done. The mirror
+         * symmetry is not used.
+         *
+         * The data are not kept: saveData() and saveImage() cannot be used
+         * afterwards.
+         */
+        void streamImage(const std::string imageFileName, const std::string dataFileName = "", int forceThreadNum = 0);
+        /*
+         * Evaluate only the tiles of the shard and save them in a binary file:
+         * the header of saveData() with the tileSize, shard and shardBy
+         * lines, followed by the steps of each tile of the shard in row-major
+         * order, each tile row by row. With Mixed precision the steps of each
+         * tile are followed by its fallback flags, one byte per pixel in the
+         * same order. The shards are then stitched by the fractalMerge program.
+         *
+         * Like streamImage() the tiles are computed in bands of tile rows
+         * fitting in memoryBudget (if not 0), and the mirror symmetry is not
+         * used.
+         */
+        void saveShard(const std::string fileName, const Shard &shard, int forceThreadNum = 0);
+        // Steps to flip of pixel (img_x, img_y) after calcData().
+        int getSteps(int img_x, int img_y);
+        // Number of tiles read from the checkpoint file by the last calcData().
+        int getResumedTiles();
+        // Number of pixels evaluated, ruled out by Fractal::canFlip() and filled by the last calcData() or streamImage().
+        long getEvaluatedPixels();
+        long getRuledOutPixels();
+        long getFilledPixels();
+        // Pixels found and not found in the cache by the last computation.
+        long getCacheHits();
+        long getCacheMisses();
+        // Phase timings since the last computation started.
+        Timings getTimings();
+        /*
+         * Add the sections of the last computation to the report: pixel
+         * counts, phase timings, throughput, and with instrumentation the
+         * busy and idle time of each task (see Instrumentation).
+         */
+        void report(RunReport &report);
         /*
          * Save the sampled data values in an ASCII file.
+         * With Mixed precision a fourth column marks the pixels recomputed by
+         * the double precision fallback.
          * 
          * This file can be then read by other programs to render the image of
          * the fractal multiple times without having to perform the calculation
          * all over again.
-         * 
-         * The forceThreadNum parameter can be used to force a certain number
-         * of threads to be used. If it is 0 the number of threads is automatically
-         * assigned to be std::thread::hardware_concurrency().
          */
         void saveData(const std::string fileName, const std::string separator = "\t");
+        /*
+         * Save the data in a binary file (see DataFile), much smaller and
+         * faster to write and read than the text of saveData(): it can be
+         * read by DataFileReader and rendered again by fractalRender. With
+         * Mixed precision it has the fallback plane, as streamImage() does.
+         */
+        void saveBinaryData(const std::string fileName);
         // Save the image render of the fractal in a PNG file.
         void saveImage(const std::string fileName);
 };
@@ -0,0 +1,340 @@
+/*
+ * Benchmarks of the main stages of the computation of the fractal, from the
+ * integration of a single pendulum to the files saved by the grids.
+ *
+ * Each benchmark is run once to warm up and then timed over several
+ * repetitions: the report gives the throughput from the mean time and the
+ * spread of the times, as a table or in JSON or CSV to compare builds.
+ */
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+#include "DoublePendulum/DoublePendulum.hpp"
+#include "Fractal/Fractal.hpp"
+#include "Fractal/ThreadPool.hpp"
+#include "Fractal/UniformGrid.hpp"
+#include "Fractal/Adaptive/AdaptiveGrid.hpp"
+#include "CommandLineOptions.hpp"
+
+const double g = 9.81;
+
+// Keeps the results of the benchmarked code from being optimized away.
+volatile double sink;
+
+struct Benchmark {
+    std::string name;
+    // Unit of the work done by each repetition, e.g. "steps".
+    std::string unit;
+    double work;
+    // Threads working on it, 0 if not a scaling benchmark.
+    int threads;
+    // Untimed preparation of each repetition, and the timed part.
+    std::function<void()> prepare, run;
+};
+
+struct Result {
+    Benchmark benchmark;
+    std::vector<double> times;
+    double mean, stddev, min;
+    // Parallel speedup over the single thread run, divided by the threads.
+    double efficiency;
+};
+
+void printHelpMessage() {
+    std::cout << "Usage:" << std::endl << std::endl;
+    std::cout << program_invocation_name << " [options]" << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--repetitions N:" << std::endl;
+    std::cout << "\t            timed repetitions of each benchmark, after one to warm up. Defaults to 5." << std::endl;
+    std::cout << "\t--quick:    smaller problems, to check that everything runs." << std::endl;
+    std::cout << "\t--filter TEXT:" << std::endl;
+    std::cout << "\t            run only the benchmarks whose name contains TEXT." << std::endl;
+    std::cout << "\t--format NAME:" << std::endl;
+    std::cout << "\t            format of the report. One of [text, json, csv]. Defaults to text." << std::endl;
+    std::cout << "\t--output FILE:" << std::endl;
+    std::cout << "\t            write the report in FILE instead of the standard output." << std::endl;
+    std::cout << "\t--threads N:" << std::endl;
+    std::cout << "\t            number of threads of the pool, the largest count of the scaling benchmarks." << std::endl;
+    std::cout << "\t            Defaults to the number of hardware threads." << std::endl << std::endl;
+}
+
+std::shared_ptr<Fractal> makeFractal(DoublePendulum::Variant variant) {
+    return std::make_shared<Fractal>(DoublePendulum::makeDoublePendulum(1, 1, 1, 1, 0.01, g, variant));
+}
+
+Result runBenchmark(const Benchmark &benchmark, int repetitions) {
+    Result result;
+    double sum = 0, squares = 0;
+
+    result.benchmark = benchmark;
+    for (int r = -1; r < repetitions; r++) {
+        benchmark.prepare();
+        auto start = std::chrono::steady_clock::now();
+        benchmark.run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        // The first run warms up the caches and the pool.
+        if (r >= 0) {
+            result.times.push_back(elapsed.count());
+        }
+    }
+    for (double time: result.times) {
+        sum += time;
+        squares += time * time;
+    }
+    result.mean = sum / result.times.size();
+    result.stddev = sqrt(std::max(0.0, squares / result.times.size() - result.mean * result.mean));
+    result.min = *std::min_element(result.times.begin(), result.times.end());
+    result.efficiency = 0;
+    return result;
+}
+
+void writeText(std::ostream &out, const std::vector<Result> &results) {
+    out << std::left << std::setw(36) << "benchmark" << std::right << std::setw(16) << "rate" << "  " << std::left << std::setw(10) << "unit"
+        << std::right << std::setw(12) << "mean [s]" << std::setw(10) << "spread" << std::setw(12) << "efficiency" << std::endl;
+    for (auto &result: results) {
+        out << std::left << std::setw(36) << result.benchmark.name << std::right << std::setw(16) << std::setprecision(4)
+            << result.benchmark.work / result.mean << "  " << std::left << std::setw(10) << result.benchmark.unit + "/s"
+            << std::right << std::setw(12) << result.mean << std::setw(9) << std::setprecision(2) << std::fixed
+            << 100 * result.stddev / result.mean << "%";
+        if (result.benchmark.threads > 0) {
+            out << std::setw(11) << 100 * result.efficiency << "%";
+        }
+        out << std::defaultfloat << std::endl;
+    }
+}
+
+void writeJson(std::ostream &out, const std::vector<Result> &results) {
+    out << "{" << std::endl;
+    out << "  \"compiler\": \"" << __VERSION__ << "\"," << std::endl;
+    out << "  \"threads\": " << ThreadPool::shared().getSize() << "," << std::endl;
+    out << "  \"benchmarks\": [" << std::endl;
+    out << std::setprecision(9);
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result &result = results[i];
+        out << "    {\"name\": \"" << result.benchmark.name << "\", \"unit\": \"" << result.benchmark.unit << "\", "
+            << "\"work\": " << result.benchmark.work << ", \"threads\": " << result.benchmark.threads << ", "
+            << "\"rate\": " << result.benchmark.work / result.mean << ", "
+            << "\"mean\": " << result.mean << ", \"stddev\": " << result.stddev << ", \"min\": " << result.min << ", ";
+        if (result.benchmark.threads > 0) {
+            out << "\"efficiency\": " << result.efficiency << ", ";
+        }
+        out << "\"times\": [";
+        for (std::size_t r = 0; r < result.times.size(); r++) {
+            out << (r > 0 ? ", " : "") << result.times[r];
+        }
+        out << "]}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+void writeCsv(std::ostream &out, const std::vector<Result> &results) {
+    out << "name,unit,work,threads,rate,mean,stddev,min,efficiency" << std::endl;
+    out << std::setprecision(9);
+    for (auto &result: results) {
+        out << result.benchmark.name << "," << result.benchmark.unit << "," << result.benchmark.work << ","
+            << result.benchmark.threads << "," << result.benchmark.work / result.mean << "," << result.mean << ","
+            << result.stddev << "," << result.min << ",";
+        if (result.benchmark.threads > 0) {
+            out << result.efficiency;
+        }
+        out << std::endl;
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    std::vector<Benchmark> benchmarks;
+    std::vector<Result> results;
+    std::string format, outFileName, filter;
+    int repetitions, poolSize;
+    bool quick;
+    CommandLineOptions options(argc, argv);
+
+    if (options.positionalNum != 1) {
+        std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    repetitions = options.getInt("repetitions", 5);
+    if (repetitions < 1) {
+        std::cerr << "Invalid repetitions option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    quick = options.has("quick");
+    filter = options.getString("filter", "");
+    format = options.getString("format", "text");
+    if (format != "text" && format != "json" && format != "csv") {
+        std::cerr << "Invalid format option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    outFileName = options.getString("output", "");
+    ThreadPool::setSharedSize(options.getInt("threads", 0));
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    poolSize = ThreadPool::shared().getSize();
+
+    // The files are saved in a temporary directory, removed at the end.
+    char directoryTemplate[] = "/tmp/benchmarkXXXXXX";
+    if (mkdtemp(directoryTemplate) == nullptr) {
+        std::cerr << "Cannot create a temporary directory!" << std::endl;
+        return 1;
+    }
+    std::string directory(directoryTemplate);
+    auto nothing = []() {};
+
+    // A single pendulum advanced by RK4.
+    const int nSteps = quick ? 100000 : 2000000;
+    for (auto variant: {DoublePendulum::Variant::Simple, DoublePendulum::Variant::Compound}) {
+        std::shared_ptr<DoublePendulum> pendulum = DoublePendulum::makeDoublePendulum(1, 1, 1, 1, 0.01, g, variant);
+        benchmarks.push_back({"calcNextState/" + DoublePendulum::variantToString(variant), "steps", (double) nSteps, 0, nothing, [pendulum, nSteps]() {
+            StateVector state = {2, 0, 1, 0};
+            for (int i = 0; i < nSteps; i++) {
+                state = pendulum->calcNextState(state);
+            }
+            sink = state.a1;
+        }});
+    }
+
+    /*
+     * A batch of identical initial conditions, as evaluated by the grids:
+     * easy flips after 56 steps, medium after 2573 and chaotic never flips
+     * within nStepMax, integrating all the steps. The batch is evaluated
+     * again until about the steps of the chaotic one are done.
+     */
+    const int batchSize = 64, flipStepMax = quick ? 4000 : 20000;
+    struct { std::string name; double ai1, ai2; } points[] = {{"easy", 3, 3}, {"medium", 2.9, 0.5}, {"chaotic", 2, 1.5}};
+    for (auto &point: points) {
+        auto fractal = makeFractal(DoublePendulum::Variant::Simple);
+        int steps = fractal->stepsToFlip(point.ai1, point.ai2, flipStepMax);
+        steps = steps == Fractal::STEPS_OUT_OF_SCALE ? flipStepMax : steps;
+        int rounds = std::max(1, flipStepMax / steps);
+        benchmarks.push_back({"stepsToFlip/" + point.name, "steps", (double) batchSize * steps * rounds, 0, nothing, [fractal, point, batchSize, flipStepMax, rounds]() {
+            std::vector<double> ai1(batchSize, point.ai1), ai2(batchSize, point.ai2);
+            std::vector<int> steps(batchSize);
+            for (int r = 0; r < rounds; r++) {
+                fractal->stepsToFlip(ai1.data(), ai2.data(), steps.data(), batchSize, flipStepMax);
+            }
+            sink = steps[0];
+        }});
+    }
+
+    // The whole domain on 1, 2, 4, ... threads, up to the size of the pool.
+    const double gridSize = quick ? 0.1 : 0.04;
+    const int gridStepMax = quick ? 500 : 1000;
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < poolSize; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(poolSize);
+    auto uniformGrid = std::make_shared<UniformGrid>(makeFractal(DoublePendulum::Variant::Simple), gridStepMax, -M_PI, M_PI, -M_PI, M_PI, gridSize);
+    auto uniformComputed = std::make_shared<bool>(false);
+    double pixels = pow(ceil(2 * M_PI / gridSize), 2);
+    for (int threads: threadCounts) {
+        benchmarks.push_back({"UniformGrid::calcData/threads=" + std::to_string(threads), "pixels", pixels, threads, nothing, [uniformGrid, uniformComputed, threads]() {
+            uniformGrid->calcData(threads);
+            *uniformComputed = true;
+        }});
+    }
+    // The files of the last computation, if any.
+    auto computeUniform = [uniformGrid, uniformComputed]() {
+        if (!*uniformComputed) {
+            uniformGrid->calcData();
+            *uniformComputed = true;
+        }
+    };
+    benchmarks.push_back({"UniformGrid::saveImage", "pixels", pixels, 0, computeUniform, [uniformGrid, directory]() {
+        uniformGrid->saveImage(directory + "/uniform.png");
+    }});
+    benchmarks.push_back({"UniformGrid::saveData", "pixels", pixels, 0, computeUniform, [uniformGrid, directory]() {
+        uniformGrid->saveData(directory + "/uniform.txt");
+    }});
+    benchmarks.push_back({"UniformGrid::saveBinaryData", "pixels", pixels, 0, computeUniform, [uniformGrid, directory]() {
+        uniformGrid->saveBinaryData(directory + "/uniform.dat");
+    }});
+
+    // Cycles from a new grid, then the files of the last one, if any.
+    const int nCycles = quick ? 100 : 400;
+    auto adaptiveGrid = std::make_shared<std::unique_ptr<AdaptiveGrid>>();
+    auto newAdaptive = [adaptiveGrid, gridStepMax]() {
+        *adaptiveGrid = std::make_unique<AdaptiveGrid>(makeFractal(DoublePendulum::Variant::Simple), gridStepMax, 0, 0, 2 * M_PI);
+    };
+    auto computeAdaptive = [adaptiveGrid, newAdaptive, nCycles]() {
+        if (!*adaptiveGrid) {
+            newAdaptive();
+            (*adaptiveGrid)->cycle(nCycles);
+        }
+    };
+    benchmarks.push_back({"AdaptiveGrid::cycle", "cycles", (double) nCycles, 0, newAdaptive, [adaptiveGrid, nCycles]() {
+        (*adaptiveGrid)->cycle(nCycles);
+    }});
+    benchmarks.push_back({"AdaptiveGrid::saveImage", "images", 1, 0, computeAdaptive, [adaptiveGrid, directory]() {
+        (*adaptiveGrid)->saveImage(directory + "/adaptive.png");
+    }});
+    benchmarks.push_back({"AdaptiveGrid::saveData", "files", 1, 0, computeAdaptive, [adaptiveGrid, directory]() {
+        (*adaptiveGrid)->saveData(directory + "/adaptive.txt");
+    }});
+
+    try {
+        for (auto &benchmark: benchmarks) {
+            if (benchmark.name.find(filter) == std::string::npos) {
+                continue;
+            }
+            std::cerr << "Running " << benchmark.name << "..." << std::endl;
+            results.push_back(runBenchmark(benchmark, repetitions));
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    // Efficiency of each thread count against the single thread one.
+    for (auto &result: results) {
+        for (auto &single: results) {
+            if (result.benchmark.threads > 0 && single.benchmark.threads == 1 && single.benchmark.name.substr(0, single.benchmark.name.find('/'))
+                                                                                   == result.benchmark.name.substr(0, result.benchmark.name.find('/'))) {
+                result.efficiency = single.mean / result.mean / result.benchmark.threads;
+            }
+        }
+    }
+
+    std::ofstream outFile;
+    if (!outFileName.empty()) {
+        outFile.open(outFileName);
+        if (!outFile) {
+            std::cerr << "Cannot open " << outFileName << " for writing" << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = outFileName.empty() ? std::cout : outFile;
+    if (format == "json") {
+        writeJson(out, results);
+    } else if (format == "csv") {
+        writeCsv(out, results);
+    } else {
+        writeText(out, results);
+    }
+
+    for (auto name: {"uniform.png", "uniform.txt", "uniform.dat", "adaptive.png", "adaptive.txt"}) {
+        unlink((directory + "/" + name).c_str());
+    }
+    rmdir(directory.c_str());
+}
@@ -0,0 +1,571 @@
+/*
+ * Numerical equivalence of the fast paths of the computation against the
+ * reference integration: the equations of motion, RK4 and flip detection of
+ * the code before any of the fast paths existed, copied here (see
+ * ReferencePendulum) so that they do not share any kernel with the
+ * candidates, one initial condition at a time and with no check beforehand
+ * of which initial conditions can flip.
+ *
+ * Each candidate (a way of computing the steps to flip, e.g. on lanes, with
+ * mixed precision or by a UniformGrid) evaluates a fixed corpus of initial
+ * conditions for both variants, with unit masses and lengths and with
+ * uneven ones: random points over the whole domain, a
+ * small grid of the whole domain and a small grid of a chaotic area. The
+ * report gives, for each of them, the initial conditions with other steps
+ * than the reference, those flipping for only one of them, the largest
+ * difference of the steps (a
+ * trajectory not flipping counts as nStepMax) and the largest relative
+ * energy error of the trajectories. The program fails if any candidate
+ * exceeds its thresholds.
+ *
+ * The grid candidates are also run on the grids which are mirror symmetric,
+ * and on the same grids shifted by a millionth of a pixel (so without the
+ * symmetry, but with the same image):
+ * using the mirror must not compute more pixels than not using it.
+ */
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include "DoublePendulum/DoublePendulum.hpp"
+#include "Fractal/Fractal.hpp"
+#include "Fractal/ThreadPool.hpp"
+#include "Fractal/UniformGrid.hpp"
+#include "CommandLineOptions.hpp"
+
+const double g = 9.81;
+const double dt = 0.01;
+
+// Masses and lengths of the pendulums evaluated.
+struct Parameters {
+    std::string name;
+    double M1, M2, L1, L2;
+};
+
+/*
+ * The reference integration, copied verbatim from the code before any of
+ * the fast paths existed: the equations of motion of SimpleDoublePendulum
+ * and CompoundDoublePendulum, the RK4 of DoublePendulum::calcNextState()
+ * and Fractal::detectFlip().
+ */
+class ReferencePendulum {
+    public:
+        ReferencePendulum(DoublePendulum::Variant variant, const Parameters &parameters) :
+            variant(variant), M1(parameters.M1), M2(parameters.M2), L1(parameters.L1), L2(parameters.L2) {
+            // Constants used in the equation of state of the compound pendulum.
+            this->c[0] = this->M1 * pow(this->L1 / 2.0, 2) / 2.0
+                       + this->M1 * pow(this->L1, 2) / 12.0 / 2.0
+                       + this->M2 * pow(this->L1, 2) / 2.0;
+            this->c[1] = this->M2 * pow(this->L2 / 2.0, 2) / 2.0
+                       + this->M2 * pow(this->L2, 2) / 12.0 / 2.0;
+            this->c[2] = this->M2 * this->L1 * this->L2 / 2.0;
+            this->c[3] = this->g * (this->M1 * this->L1 / 2.0 + this->M2 * this->L1);
+            this->c[4] = this->g * this->M2 * this->L2 / 2.0;
+        }
+
+        StateVector motionEquationStateForm(StateVector y) {
+            StateVector out;
+
+            out[0] = y.w1;
+            out[2] = y.w2;
+            if (this->variant == DoublePendulum::Variant::Simple) {
+                out[1] = (
+                    this->M2 * this->L1 * cos(y.a2 - y.a1) * sin(y.a2 - y.a1) * pow(y.w1, 2)
+                    + this->M2 * this->L2 * sin(y.a2 - y.a1) * pow(y.w2, 2)
+                    - (this->M1 + this->M2) * this->g * sin(y.a1)
+                    + this->M2 * this->g * cos(y.a2 - y.a1) * sin(y.a2)
+                ) / (
+                    (this->M1 + this->M2) * this->L1 - this->M2 * this->L1 * pow(cos(y.a2 - y.a1), 2)
+                );
+                out[3] = (
+                    - (this->M1 + this->M2) * this->L1 * sin(y.a2 - y.a1) * pow(y.w1, 2)
+                    - this->M2 * this->L2 * cos(y.a2 - y.a1) * sin(y.a2 - y.a1) * pow(y.w2, 2)
+                    + (this->M1 + this->M2) * this->g * cos(y.a2 - y.a1) * sin(y.a1)
+                    - (this->M1 + this->M2) * this->g * sin(y.a2)
+                ) / (
+                    (this->M1 + this->M2) * this->L2 - this->M2 * this->L2 * pow(cos(y.a2 - y.a1), 2)
+                );
+            } else {
+                out[1] = (
+                    2 * this->c[1] * this->c[3] * sin(y.a1)
+                    + pow(this->c[2], 2) * pow(y.w1, 2) * sin(y.a1 - y.a2) * cos(y.a1 - y.a2)
+                    + 2 * this->c[1] * this->c[2] * pow(y.w2, 2) * sin(y.a1 - y.a2)
+                    - this->c[2] * this->c[4] * cos(y.a1 - y.a2) * sin(y.a2)
+                ) / (
+                    pow(this->c[2], 2) * pow(cos(y.a1 - y.a2), 2) - 4 * this->c[0] * this->c[1]
+                );
+                out[3] = (
+                    2 * this->c[0] * this->c[4] * sin(y.a2)
+                    - pow(this->c[2], 2) * pow(y.w2, 2) * sin(y.a1 - y.a2) * cos(y.a1 - y.a2)
+                    - 2 * this->c[0] * this->c[2] * pow(y.w1, 2) * sin(y.a1 - y.a2)
+                    - this->c[2] * this->c[3] * cos(y.a1 - y.a2) * sin(y.a1)
+                ) / (
+                    pow(this->c[2], 2) * pow(cos(y.a1 - y.a2), 2) - 4 * this->c[0] * this->c[1]
+                );
+            }
+            return out;
+        }
+
+        StateVector calcNextState(StateVector currState) {
+            StateVector Y1, Y2, Y3, Y4;
+            StateVector k1, k2, k3, k4;
+            StateVector nextState;
+
+            Y1 = currState;
+            k1 = motionEquationStateForm(Y1);
+            Y2 = currState + k1 * this->dt/2.0;
+
+            k2 = motionEquationStateForm(Y2);
+            Y3 = currState + k2 * this->dt/2.0;
+
+            k3 = motionEquationStateForm(Y3);
+            Y4 = currState + k3 * this->dt;
+
+            k4 = motionEquationStateForm(Y4);
+            nextState = currState + (k1 + k2 * 2 + k3 * 2 + k4) * this->dt/6.0;
+
+            return nextState;
+        }
+
+        static bool detectFlip(StateVector prevState, StateVector currState) {
+            // The offset by PI is to start counting rounds at the top (at an agle of PI radians
+            // in the global reference system) instead of at the bottom (0 radians).
+            float nRoundsRod1PrevState = floor((prevState.a1 - M_PI) / (2 * M_PI));
+            float nRoundsRod1CurrState = floor((currState.a1 - M_PI) / (2 * M_PI));
+            float nRoundsRod2PrevState = floor((prevState.a2 - M_PI) / (2 * M_PI));
+            float nRoundsRod2CurrState = floor((currState.a2 - M_PI) / (2 * M_PI));
+
+            return (nRoundsRod1PrevState != nRoundsRod1CurrState) || (nRoundsRod2PrevState != nRoundsRod2CurrState);
+        }
+
+    private:
+        DoublePendulum::Variant variant;
+        double M1, M2, L1, L2;
+        const double g = ::g, dt = ::dt;
+        double c[5];
+};
+
+// Initial conditions evaluated by all the candidates.
+struct Corpus {
+    std::string name;
+    std::vector<double> ai1, ai2;
+    // Only for the grids: the domain and the step, pixel (x, y) being (ai1Min + x * gridSize, ai2Max - y * gridSize).
+    bool grid;
+    double ai1Min, ai1Max, ai2Min, ai2Max, gridSize;
+    int sizeX, sizeY;
+    // The grid is mirror symmetric (see UniformGrid::isMirrored()).
+    bool symmetric;
+};
+
+struct Candidate {
+    std::string name;
+    // Configure the fractal to evaluate.
+    std::function<void(Fractal &)> setup;
+    // Evaluated by a UniformGrid (grid corpora only), or with the scalar Fractal::stepsToFlip().
+    bool grid, scalar;
+    UniformGrid::RenderMode renderMode;
+    // Pass thresholds, per corpus: initial conditions with other steps than the reference, of which flipping for only one.
+    int maxDiffering, maxFlipMismatches, maxDeviation;
+    double maxEnergyError;
+};
+
+struct Result {
+    std::string candidate, variant, parameters, corpus;
+    long total, identical, flipMismatches;
+    int maxDeviation;
+    double energyError;
+    bool passed;
+};
+
+// Pixels computed (evaluated or ruled out) by a grid candidate with and without the mirror symmetry.
+struct MirrorResult {
+    std::string candidate, variant, parameters, corpus;
+    long symmetric, shifted;
+};
+
+void printHelpMessage() {
+    std::cout << "Usage:" << std::endl << std::endl;
+    std::cout << program_invocation_name << " [options]" << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--candidates LIST:" << std::endl;
+    std::cout << "\t            comma separated candidates to check against the reference. Defaults to all of them:" << std::endl;
+    std::cout << "\t            scalar, lanes, fast-math, mixed, mixed-fast, recurrence, grid, grid-boundary." << std::endl;
+    std::cout << "\t--n-step-max N:" << std::endl;
+    std::cout << "\t            maximum number of steps of the simulation. Defaults to 1000." << std::endl;
+    std::cout << "\t--points N:" << std::endl;
+    std::cout << "\t            random initial conditions of the corpus. Defaults to 2000." << std::endl;
+    std::cout << "\t--quick:    smaller corpus and nStepMax, to check that everything runs." << std::endl;
+    std::cout << "\t--max-differing N:" << std::endl;
+    std::cout << "\t            maximum number of initial conditions of a corpus with other steps than the reference, for all the candidates." << std::endl;
+    std::cout << "\t--max-flip-mismatches N:" << std::endl;
+    std::cout << "\t            maximum number of initial conditions of a corpus flipping for only one of the candidate and the reference." << std::endl;
+    std::cout << "\t--max-deviation N:" << std::endl;
+    std::cout << "\t            maximum difference of the steps from the reference, for all the candidates." << std::endl;
+    std::cout << "\t--max-energy-error VAL:" << std::endl;
+    std::cout << "\t            maximum relative energy error of the trajectories, for all the candidates." << std::endl;
+    std::cout << "\t            each candidate has its own default thresholds, measured on the default corpus and listed in the report:" << std::endl;
+    std::cout << "\t            with other --n-step-max or --points give them explicitly." << std::endl;
+    std::cout << "\t--threads N:" << std::endl;
+    std::cout << "\t            number of threads of the pool evaluating the grids. Defaults to the number of hardware threads." << std::endl << std::endl;
+}
+
+// Uniform in [min, max), from a fixed sequence so that the corpus never changes.
+double nextRandom(uint64_t &seed, double min, double max) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return min + (max - min) * (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+Corpus makePoints(int pointsNum) {
+    Corpus corpus;
+    uint64_t seed = 1;
+
+    corpus.name = "points";
+    corpus.grid = false;
+    corpus.symmetric = false;
+    for (int i = 0; i < pointsNum; i++) {
+        corpus.ai1.push_back(nextRandom(seed, -M_PI, M_PI));
+        corpus.ai2.push_back(nextRandom(seed, -M_PI, M_PI));
+    }
+    return corpus;
+}
+
+// The initial conditions of the pixels of a UniformGrid on the domain.
+Corpus makeGrid(const std::string name, double ai1Min, double ai1Max, double ai2Min, double ai2Max, double gridSize,
+                bool symmetric) {
+    Corpus corpus;
+
+    corpus.name = name;
+    corpus.grid = true;
+    corpus.symmetric = symmetric;
+    corpus.ai1Min = ai1Min;
+    corpus.ai1Max = ai1Max;
+    corpus.ai2Min = ai2Min;
+    corpus.ai2Max = ai2Max;
+    corpus.gridSize = gridSize;
+    corpus.sizeX = (int) ceil((ai1Max - ai1Min) / gridSize);
+    corpus.sizeY = (int) ceil((ai2Max - ai2Min) / gridSize);
+    for (int y = 0; y < corpus.sizeY; y++) {
+        for (int x = 0; x < corpus.sizeX; x++) {
+            corpus.ai1.push_back(ai1Min + x * gridSize);
+            corpus.ai2.push_back(ai2Max - y * gridSize);
+        }
+    }
+    return corpus;
+}
+
+/*
+ * The reference: the steps to flip as computed before any of the fast paths
+ * existed, and the relative energy error at the end of the trajectory (the
+ * energy given by the pendulum, which is not one of the kernels checked).
+ */
+int referenceStepsToFlip(ReferencePendulum &reference, DoublePendulum &pendulum, double ai1, double ai2, int nStepMax,
+                         double &energyError) {
+    StateVector currState = {ai1, 0, ai2, 0}, nextState;
+    double initialEnergy = pendulum.getEnergy(currState);
+    // Left out of the energy error when it is not defined, as by Fractal.
+    auto relativeError = [&](const StateVector &state) {
+        return initialEnergy == 0 ? 0 : std::abs((pendulum.getEnergy(state) - initialEnergy) / initialEnergy);
+    };
+
+    for (int count = 0; count < nStepMax; count++) {
+        nextState = reference.calcNextState(currState);
+        if (count > 1 && ReferencePendulum::detectFlip(currState, nextState)) {
+            energyError = relativeError(nextState);
+            return count;
+        }
+        currState = nextState;
+    }
+    energyError = relativeError(currState);
+    return Fractal::STEPS_OUT_OF_SCALE;
+}
+
+// The steps of the candidate for each initial condition of the corpus, and the largest energy error.
+std::vector<int> evaluate(const Candidate &candidate, DoublePendulum::Variant variant, const Parameters &parameters,
+                          const Corpus &corpus, int nStepMax, double &energyError) {
+    auto fractal = std::make_shared<Fractal>(DoublePendulum::makeDoublePendulum(parameters.M1, parameters.M2, parameters.L1,
+                                                                                parameters.L2, dt, g, variant));
+    std::vector<int> steps(corpus.ai1.size());
+
+    fractal->measureEnergyDrift = true;
+    candidate.setup(*fractal);
+    if (candidate.grid) {
+        UniformGrid grid(fractal, nStepMax, corpus.ai1Min, corpus.ai1Max, corpus.ai2Min, corpus.ai2Max, corpus.gridSize);
+        grid.renderMode = candidate.renderMode;
+        grid.calcData();
+        for (int y = 0; y < corpus.sizeY; y++) {
+            for (int x = 0; x < corpus.sizeX; x++) {
+                steps[y * corpus.sizeX + x] = grid.getSteps(x, y);
+            }
+        }
+    } else if (candidate.scalar) {
+        for (std::size_t i = 0; i < steps.size(); i++) {
+            steps[i] = fractal->stepsToFlip(corpus.ai1[i], corpus.ai2[i], nStepMax);
+        }
+    } else {
+        fractal->stepsToFlip(corpus.ai1.data(), corpus.ai2.data(), steps.data(), steps.size(), nStepMax);
+    }
+    // Only the trajectories which were integrated.
+    energyError = fractal->getStatistics().energyDriftMax;
+    return steps;
+}
+
+// Pixels computed by the UniformGrid of the candidate on the corpus, with the domain moved by ai2Shift.
+long gridPixels(const Candidate &candidate, DoublePendulum::Variant variant, const Parameters &parameters, const Corpus &corpus,
+                int nStepMax, double ai2Shift) {
+    auto fractal = std::make_shared<Fractal>(DoublePendulum::makeDoublePendulum(parameters.M1, parameters.M2, parameters.L1,
+                                                                                parameters.L2, dt, g, variant));
+
+    candidate.setup(*fractal);
+    UniformGrid grid(fractal, nStepMax, corpus.ai1Min, corpus.ai1Max, corpus.ai2Min + ai2Shift, corpus.ai2Max + ai2Shift,
+                     corpus.gridSize);
+    grid.renderMode = candidate.renderMode;
+    grid.calcData();
+    return grid.getEvaluatedPixels() + grid.getRuledOutPixels();
+}
+
+Result compare(const Candidate &candidate, DoublePendulum::Variant variant, const Parameters &parameters, const Corpus &corpus,
+               int nStepMax, const std::vector<int> &reference, double referenceEnergyError) {
+    Result result;
+    std::vector<int> steps;
+    int deviation;
+
+    result.candidate = candidate.name;
+    result.variant = DoublePendulum::variantToString(variant);
+    result.parameters = parameters.name;
+    result.corpus = corpus.name;
+    steps = evaluate(candidate, variant, parameters, corpus, nStepMax, result.energyError);
+
+    result.total = steps.size();
+    result.identical = 0;
+    result.flipMismatches = 0;
+    result.maxDeviation = 0;
+    for (std::size_t i = 0; i < steps.size(); i++) {
+        if (steps[i] == reference[i]) {
+            result.identical++;
+            continue;
+        }
+        if (steps[i] == Fractal::STEPS_OUT_OF_SCALE || reference[i] == Fractal::STEPS_OUT_OF_SCALE) {
+            result.flipMismatches++;
+        }
+        // Not flipping counts as nStepMax.
+        deviation = std::abs((steps[i] == Fractal::STEPS_OUT_OF_SCALE ? nStepMax : steps[i])
+                             - (reference[i] == Fractal::STEPS_OUT_OF_SCALE ? nStepMax : reference[i]));
+        result.maxDeviation = std::max(result.maxDeviation, deviation);
+    }
+    result.passed = result.total - result.identical <= candidate.maxDiffering
+                    && result.flipMismatches <= candidate.maxFlipMismatches
+                    && result.maxDeviation <= candidate.maxDeviation
+                    && result.energyError <= std::max(candidate.maxEnergyError, referenceEnergyError);
+    return result;
+}
+
+int main(int argc, const char * argv[])
+{
+    std::vector<Candidate> candidates, selected;
+    std::vector<Corpus> corpora;
+    std::vector<Parameters> parametersSets;
+    std::vector<Result> results;
+    std::vector<MirrorResult> mirrorResults;
+    std::string candidatesList, name;
+    int nStepMax, pointsNum;
+    bool quick, passed;
+    CommandLineOptions options(argc, argv);
+
+    if (options.positionalNum != 1) {
+        std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    quick = options.has("quick");
+    nStepMax = options.getInt("n-step-max", quick ? 300 : 1000);
+    if (nStepMax < 1) {
+        std::cerr << "Invalid nStepMax option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    pointsNum = options.getInt("points", quick ? 200 : 2000);
+    if (pointsNum < 0) {
+        std::cerr << "Invalid points option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    /*
+     * The default thresholds: the paths which only reorganize the same
+     * computation must give the same steps as the reference, the others
+     * may move a few chaotic flips. Their thresholds are tied to this corpus
+     * and to the default nStepMax = 1000: the largest differing initial
+     * conditions, flip mismatches and deviation measured on any of its
+     * corpora, plus a margin of about half the counts and a quarter of the
+     * deviation, so that a change which moves more flips, or moves them
+     * further, fails. Measured:
+     * - fast-math and recurrence: none, held to 2, 1 and 10 steps;
+     * - mixed: 3, 1 and 198 steps (a trajectory not flipping in float, then
+     *   trusted, flips late in double), held to 6, 2 and 250;
+     * - mixed-fast: 8, 2 and 87 steps, held to 12, 4 and 110;
+     * - grid-boundary: 6, 6 and 372 steps (a pixel of the chaotic area with
+     *   the uneven simple pendulum filled from its neighbours), held to 10,
+     *   8 and 450.
+     * The smaller corpus of --quick stays within them.
+     * The energy error is only held to maxEnergyError where the reference
+     * itself drifts less.
+     */
+    auto rk4 = [](Fractal &fractal) {};
+    auto fastMath = [](Fractal &fractal) {
+        fractal.pendulum->mathAccuracy = DoublePendulum::MathAccuracy::Fast;
+    };
+    auto mixed = [](Fractal &fractal) {
+        fractal.precision = Fractal::Precision::Mixed;
+    };
+    auto mixedFast = [](Fractal &fractal) {
+        fractal.precision = Fractal::Precision::Mixed;
+        fractal.pendulum->mathAccuracy = DoublePendulum::MathAccuracy::Fast;
+    };
+    auto recurrence = [](Fractal &fractal) {
+        fractal.earlyExit = Fractal::EarlyExit::Recurrence;
+    };
+    candidates.push_back({"scalar", rk4, false, true, UniformGrid::RenderMode::Full, 0, 0, 0, 1e-3});
+    candidates.push_back({"lanes", rk4, false, false, UniformGrid::RenderMode::Full, 0, 0, 0, 1e-3});
+    candidates.push_back({"fast-math", fastMath, false, false, UniformGrid::RenderMode::Full, 2, 1, 10, 1e-3});
+    candidates.push_back({"mixed", mixed, false, false, UniformGrid::RenderMode::Full, 6, 2, 250, 1e-3});
+    candidates.push_back({"mixed-fast", mixedFast, false, false, UniformGrid::RenderMode::Full, 12, 4, 110, 1e-3});
+    candidates.push_back({"recurrence", recurrence, false, false, UniformGrid::RenderMode::Full, 2, 1, 10, 1e-3});
+    candidates.push_back({"grid", rk4, true, false, UniformGrid::RenderMode::Full, 0, 0, 0, 1e-3});
+    candidates.push_back({"grid-boundary", rk4, true, false, UniformGrid::RenderMode::Boundary, 10, 8, 450, 1e-3});
+
+    candidatesList = options.getString("candidates", "");
+    if (candidatesList.empty()) {
+        selected = candidates;
+    } else {
+        std::istringstream names(candidatesList);
+        while (std::getline(names, name, ',')) {
+            auto found = std::find_if(candidates.begin(), candidates.end(), [&name](const Candidate &candidate) {
+                return candidate.name == name;
+            });
+            if (found == candidates.end()) {
+                std::cerr << "Invalid candidates option!" << std::endl << std::endl;
+                printHelpMessage();
+                return 1;
+            }
+            selected.push_back(*found);
+        }
+    }
+    for (auto &candidate: selected) {
+        candidate.maxDiffering = options.getInt("max-differing", candidate.maxDiffering);
+        candidate.maxFlipMismatches = options.getInt("max-flip-mismatches", candidate.maxFlipMismatches);
+        candidate.maxDeviation = options.getInt("max-deviation", candidate.maxDeviation);
+        candidate.maxEnergyError = options.getDouble("max-energy-error", candidate.maxEnergyError);
+    }
+    ThreadPool::setSharedSize(options.getInt("threads", 0));
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    /*
+     * The whole domain is mirror symmetric on the grid, so the grid
+     * candidates use the symmetry, and so is the off-centre domain, whose
+     * mirror (the pixel of the initial conditions (0, 0)) is not in the
+     * middle of the image and only covers a few rows.
+     */
+    corpora.push_back(makePoints(pointsNum));
+    corpora.push_back(makeGrid("domain", -3, 3, -3, 3, quick ? 0.25 : 0.125, true));
+    corpora.push_back(makeGrid("offcentre", -3, 3, -3, 0.5, quick ? 0.25 : 0.125, true));
+    corpora.push_back(makeGrid("chaotic", 1.5, 2.5, 0.5, 1.5, quick ? 1.0 / 24 : 1.0 / 48, false));
+    /*
+     * Unit masses and lengths, and uneven ones, with the heavier and longer
+     * lower rod, so that a kernel mixing up the parameters of the two rods
+     * cannot pass.
+     */
+    parametersSets.push_back({"unit", 1, 1, 1, 1});
+    parametersSets.push_back({"uneven", 0.7, 1.6, 0.8, 1.3});
+
+    try {
+        for (auto &parameters: parametersSets) {
+            for (auto variant: {DoublePendulum::Variant::Simple, DoublePendulum::Variant::Compound}) {
+                auto pendulum = DoublePendulum::makeDoublePendulum(parameters.M1, parameters.M2, parameters.L1, parameters.L2,
+                                                                   dt, g, variant);
+                ReferencePendulum referencePendulum(variant, parameters);
+                for (auto &corpus: corpora) {
+                    std::vector<int> reference(corpus.ai1.size());
+                    double energyError, referenceEnergyError = 0;
+
+                    std::cerr << "Reference " << DoublePendulum::variantToString(variant) << "/" << parameters.name << "/"
+                              << corpus.name << "..." << std::endl;
+                    for (std::size_t i = 0; i < reference.size(); i++) {
+                        reference[i] = referenceStepsToFlip(referencePendulum, *pendulum, corpus.ai1[i], corpus.ai2[i], nStepMax,
+                                                            energyError);
+                        referenceEnergyError = std::max(referenceEnergyError, energyError);
+                    }
+                    results.push_back({"reference", DoublePendulum::variantToString(variant), parameters.name, corpus.name,
+                                       (long) reference.size(), (long) reference.size(), 0, 0, referenceEnergyError, true});
+
+                    for (auto &candidate: selected) {
+                        if (candidate.grid && !corpus.grid) {
+                            continue;
+                        }
+                        std::cerr << "Checking " << candidate.name << "..." << std::endl;
+                        results.push_back(compare(candidate, variant, parameters, corpus, nStepMax, reference, referenceEnergyError));
+                        if (candidate.grid && corpus.symmetric) {
+                            mirrorResults.push_back({candidate.name, DoublePendulum::variantToString(variant), parameters.name,
+                                                     corpus.name,
+                                                     gridPixels(candidate, variant, parameters, corpus, nStepMax, 0),
+                                                     gridPixels(candidate, variant, parameters, corpus, nStepMax,
+                                                                corpus.gridSize * 1e-6)});
+                        }
+                    }
+                }
+            }
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "nStepMax " << nStepMax << ", dt " << dt << std::endl << std::endl;
+    std::cout << std::left << std::setw(16) << "candidate" << std::setw(10) << "variant" << std::setw(8) << "masses"
+              << std::setw(10) << "corpus"
+              << std::right << std::setw(8) << "points" << std::setw(12) << "differing" << std::setw(12) << "flip diff"
+              << std::setw(12) << "max dev" << std::setw(14) << "energy error" << "  " << "result" << std::endl;
+    passed = true;
+    for (auto &result: results) {
+        std::cout << std::left << std::setw(16) << result.candidate << std::setw(10) << result.variant << std::setw(8)
+                  << result.parameters << std::setw(10) << result.corpus
+                  << std::right << std::setw(8) << result.total << std::setw(12) << result.total - result.identical
+                  << std::setw(12) << result.flipMismatches
+                  << std::setw(12) << result.maxDeviation << std::setw(14) << std::scientific << std::setprecision(2)
+                  << result.energyError << std::defaultfloat << "  " << (result.passed ? "ok" : "FAILED") << std::endl;
+        passed = passed && result.passed;
+    }
+
+    if (!mirrorResults.empty()) {
+        std::cout << std::endl << std::left << std::setw(16) << "mirror" << std::setw(10) << "variant" << std::setw(8) << "masses"
+                  << std::setw(10) << "corpus"
+                  << std::right << std::setw(12) << "symmetric" << std::setw(12) << "shifted" << "  " << "result" << std::endl;
+    }
+    for (auto &result: mirrorResults) {
+        std::cout << std::left << std::setw(16) << result.candidate << std::setw(10) << result.variant << std::setw(8)
+                  << result.parameters << std::setw(10) << result.corpus
+                  << std::right << std::setw(12) << result.symmetric << std::setw(12) << result.shifted << "  "
+                  << (result.symmetric <= result.shifted ? "ok" : "FAILED") << std::endl;
+        passed = passed && result.symmetric <= result.shifted;
+    }
+
+    std::cout << std::endl << "Thresholds per corpus (differing, flip diff, max dev, energy error):" << std::endl;
+    for (auto &candidate: selected) {
+        std::cout << "\t" << std::left << std::setw(16) << candidate.name << std::right << candidate.maxDiffering << ", "
+                  << candidate.maxFlipMismatches << ", " << candidate.maxDeviation << ", " << candidate.maxEnergyError << std::endl;
+    }
+    std::cout << std::endl << (passed ? "All the candidates match the reference." : "Some candidates do not match the reference!") << std::endl;
+    return passed ? 0 : 1;
+}
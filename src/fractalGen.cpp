@@ -1,17 +1,22 @@
 #include <string>
+#include <stdexcept>
 #include <iostream>
 #include <memory>
-#include <png++/image.hpp>
 #include <png++/rgb_pixel.hpp>
 #include "DoublePendulum/DoublePendulum.hpp"
 #include "Fractal/Fractal.hpp"
+#include "Fractal/ThreadPool.hpp"
 #include "Fractal/UniformGrid.hpp"
+#include "Fractal/PngWriter.hpp"
+#include "Fractal/RunReport.hpp"
+#include "Fractal/Instrumentation.hpp"
+#include "CommandLineOptions.hpp"
 
 const double g = 9.81;
 
 void printHelpMessage() {
     std::cout << "Usage:" << std::endl << std::endl;
-    std::cout << program_invocation_name << " outFile pendulumType M1 M2 L1 L2 ai1Min aiMax ai2Min ai2Max gridSize dt nStepMax" << std::endl << std::endl;
+    std::cout << program_invocation_name << " outFile pendulumType M1 M2 L1 L2 ai1Min aiMax ai2Min ai2Max gridSize dt nStepMax [options]" << std::endl << std::endl;
     std::cout << "\toutFile:    output file name (no extension)." << std::endl;
     std::cout << "\tpendulumType:" << std::endl;
     std::cout << "              type of pendulum. One of [simple, compound]." << std::endl;
@@ -22,6 +27,76 @@ void printHelpMessage() {
     std::cout << "\tgridSize:   increment of the starting angles in [rad]." << std::endl;
     std::cout << "\tdt:         time step of the simulation in [s]." << std::endl;
     std::cout << "\tnStepMax:   maximum number of steps of the simulation." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--integrator NAME:" << std::endl;
+    std::cout << "\t            integrator used to solve the motion. One of [rk4, dopri54, midpoint, gauss4, verlet]. Defaults to rk4." << std::endl;
+    std::cout << "\t            dopri54 adapts its step size (dt is only the first one) and simulates up to nStepMax * dt [s]." << std::endl;
+    std::cout << "\t            midpoint, gauss4 and verlet are symplectic: the energy error stays bounded also with a large dt." << std::endl;
+    std::cout << "\t--rtol VAL, --atol VAL:" << std::endl;
+    std::cout << "\t            relative and absolute error tolerances of the adaptive integrators. Default to 1e-8." << std::endl;
+    std::cout << "\t--energy-drift:" << std::endl;
+    std::cout << "\t            measure and report the relative energy error at the end of each trajectory." << std::endl;
+    std::cout << "\t--math NAME:" << std::endl;
+    std::cout << "\t            accuracy of the sine and cosine functions. One of [exact, fast]. Defaults to exact." << std::endl;
+    std::cout << "\t            fast uses vectorized polynomials, within 2.5 ulp of the exact results." << std::endl;
+    std::cout << "\t--precision NAME:" << std::endl;
+    std::cout << "\t            floating point precision of the evaluation with rk4. One of [double, mixed]. Defaults to double." << std::endl;
+    std::cout << "\t            mixed integrates in float on twice the lanes, recomputing in double the late flips." << std::endl;
+    std::cout << "\t--fallback-fraction VAL:" << std::endl;
+    std::cout << "\t            with mixed precision, flips after more than VAL * nStepMax steps are recomputed in double," << std::endl;
+    std::cout << "\t            the trajectories not flipping are trusted in float. 1 disables the fallback. Defaults to 0.5." << std::endl;
+    std::cout << "\t--early-exit NAME:" << std::endl;
+    std::cout << "\t            early termination of the trajectories which never flip, with fixed step integrators. One of [off, measure, recurrence]. Defaults to off." << std::endl;
+    std::cout << "\t            recurrence ends the trajectories which return close to a previous state (this may rarely miss a late flip)." << std::endl;
+    std::cout << "\t            measure runs the detector without acting on it: it saves nothing, and reports what recurrence would save." << std::endl;
+    std::cout << "\t--recurrence-tolerance VAL:" << std::endl;
+    std::cout << "\t            distance in [rad] within which a state is considered a return to a previous one. Defaults to 0.001." << std::endl;
+    std::cout << "\t--render NAME:" << std::endl;
+    std::cout << "\t            rendering mode. One of [full, boundary]. Defaults to full." << std::endl;
+    std::cout << "\t            boundary traces the borders of the flat areas and fills their interior without evaluating it." << std::endl;
+    std::cout << "\t--boundary-tolerance VAL:" << std::endl;
+    std::cout << "\t            with boundary rendering, relative spread of the steps within which a border is filled. Defaults to 0 (all equal)." << std::endl;
+    std::cout << "\t--tile-size N:" << std::endl;
+    std::cout << "\t            side in [pixels] of the square tiles distributed among the threads, at most 4096. Defaults to 32." << std::endl;
+    std::cout << "\t--tile-order NAME:" << std::endl;
+    std::cout << "\t            order in which the tiles are evaluated. One of [row-major, morton]. Defaults to morton." << std::endl;
+    std::cout << "\t--memory-budget MB:" << std::endl;
+    std::cout << "\t            compute and write the image in bands of rows holding at most MB [MiB] of data, instead of all at once." << std::endl;
+    std::cout << "\t            for images too large to fit in memory. Defaults to 0 (whole image in memory)." << std::endl;
+    std::cout << "\t--data-file FILE:" << std::endl;
+    std::cout << "\t            also save the number of steps of each pixel in FILE, in binary (16 bits per pixel if nStepMax fits)." << std::endl;
+    std::cout << "\t            with mixed precision FILE also marks the pixels recomputed in double." << std::endl;
+    std::cout << "\t            the image can be rendered again from FILE by fractalRender." << std::endl;
+    std::cout << "\t--data-encoding NAME:" << std::endl;
+    std::cout << "\t            encoding of the data file. One of [dense, rle]. Defaults to dense." << std::endl;
+    std::cout << "\t            rle encodes the long runs of pixels which never flip, but the file cannot be read in place." << std::endl;
+    std::cout << "\t--checkpoint FILE:" << std::endl;
+    std::cout << "\t            store each tile in FILE as soon as it is computed, so that an interrupted run can be resumed." << std::endl;
+    std::cout << "\t            the whole image is kept in memory: it cannot be used with --memory-budget." << std::endl;
+    std::cout << "\t--checkpoint-interval SECONDS:" << std::endl;
+    std::cout << "\t            how often the checkpoint file is flushed to disk, at least 1. Defaults to 60." << std::endl;
+    std::cout << "\t--resume:   reopen the checkpoint file of an interrupted run with the same parameters, computing only the missing tiles." << std::endl;
+    std::cout << "\t--cache DIR:" << std::endl;
+    std::cout << "\t            look up the pixels in the cache in DIR before evaluating them, and store them in it afterwards." << std::endl;
+    std::cout << "\t            rendering again, zooming or raising nStepMax then evaluates only the new pixels." << std::endl;
+    std::cout << "\t            ai1Min and ai2Max must be multiples of gridSize." << std::endl;
+    std::cout << "\t--png-level N:" << std::endl;
+    std::cout << "\t            zlib compression level of the image, from 0 (none) to 9 (best). Defaults to 6." << std::endl;
+    std::cout << "\t            the image is compressed in parallel by the threads of the pool." << std::endl;
+    std::cout << "\t--cost-map FILE:" << std::endl;
+    std::cout << "\t            also save the number of steps integrated for each pixel in FILE, in the binary format of the data file." << std::endl;
+    std::cout << "\t            the pixels which were not evaluated (e.g. mirrored or cached) cost 0. It can be rendered by fractalRender." << std::endl;
+    std::cout << "\t--report FILE:" << std::endl;
+    std::cout << "\t            save a report of the run in JSON in FILE: pixel counts, timings of the phases and throughput." << std::endl;
+    std::cout << "\t            a build with `make INSTRUMENT=1` also reports the steps integrated and the busy time of each thread." << std::endl;
+    std::cout << "\t--shard I/N:" << std::endl;
+    std::cout << "\t            compute only the I-th of N parts of the image (I from 0) and save its data in outFile instead of the image." << std::endl;
+    std::cout << "\t            the N parts, computed by separate runs, are merged in the image by fractalMerge." << std::endl;
+    std::cout << "\t--shard-by NAME:" << std::endl;
+    std::cout << "\t            partitioning of the tiles among the shards. One of [rows, tiles]. Defaults to tiles." << std::endl;
+    std::cout << "\t            rows gives each shard a contiguous band of rows, tiles one tile every N." << std::endl;
+    std::cout << "\t--threads N:" << std::endl;
+    std::cout << "\t            number of threads of the pool evaluating the fractal. Defaults to the number of hardware threads." << std::endl << std::endl;
 }
 
 int main(int argc, const char * argv[])
@@ -32,8 +107,26 @@ int main(int argc, const char * argv[])
     double ai1Min, ai1Max, ai2Min, ai2Max;
     double dt, gridSize;
     int nStepMax;
+    DoublePendulum::Integrator integrator;
+    DoublePendulum::MathAccuracy mathAccuracy;
+    Fractal::Precision precision;
+    Fractal::EarlyExit earlyExit;
+    UniformGrid::RenderMode renderMode;
+    double boundaryTolerance;
+    long memoryBudget;
+    std::string dataFileName, checkpointFileName, cacheDirectory, costMapFileName, reportFileName;
+    DataFile::Encoding dataEncoding;
+    bool resume;
+    Shard::Mode shardMode;
+    Shard shard;
+    bool sharded;
+    int checkpointInterval;
+    int compressionLevel;
+    int tileSize;
+    TileScheduler::Order tileOrder;
+    CommandLineOptions options(argc, argv);
 
-    if (argc != 14) {
+    if (options.positionalNum != 14) {
         std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
         printHelpMessage();
         return 1;
@@ -62,24 +155,205 @@ int main(int argc, const char * argv[])
     L1 = std::stof(argv[5]);
     L2 = std::stof(argv[6]);
     // Environment parameters.
-    ai1Min = std::stof(argv[7]);
-    ai1Max = std::stof(argv[8]);
-    ai2Min = std::stof(argv[9]);
-    ai2Max = std::stof(argv[10]);
-    gridSize = std::stof(argv[11]);
+    ai1Min = std::stod(argv[7]);
+    ai1Max = std::stod(argv[8]);
+    ai2Min = std::stod(argv[9]);
+    ai2Max = std::stod(argv[10]);
+    gridSize = std::stod(argv[11]);
     dt = std::stof(argv[12]);
     nStepMax = std::stoi(argv[13]);
+    // Options.
+    if (!DoublePendulum::stringToIntegrator(options.getString("integrator", "rk4"), integrator)) {
+        std::cerr << "Invalid integrator option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!DoublePendulum::stringToMathAccuracy(options.getString("math", "exact"), mathAccuracy)) {
+        std::cerr << "Invalid math option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToPrecision(options.getString("precision", "double"), precision)) {
+        std::cerr << "Invalid precision option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToEarlyExit(options.getString("early-exit", "off"), earlyExit)) {
+        std::cerr << "Invalid early exit option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!UniformGrid::stringToRenderMode(options.getString("render", "full"), renderMode)) {
+        std::cerr << "Invalid render option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    boundaryTolerance = options.getDouble("boundary-tolerance", 0);
+    if (boundaryTolerance < 0) {
+        std::cerr << "Invalid boundary tolerance option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    tileSize = options.getInt("tile-size", 32);
+    if (tileSize < 1 || tileSize > UniformGrid::MAX_TILE_SIZE) {
+        std::cerr << "Invalid tile size option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!TileScheduler::stringToOrder(options.getString("tile-order", "morton"), tileOrder)) {
+        std::cerr << "Invalid tile order option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
 
-    UniformGrid grid(
-        std::make_shared<Fractal> (
-            DoublePendulum::makeDoublePendulum(
-                M1, M2, L1, L2, dt, g, pendulumType
-            )
-        ),
-        nStepMax, ai1Min, ai1Max, ai2Min, ai2Max, gridSize
-    );
+    auto pendulum = DoublePendulum::makeDoublePendulum(M1, M2, L1, L2, dt, g, pendulumType);
+    pendulum->setIntegrator(integrator, options.getDouble("rtol", 1e-8), options.getDouble("atol", 1e-8));
+    pendulum->mathAccuracy = mathAccuracy;
+    auto fractal = std::make_shared<Fractal>(std::move(pendulum));
+    fractal->precision = precision;
+    fractal->fallbackFraction = options.getDouble("fallback-fraction", 0.5);
+    fractal->earlyExit = earlyExit;
+    fractal->recurrenceTolerance = options.getDouble("recurrence-tolerance", 0.001);
+    fractal->measureEnergyDrift = options.has("energy-drift");
 
-    grid.calcData();
-    grid.saveImage(outFileName);
+    memoryBudget = options.getInt("memory-budget", 0);
+    if (memoryBudget < 0) {
+        std::cerr << "Invalid memory budget option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    dataFileName = options.getString("data-file", "");
+    if (!DataFile::stringToEncoding(options.getString("data-encoding", "dense"), dataEncoding)) {
+        std::cerr << "Invalid data encoding option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    compressionLevel = options.getInt("png-level", PngWriter::DEFAULT_LEVEL);
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        std::cerr << "Invalid PNG level option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    checkpointFileName = options.getString("checkpoint", "");
+    resume = options.has("resume");
+    checkpointInterval = options.getInt("checkpoint-interval", 60);
+    if (checkpointInterval < 1) {
+        std::cerr << "Invalid checkpoint interval option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (resume && checkpointFileName.empty()) {
+        std::cerr << "The resume option needs a checkpoint file!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!checkpointFileName.empty() && memoryBudget > 0) {
+        std::cerr << "The checkpoint option cannot be used with a memory budget!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    cacheDirectory = options.getString("cache", "");
+    costMapFileName = options.getString("cost-map", "");
+    reportFileName = options.getString("report", "");
+
+    if (!Shard::stringToMode(options.getString("shard-by", "tiles"), shardMode)) {
+        std::cerr << "Invalid shard partitioning option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    sharded = options.has("shard");
+    if (sharded && !Shard::parse(options.getString("shard", ""), shardMode, shard)) {
+        std::cerr << "Invalid shard option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (sharded && (!checkpointFileName.empty() || !dataFileName.empty() || !costMapFileName.empty())) {
+        std::cerr << "The shard option cannot be used with a checkpoint, data or cost map file!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    ThreadPool::setSharedSize(options.getInt("threads", 0));
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    UniformGrid grid(fractal, nStepMax, ai1Min, ai1Max, ai2Min, ai2Max, gridSize);
+    grid.renderMode = renderMode;
+    grid.boundaryTolerance = boundaryTolerance;
+    grid.tileSize = tileSize;
+    grid.tileOrder = tileOrder;
+
+    grid.checkpointFileName = checkpointFileName;
+    grid.resume = resume;
+    grid.checkpointInterval = checkpointInterval;
+    grid.memoryBudget = memoryBudget << 20;
+    grid.dataEncoding = dataEncoding;
+    grid.compressionLevel = compressionLevel;
+    grid.cacheDirectory = cacheDirectory;
+    grid.costMapFileName = costMapFileName;
+
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+    try {
+        if (sharded) {
+            grid.saveShard(outFileName, shard);
+        } else if (memoryBudget > 0) {
+            grid.streamImage(outFileName, dataFileName);
+        } else {
+            grid.calcData();
+            grid.saveImage(outFileName);
+            if (!dataFileName.empty()) {
+                grid.saveBinaryData(dataFileName);
+            }
+        }
+        if (!reportFileName.empty()) {
+            RunReport report;
+            report.setString("run", "program", "fractalGen");
+            report.setNumber("run", "threads", ThreadPool::shared().getSize());
+            report.setBool("run", "instrumented", Instrumentation::ENABLED);
+            report.setNumber("run", "wallTime", Instrumentation::secondsSince(start));
+            grid.report(report);
+            report.save(reportFileName);
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    if (!cacheDirectory.empty()) {
+        std::cout << "Cache: " << grid.getCacheHits() << " hits, " << grid.getCacheMisses() << " misses" << std::endl;
+    }
+    if (resume) {
+        std::cout << "Resumed " << grid.getResumedTiles() << " tiles from " << checkpointFileName << std::endl;
+    }
+
+    // Report the accuracy achieved by the integrator.
+    Fractal::Statistics stats = fractal->getStatistics();
+    if (stats.energyDriftSamples > 0) {
+        std::cout << "Relative energy drift (" << DoublePendulum::integratorToString(integrator) << "): max "
+                  << stats.energyDriftMax << ", mean " << stats.energyDriftSum / stats.energyDriftSamples << std::endl;
+    }
+    if (fractal->pendulum->isSymplectic()) {
+        std::cout << "Steps not converged (" << DoublePendulum::integratorToString(integrator) << "): "
+                  << stats.unconvergedSteps << ", done with RK4" << std::endl;
+    }
+    if (precision == Fractal::Precision::Mixed) {
+        std::cout << "Double precision fallback: " << stats.fallbacks << " evaluations" << std::endl;
+    }
+    if (earlyExit == Fractal::EarlyExit::Recurrence) {
+        std::cout << "Early exit (recurrence): " << stats.earlyExits << " trajectories, "
+                  << stats.stepsAfterDetection << " steps saved" << std::endl;
+    } else if (earlyExit == Fractal::EarlyExit::Measure) {
+        std::cout << "Early exit (measure, nothing saved): " << stats.earlyExits << " trajectories detected as trapped, "
+                  << stats.earlyExitsFlipped << " of them flipped later; recurrence would save "
+                  << stats.stepsAfterDetection << " steps" << std::endl;
+    }
+    if (renderMode == UniformGrid::RenderMode::Boundary) {
+        std::cout << "Boundary tracing: " << grid.getEvaluatedPixels() << " pixels evaluated, "
+                  << grid.getFilledPixels() << " filled" << std::endl;
+    }
     // grid.saveData(outFileName);
 }
\ No newline at end of file
@@ -1,15 +1,21 @@
 #include <string>
+#include <stdexcept>
 #include <iostream>
 #include <memory>
 #include "DoublePendulum/DoublePendulum.hpp"
 #include "Fractal/Fractal.hpp"
+#include "Fractal/ThreadPool.hpp"
 #include "Fractal/Adaptive/AdaptiveGrid.hpp"
+#include "Fractal/PngWriter.hpp"
+#include "Fractal/RunReport.hpp"
+#include "Fractal/Instrumentation.hpp"
+#include "CommandLineOptions.hpp"
 
 const double g = 9.81;
 
 void printHelpMessage() {
     std::cout << "Usage:" << std::endl << std::endl;
-    std::cout << program_invocation_name << " outFile systemType M1 M2 L1 L2 ai1Central ai2Central dt nStepMax nCycles nCyclesPrint" << std::endl << std::endl;
+    std::cout << program_invocation_name << " outFile systemType M1 M2 L1 L2 ai1Central ai2Central dt nStepMax nCycles [nCyclesPrint] [options]" << std::endl << std::endl;
     std::cout << "\toutFile:       output file name." << std::endl;
     std::cout << "\tsystemType:    type of pendulum. One of [simple, compound]." << std::endl;
     std::cout << "\tM1, M2:        masses of the rods in [kg]." << std::endl;
@@ -21,20 +27,70 @@ void printHelpMessage() {
     std::cout << "\tnStepMax:      maximum number of steps for each simulation." << std::endl;
     std::cout << "\tnCycles:       number of cycles (increasing resolution of a region) to run." << std::endl;
     std::cout << "\tnCyclesPrint:  number of cycles after which a file with the partial data is printed. Defaults to 0 (never)." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--integrator NAME:" << std::endl;
+    std::cout << "\t               integrator used to solve the motion. One of [rk4, dopri54, midpoint, gauss4, verlet]. Defaults to rk4." << std::endl;
+    std::cout << "\t               dopri54 adapts its step size (dt is only the first one) and simulates up to nStepMax * dt [s]." << std::endl;
+    std::cout << "\t               midpoint, gauss4 and verlet are symplectic: the energy error stays bounded also with a large dt." << std::endl;
+    std::cout << "\t--rtol VAL, --atol VAL:" << std::endl;
+    std::cout << "\t               relative and absolute error tolerances of the adaptive integrators. Default to 1e-8." << std::endl;
+    std::cout << "\t--energy-drift:" << std::endl;
+    std::cout << "\t               measure and report the relative energy error at the end of each trajectory." << std::endl;
+    std::cout << "\t--math NAME:" << std::endl;
+    std::cout << "\t               accuracy of the sine and cosine functions. One of [exact, fast]. Defaults to exact." << std::endl;
+    std::cout << "\t               fast uses vectorized polynomials, within 2.5 ulp of the exact results." << std::endl;
+    std::cout << "\t--precision NAME:" << std::endl;
+    std::cout << "\t               floating point precision of the evaluation with rk4. One of [double, mixed]. Defaults to double." << std::endl;
+    std::cout << "\t               mixed integrates in float on twice the lanes, recomputing in double the late flips." << std::endl;
+    std::cout << "\t--fallback-fraction VAL:" << std::endl;
+    std::cout << "\t               with mixed precision, flips after more than VAL * nStepMax steps are recomputed in double," << std::endl;
+    std::cout << "\t               the trajectories not flipping are trusted in float. 1 disables the fallback. Defaults to 0.5." << std::endl;
+    std::cout << "\t--early-exit NAME:" << std::endl;
+    std::cout << "\t               early termination of the trajectories which never flip, with fixed step integrators. One of [off, measure, recurrence]. Defaults to off." << std::endl;
+    std::cout << "\t               recurrence ends the trajectories which return close to a previous state (this may rarely miss a late flip)." << std::endl;
+    std::cout << "\t               measure runs the detector without acting on it: it saves nothing, and reports what recurrence would save." << std::endl;
+    std::cout << "\t--recurrence-tolerance VAL:" << std::endl;
+    std::cout << "\t               distance in [rad] within which a state is considered a return to a previous one. Defaults to 0.001." << std::endl;
+    std::cout << "\t--refine-batch N:" << std::endl;
+    std::cout << "\t               number of regions split at once, evaluating all their new points concurrently. Defaults to 1." << std::endl;
+    std::cout << "\t               a larger batch uses more threads, splitting the regions slightly out of priority order." << std::endl;
+    std::cout << "\t--refine-threshold VAL:" << std::endl;
+    std::cout << "\t               split at once only the regions with at least VAL times the highest priority. Defaults to 0." << std::endl;
+    std::cout << "\t--image-size N:" << std::endl;
+    std::cout << "\t               side of the image in pixels. Defaults to one pixel per smallest region, tripling with each level of refinement," << std::endl;
+    std::cout << "\t               up to 4096 pixels." << std::endl;
+    std::cout << "\t--view-ai1 VAL, --view-ai2 VAL, --view-size VAL:" << std::endl;
+    std::cout << "\t               center and side in [rad] of the square drawn in the image. Default to the whole domain." << std::endl;
+    std::cout << "\t--png-level N:" << std::endl;
+    std::cout << "\t               zlib compression level of the image, from 0 (none) to 9 (best). Defaults to 6." << std::endl;
+    std::cout << "\t--fallback-points FILE:" << std::endl;
+    std::cout << "\t               with mixed precision, also save in FILE the points recomputed in double, one per line." << std::endl;
+    std::cout << "\t--report FILE:" << std::endl;
+    std::cout << "\t               save a report of the run in JSON in FILE: regions, timings of the phases and splits per second." << std::endl;
+    std::cout << "\t               a build with `make INSTRUMENT=1` also reports the steps integrated." << std::endl;
+    std::cout << "\t--threads N:" << std::endl;
+    std::cout << "\t               number of threads of the pool evaluating the fractal. Defaults to the number of hardware threads." << std::endl << std::endl;
 }
 
 int main(int argc, const char * argv[])
 {
-    std::string outFileName, pendulumTypeStr;
+    std::string outFileName, pendulumTypeStr, reportFileName, fallbackPointsFileName;
     DoublePendulum::Variant pendulumType;
     double M1, M2, L1, L2;
     double ai1Central, ai2Central, aiSize;
     double dt;
     int nStepMax, nCycles, nCyclesPrint;
+    int compressionLevel, refineBatch, imageSize;
+    double refineThreshold, viewAi1Central, viewAi2Central, viewSize;
+    DoublePendulum::Integrator integrator;
+    DoublePendulum::MathAccuracy mathAccuracy;
+    Fractal::Precision precision;
+    Fractal::EarlyExit earlyExit;
+    CommandLineOptions options(argc, argv);
 
     // PARAMETERS.
 
-    if (argc != 14 && argc != 13) {
+    if (options.positionalNum != 14 && options.positionalNum != 13) {
         std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
         printHelpMessage();
         return 1;
@@ -71,35 +127,159 @@ int main(int argc, const char * argv[])
     nStepMax = std::stoi(argv[11]);
     nCycles = std::stoi(argv[12]);
     // Optional last argument.
-    if (argc == 14) {
+    if (options.positionalNum == 14) {
         nCyclesPrint = std::stoi(argv[13]);
     } else {
         nCyclesPrint = 0;
     }
 
-    AdaptiveGrid grid(
-        std::make_unique<Fractal> (
-            DoublePendulum::makeDoublePendulum(M1, M2, L1, L2, dt, g, pendulumType)
-        ),
-        nStepMax, ai1Central, ai2Central, aiSize
-    );
-
-    if (nCyclesPrint > 0) {
-        int cycles = 0;
-        // Perform the calculations in batches of nCyclesPrint each...
-        while (nCycles - cycles > nCyclesPrint) {
-            grid.cycle(nCyclesPrint);
-            cycles += nCyclesPrint;
-            // ... print the intermediate restults...
+    // Options.
+    if (!DoublePendulum::stringToIntegrator(options.getString("integrator", "rk4"), integrator)) {
+        std::cerr << "Invalid integrator option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!DoublePendulum::stringToMathAccuracy(options.getString("math", "exact"), mathAccuracy)) {
+        std::cerr << "Invalid math option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToPrecision(options.getString("precision", "double"), precision)) {
+        std::cerr << "Invalid precision option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToEarlyExit(options.getString("early-exit", "off"), earlyExit)) {
+        std::cerr << "Invalid early exit option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    auto pendulum = DoublePendulum::makeDoublePendulum(M1, M2, L1, L2, dt, g, pendulumType);
+    pendulum->setIntegrator(integrator, options.getDouble("rtol", 1e-8), options.getDouble("atol", 1e-8));
+    pendulum->mathAccuracy = mathAccuracy;
+    auto fractal = std::make_shared<Fractal>(std::move(pendulum));
+    fractal->precision = precision;
+    fractal->fallbackFraction = options.getDouble("fallback-fraction", 0.5);
+    fractal->earlyExit = earlyExit;
+    fractal->recurrenceTolerance = options.getDouble("recurrence-tolerance", 0.001);
+    fractal->measureEnergyDrift = options.has("energy-drift");
+
+    compressionLevel = options.getInt("png-level", PngWriter::DEFAULT_LEVEL);
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        std::cerr << "Invalid PNG level option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    refineBatch = options.getInt("refine-batch", 1);
+    if (refineBatch < 1) {
+        std::cerr << "Invalid refine batch option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    refineThreshold = options.getDouble("refine-threshold", 0);
+    if (refineThreshold < 0 || refineThreshold > 1) {
+        std::cerr << "Invalid refine threshold option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    imageSize = options.getInt("image-size", 0);
+    if (imageSize < 0) {
+        std::cerr << "Invalid image size option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    viewAi1Central = options.getDouble("view-ai1", ai1Central);
+    viewAi2Central = options.getDouble("view-ai2", ai2Central);
+    viewSize = options.getDouble("view-size", aiSize);
+    if (viewSize <= 0) {
+        std::cerr << "Invalid view size option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    reportFileName = options.getString("report", "");
+    fallbackPointsFileName = options.getString("fallback-points", "");
+    if (!fallbackPointsFileName.empty() && precision != Fractal::Precision::Mixed) {
+        std::cerr << "The fallback points option needs mixed precision!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    ThreadPool::setSharedSize(options.getInt("threads", 0));
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    AdaptiveGrid grid(fractal, nStepMax, ai1Central, ai2Central, aiSize);
+    grid.compressionLevel = compressionLevel;
+    grid.refineBatch = refineBatch;
+    grid.refineThreshold = refineThreshold;
+    grid.imageSize = imageSize;
+    grid.viewAi1Central = viewAi1Central;
+    grid.viewAi2Central = viewAi2Central;
+    grid.viewSize = viewSize;
+
+    Instrumentation::Clock::time_point start = Instrumentation::Clock::now();
+    try {
+        if (nCyclesPrint > 0) {
+            int cycles = 0;
+            // Perform the calculations in batches of nCyclesPrint each...
+            while (nCycles - cycles > nCyclesPrint) {
+                grid.cycle(nCyclesPrint);
+                cycles += nCyclesPrint;
+                // ... print the intermediate restults...
+                grid.saveImage(outFileName);
+            }
+            // ... perform the last calculations and print the final results.
+            grid.cycle(nCycles - cycles);
+            grid.saveImage(outFileName);
+        } else {
+            // Perform all the calculations...
+            grid.cycle(nCycles);
+            // ... then print the final result.
             grid.saveImage(outFileName);
         }
-        // ... perform the last calculations and print the final results.
-        grid.cycle(nCycles - cycles);
-        grid.saveImage(outFileName);
-    } else {
-        // Perform all the calculations...
-        grid.cycle(nCycles);
-        // ... then print the final result.
-        grid.saveImage(outFileName);
+        if (!fallbackPointsFileName.empty()) {
+            grid.saveFallbackPoints(fallbackPointsFileName);
+        }
+        if (!reportFileName.empty()) {
+            RunReport report;
+            report.setString("run", "program", "fractalGenAdaptive");
+            report.setNumber("run", "threads", ThreadPool::shared().getSize());
+            report.setBool("run", "instrumented", Instrumentation::ENABLED);
+            report.setNumber("run", "wallTime", Instrumentation::secondsSince(start));
+            grid.report(report);
+            report.save(reportFileName);
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    // Report the accuracy achieved by the integrator.
+    Fractal::Statistics stats = fractal->getStatistics();
+    if (stats.energyDriftSamples > 0) {
+        std::cout << "Relative energy drift (" << DoublePendulum::integratorToString(integrator) << "): max "
+                  << stats.energyDriftMax << ", mean " << stats.energyDriftSum / stats.energyDriftSamples << std::endl;
+    }
+    if (fractal->pendulum->isSymplectic()) {
+        std::cout << "Steps not converged (" << DoublePendulum::integratorToString(integrator) << "): "
+                  << stats.unconvergedSteps << ", done with RK4" << std::endl;
+    }
+    if (precision == Fractal::Precision::Mixed) {
+        std::cout << "Double precision fallback: " << stats.fallbacks << " evaluations" << std::endl;
+    }
+    if (earlyExit == Fractal::EarlyExit::Recurrence) {
+        std::cout << "Early exit (recurrence): " << stats.earlyExits << " trajectories, "
+                  << stats.stepsAfterDetection << " steps saved" << std::endl;
+    } else if (earlyExit == Fractal::EarlyExit::Measure) {
+        std::cout << "Early exit (measure, nothing saved): " << stats.earlyExits << " trajectories detected as trapped, "
+                  << stats.earlyExitsFlipped << " of them flipped later; recurrence would save "
+                  << stats.stepsAfterDetection << " steps" << std::endl;
     }
 }
\ No newline at end of file
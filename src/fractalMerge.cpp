@@ -0,0 +1,212 @@
+/*
+ * Stitch the shards of a UniformGrid render, computed by separate runs of
+ * fractalGen with the --shard option, and save the image of the fractal
+ * without computing anything.
+ *
+ * The shard files are read sequentially, a row of tiles at a time, so the
+ * memory used does not depend on the size of the image.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include "Fractal/Fractal.hpp"
+#include "Fractal/ColorScale.hpp"
+#include "Fractal/ColorTable.hpp"
+#include "Fractal/PngWriter.hpp"
+#include "Fractal/Shard.hpp"
+#include "Fractal/StepsBuffer.hpp"
+#include "Fractal/DataFile.hpp"
+#include "CommandLineOptions.hpp"
+
+void printHelpMessage() {
+    std::cout << "Usage:" << std::endl << std::endl;
+    std::cout << program_invocation_name << " outFile shardFile [shardFile ...] [options]" << std::endl << std::endl;
+    std::cout << "\toutFile:    output image file name." << std::endl;
+    std::cout << "\tshardFile:  data file of a shard, saved by fractalGen with the --shard option. All the shards are needed." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--data-file FILE:" << std::endl;
+    std::cout << "\t            also save the number of steps of each pixel in FILE, as fractalGen does (with the fallback flags of mixed precision)." << std::endl;
+    std::cout << "\t--data-encoding NAME:" << std::endl;
+    std::cout << "\t            encoding of the data file. One of [dense, rle]. Defaults to dense." << std::endl;
+    std::cout << "\t--png-level N:" << std::endl;
+    std::cout << "\t            zlib compression level of the image, from 0 (none) to 9 (best). Defaults to 6." << std::endl << std::endl;
+}
+
+// A shard data file, positioned at the beginning of the data.
+struct ShardFile {
+    std::string fileName;
+    std::ifstream stream;
+    // Header lines, except the shard one which differs among the shards.
+    std::vector<std::string> header;
+    std::map<std::string, std::string> values;
+    Shard shard;
+};
+
+// Read the header lines up to the dataType one, after which the data begin.
+bool readHeader(ShardFile &file) {
+    std::string line;
+    std::size_t equal;
+
+    while (std::getline(file.stream, line)) {
+        equal = line.find('=');
+        if (line.empty() || line[0] != '#' || equal == std::string::npos) {
+            return false;
+        }
+        file.values[line.substr(1, equal - 1)] = line.substr(equal + 1);
+        if (line.rfind("#shard=", 0) != 0) {
+            file.header.push_back(line);
+        }
+        if (line.rfind("#dataType=", 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, const char * argv[])
+{
+    std::string outFileName, dataFileName, parameters;
+    DataFile::Encoding dataEncoding;
+    std::vector<std::unique_ptr<ShardFile>> files;
+    std::vector<ShardFile *> byIndex;
+    Shard::Mode mode;
+    int imgSizeX, imgSizeY, tileSize, tilesX, tilesY, rows, width, compressionLevel;
+    bool compact, mixed;
+    CommandLineOptions options(argc, argv);
+
+    if (options.positionalNum < 3) {
+        std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    outFileName = std::string(argv[1]);
+    dataFileName = options.getString("data-file", "");
+    if (!DataFile::stringToEncoding(options.getString("data-encoding", "dense"), dataEncoding)) {
+        std::cerr << "Invalid data encoding option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    compressionLevel = options.getInt("png-level", PngWriter::DEFAULT_LEVEL);
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        std::cerr << "Invalid PNG level option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    // Read and validate the headers of the shards.
+    for (int i = 2; i < options.positionalNum; i++) {
+        auto file = std::make_unique<ShardFile>();
+        file->fileName = argv[i];
+        file->stream.open(file->fileName, std::ios::binary);
+        if (!file->stream || !readHeader(*file) || file->values.count("shard") == 0
+            || !Shard::stringToMode(file->values["shardBy"], mode)
+            || !Shard::parse(file->values["shard"], mode, file->shard)) {
+            std::cerr << file->fileName << " is not a shard data file!" << std::endl;
+            return 1;
+        }
+        if (!files.empty() && file->header != files[0]->header) {
+            std::cerr << file->fileName << " is a shard of a different render than " << files[0]->fileName << "!" << std::endl;
+            return 1;
+        }
+        files.push_back(std::move(file));
+    }
+    byIndex.resize(files[0]->shard.num, nullptr);
+    for (auto &file: files) {
+        if (file->shard.num != (int) files.size() || byIndex[file->shard.index] != nullptr) {
+            std::cerr << "Expected each of the " << file->shard.num << " shards exactly once!" << std::endl;
+            return 1;
+        }
+        byIndex[file->shard.index] = file.get();
+    }
+
+    std::map<std::string, std::string> &values = files[0]->values;
+    imgSizeX = std::stoi(values["imgSizeX"]);
+    imgSizeY = std::stoi(values["imgSizeY"]);
+    tileSize = std::stoi(values["tileSize"]);
+    compact = values["dataType"] == "uint16";
+    // With mixed precision the steps of each tile are followed by its fallback flags.
+    mixed = values["precision"] == Fractal::precisionToString(Fractal::Precision::Mixed);
+    tilesX = (imgSizeX + tileSize - 1) / tileSize;
+    tilesY = (imgSizeY + tileSize - 1) / tileSize;
+
+    // Same scale as UniformGrid.
+    float baseSteps = sqrt(std::stod(values["L1"]) / std::stod(values["g"])) / std::stod(values["dt"]);
+    ColorTable colorTable(ColorScale(), baseSteps, std::stoi(values["nStepMax"]));
+
+    try {
+        PngWriter image(outFileName, imgSizeX, imgSizeY, compressionLevel);
+        std::vector<png::rgb_pixel> pixels;
+        std::unique_ptr<DataFileWriter> dataFile;
+        if (!dataFileName.empty()) {
+            // Same parameters as a data file saved by fractalGen.
+            for (auto &line: files[0]->header) {
+                if (line.rfind("#tileSize=", 0) != 0 && line.rfind("#shardBy=", 0) != 0 && line.rfind("#dataType=", 0) != 0) {
+                    parameters += line + "\n";
+                }
+            }
+            dataFile = std::make_unique<DataFileWriter>(dataFileName, parameters, imgSizeX, imgSizeY, compact, dataEncoding, mixed);
+        }
+
+        // Stitch a row of tiles at a time: each shard stores its tiles in row-major order.
+        StepsBuffer data;
+        std::vector<char> band, fallback;
+        for (int ty = 0; ty < tilesY; ty++) {
+            rows = std::min(tileSize, imgSizeY - ty * tileSize);
+            data.assign((std::size_t) imgSizeX * rows, compact, Fractal::STEPS_OUT_OF_SCALE);
+            band.resize((std::size_t) imgSizeX * rows * data.bytesPerPixel());
+            fallback.assign(mixed ? (std::size_t) imgSizeX * rows : 0, false);
+            for (int tx = 0; tx < tilesX; tx++) {
+                width = std::min((tx + 1) * tileSize, imgSizeX) - tx * tileSize;
+                for (auto file: byIndex) {
+                    if (!file->shard.ownsTile(tx, ty, tilesX, tilesY)) {
+                        continue;
+                    }
+                    for (int y = 0; y < rows; y++) {
+                        file->stream.read(band.data() + ((std::size_t) y * imgSizeX + tx * tileSize) * data.bytesPerPixel(),
+                                          width * data.bytesPerPixel());
+                    }
+                    for (int y = 0; mixed && y < rows; y++) {
+                        file->stream.read(fallback.data() + (std::size_t) y * imgSizeX + tx * tileSize, width);
+                    }
+                    if (!file->stream) {
+                        std::cerr << file->fileName << " is truncated!" << std::endl;
+                        return 1;
+                    }
+                }
+            }
+            data.copyFrom(band.data(), 0, data.size());
+
+            pixels.resize(data.size());
+            colorTable.colorPixels(data.size(), [&data](std::size_t i) { return data.get(i); }, pixels.data());
+            image.writeRows(pixels.data(), rows);
+            if (dataFile) {
+                dataFile->write(data, 0, data.size(), fallback.data());
+            }
+        }
+
+        if (dataFile) {
+            dataFile->close();
+        }
+
+        for (auto &file: files) {
+            if (file->stream.peek() != EOF) {
+                std::cerr << file->fileName << " has more data than expected!" << std::endl;
+                return 1;
+            }
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
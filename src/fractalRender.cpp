@@ -0,0 +1,110 @@
+/*
+ * Render again the image of a fractal from the binary data file saved by
+ * fractalGen (or fractalMerge), e.g. with a different color scale, without
+ * computing anything.
+ */
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+#include "Fractal/Fractal.hpp"
+#include "Fractal/ColorScale.hpp"
+#include "Fractal/ColorTable.hpp"
+#include "Fractal/PngWriter.hpp"
+#include "Fractal/DataFile.hpp"
+#include "CommandLineOptions.hpp"
+
+// Pixels colored and written at a time.
+const int BAND_PIXELS = 1 << 22;
+
+void printHelpMessage() {
+    std::cout << "Usage:" << std::endl << std::endl;
+    std::cout << program_invocation_name << " dataFile outFile [options]" << std::endl << std::endl;
+    std::cout << "\tdataFile:   binary data file saved by fractalGen or fractalMerge with the --data-file option." << std::endl;
+    std::cout << "\toutFile:    output image file name." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--colors LIST:" << std::endl;
+    std::cout << "\t            comma separated hex codes (6 digits, with or without #) of the start and end colors of each leg of the logarithmic scale," << std::endl;
+    std::cout << "\t            followed by the color of the pixels which never flip. Defaults to the scale of fractalGen." << std::endl;
+    std::cout << "\t--shades N: number of shades of each leg of the scale. Defaults to 100." << std::endl;
+    std::cout << "\t--png-level N:" << std::endl;
+    std::cout << "\t            zlib compression level of the image, from 0 (none) to 9 (best). Defaults to 6." << std::endl << std::endl;
+}
+
+int main(int argc, const char * argv[])
+{
+    std::string dataFileName, outFileName, color;
+    std::vector<std::string> colors;
+    int shadesNum, compressionLevel, bandRows;
+    double L1, g, dt;
+    CommandLineOptions options(argc, argv);
+
+    if (options.positionalNum != 3) {
+        std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    dataFileName = std::string(argv[1]);
+    outFileName = std::string(argv[2]);
+    std::istringstream colorList(options.getString("colors", ""));
+    while (std::getline(colorList, color, ',')) {
+        colors.push_back(color);
+    }
+    // Pairs of colors for each leg, plus the out of scale one.
+    if (options.has("colors") && (colors.size() < 3 || colors.size() % 2 != 1
+                                  || !std::all_of(colors.begin(), colors.end(), ColorScale::isHexCode))) {
+        std::cerr << "Invalid colors option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    shadesNum = options.getInt("shades", 100);
+    if (shadesNum < 2) {
+        std::cerr << "Invalid shades option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    compressionLevel = options.getInt("png-level", PngWriter::DEFAULT_LEVEL);
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        std::cerr << "Invalid PNG level option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    try {
+        DataFileReader data(dataFileName);
+        ColorScale colorScale(colors.empty() ? ColorScale::defaultColorHexCodes() : colors, shadesNum);
+
+        // Same scale as UniformGrid.
+        L1 = std::stod(data.getParameter("L1"));
+        g = std::stod(data.getParameter("g"));
+        dt = std::stod(data.getParameter("dt"));
+        float baseSteps = sqrt(L1 / g) / dt;
+
+        ColorTable colorTable(colorScale, baseSteps, std::stoi(data.getParameter("nStepMax")));
+
+        // The image is colored and written in bands of about BAND_PIXELS pixels.
+        int imgSizeX = data.getImgSizeX(), imgSizeY = data.getImgSizeY();
+        bandRows = std::max(1, BAND_PIXELS / std::max(imgSizeX, 1));
+        PngWriter image(outFileName, imgSizeX, imgSizeY, compressionLevel);
+        std::vector<png::rgb_pixel> pixels;
+        for (int y0 = 0; y0 < imgSizeY; y0 += bandRows) {
+            int rows = std::min(bandRows, imgSizeY - y0);
+            pixels.resize((std::size_t) imgSizeX * rows);
+            std::size_t first = (std::size_t) y0 * imgSizeX;
+            colorTable.colorPixels(pixels.size(), [&](std::size_t i) { return data.getSteps(first + i); }, pixels.data());
+            image.writeRows(pixels.data(), rows);
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,335 @@
+/*
+ * Render a sequence of frames of the fractal, e.g. for a video, sweeping the
+ * parameters of the pendulum and/or the domain from a start to an end value.
+ *
+ * All the frames run in the same process on the same pool: up to
+ * framesInFlight frames are rendered at once, so that the tiles of the next
+ * frame keep the threads busy while the last tiles of a frame are evaluated
+ * and its image is colored and compressed.
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <iostream>
+#include <memory>
+#include <future>
+#include <cmath>
+#include "DoublePendulum/DoublePendulum.hpp"
+#include "Fractal/Fractal.hpp"
+#include "Fractal/ThreadPool.hpp"
+#include "Fractal/UniformGrid.hpp"
+#include "Fractal/PngWriter.hpp"
+#include "CommandLineOptions.hpp"
+
+const double g = 9.81;
+
+// The swept parameters of a frame.
+struct Frame {
+    double M1, M2, L1, L2;
+    double ai1Min, ai1Max, ai2Min, ai2Max, gridSize;
+};
+
+void printHelpMessage() {
+    std::cout << "Usage:" << std::endl << std::endl;
+    std::cout << program_invocation_name << " outPrefix pendulumType M1 M2 L1 L2 ai1Min aiMax ai2Min ai2Max gridSize dt nStepMax framesNum [options]" << std::endl << std::endl;
+    std::cout << "\toutPrefix:  prefix of the output files: frame k is saved in outPrefix followed by k (4 digits at least)," << std::endl;
+    std::cout << "\t            the image with the .png extension and the binary data (see fractalGen --data-file) with the .dat one." << std::endl;
+    std::cout << "\tpendulumType:" << std::endl;
+    std::cout << "              type of pendulum. One of [simple, compound]." << std::endl;
+    std::cout << "\tM1, M2:     masses of the rods in [kg] of the first frame." << std::endl;
+    std::cout << "\tL1, L2:     lengths of the rods in [m] of the first frame." << std::endl;
+    std::cout << "\tai1Min, ai1Max, ai2Min, ai2Max:" << std::endl;
+    std::cout << "\t            ranges for the starting angles of the rods in [rad] of the first frame, which sets the image size." << std::endl;
+    std::cout << "\tgridSize:   increment of the starting angles in [rad] of the first frame." << std::endl;
+    std::cout << "\tdt:         time step of the simulation in [s]." << std::endl;
+    std::cout << "\tnStepMax:   maximum number of steps of the simulation." << std::endl;
+    std::cout << "\tframesNum:  number of frames, the first with the start parameters and the last with the end ones." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--to-m1 VAL, --to-m2 VAL, --to-l1 VAL, --to-l2 VAL:" << std::endl;
+    std::cout << "\t            masses and lengths of the last frame, swept linearly. Default to the ones of the first frame." << std::endl;
+    std::cout << "\t--to-domain ai1Min,ai1Max,ai2Min,ai2Max:" << std::endl;
+    std::cout << "\t            domain of the last frame. Defaults to the one of the first frame." << std::endl;
+    std::cout << "\t            a domain of a different width is a zoom: the width changes by the same factor at each frame," << std::endl;
+    std::cout << "\t            around the point which stays still. The height follows from the image size." << std::endl;
+    std::cout << "\t--frames-in-flight N:" << std::endl;
+    std::cout << "\t            number of frames rendered at the same time, each holding its data in memory. Defaults to 2." << std::endl;
+    std::cout << "\t--integrator NAME:" << std::endl;
+    std::cout << "\t            integrator used to solve the motion. One of [rk4, dopri54, midpoint, gauss4, verlet]. Defaults to rk4." << std::endl;
+    std::cout << "\t--rtol VAL, --atol VAL:" << std::endl;
+    std::cout << "\t            relative and absolute error tolerances of the adaptive integrators. Default to 1e-8." << std::endl;
+    std::cout << "\t--math NAME:" << std::endl;
+    std::cout << "\t            accuracy of the sine and cosine functions. One of [exact, fast]. Defaults to exact." << std::endl;
+    std::cout << "\t--precision NAME:" << std::endl;
+    std::cout << "\t            floating point precision of the evaluation with rk4. One of [double, mixed]. Defaults to double." << std::endl;
+    std::cout << "\t--fallback-fraction VAL:" << std::endl;
+    std::cout << "\t            with mixed precision, flips after more than VAL * nStepMax steps are recomputed in double," << std::endl;
+    std::cout << "\t            the trajectories not flipping are trusted in float. 1 disables the fallback. Defaults to 0.5." << std::endl;
+    std::cout << "\t--early-exit NAME:" << std::endl;
+    std::cout << "\t            early termination of the trajectories which never flip, with fixed step integrators. One of [off, measure, recurrence]. Defaults to off." << std::endl;
+    std::cout << "\t--recurrence-tolerance VAL:" << std::endl;
+    std::cout << "\t            distance in [rad] within which a state is considered a return to a previous one. Defaults to 0.001." << std::endl;
+    std::cout << "\t--render NAME:" << std::endl;
+    std::cout << "\t            rendering mode. One of [full, boundary]. Defaults to full." << std::endl;
+    std::cout << "\t--boundary-tolerance VAL:" << std::endl;
+    std::cout << "\t            with boundary rendering, relative spread of the steps within which a border is considered uniform. Defaults to 0." << std::endl;
+    std::cout << "\t--tile-size N:" << std::endl;
+    std::cout << "\t            side in [pixels] of the square tiles distributed among the threads, at most 4096. Defaults to 32." << std::endl;
+    std::cout << "\t--tile-order NAME:" << std::endl;
+    std::cout << "\t            order in which the tiles are evaluated. One of [row-major, morton]. Defaults to morton." << std::endl;
+    std::cout << "\t--data-encoding NAME:" << std::endl;
+    std::cout << "\t            encoding of the data files. One of [dense, rle]. Defaults to dense." << std::endl;
+    std::cout << "\t--png-level N:" << std::endl;
+    std::cout << "\t            zlib compression level of the images, from 0 (none) to 9 (best). Defaults to 6." << std::endl;
+    std::cout << "\t--threads N:" << std::endl;
+    std::cout << "\t            number of threads of the pool shared by all the frames. Defaults to the number of hardware threads." << std::endl << std::endl;
+}
+
+/*
+ * The parameters of the frame at t in [0, 1] of the sweep from start to end.
+ *
+ * The masses and lengths are interpolated linearly. The domain keeps the
+ * image size of the first frame: its top left corner (which, with the grid
+ * size, sets the initial conditions of the pixels) moves linearly if the
+ * width does not change, otherwise the width changes geometrically and the
+ * corner moves towards the fixed point of the zoom.
+ */
+Frame interpolateFrame(const Frame &start, const Frame &end, int imgSizeX, int imgSizeY, double t) {
+    Frame frame;
+    double startWidth, endWidth, scale, fixed1, fixed2;
+
+    frame.M1 = start.M1 + t * (end.M1 - start.M1);
+    frame.M2 = start.M2 + t * (end.M2 - start.M2);
+    frame.L1 = start.L1 + t * (end.L1 - start.L1);
+    frame.L2 = start.L2 + t * (end.L2 - start.L2);
+
+    startWidth = start.ai1Max - start.ai1Min;
+    endWidth = end.ai1Max - end.ai1Min;
+    if (std::abs(endWidth - startWidth) <= 1e-12 * startWidth) {
+        scale = 1;
+        frame.ai1Min = start.ai1Min + t * (end.ai1Min - start.ai1Min);
+        frame.ai2Max = start.ai2Max + t * (end.ai2Max - start.ai2Max);
+    } else {
+        scale = pow(endWidth / startWidth, t);
+        fixed1 = (end.ai1Min * startWidth - start.ai1Min * endWidth) / (startWidth - endWidth);
+        fixed2 = (end.ai2Max * startWidth - start.ai2Max * endWidth) / (startWidth - endWidth);
+        frame.ai1Min = fixed1 + (start.ai1Min - fixed1) * scale;
+        frame.ai2Max = fixed2 + (start.ai2Max - fixed2) * scale;
+    }
+    frame.gridSize = start.gridSize * scale;
+    // Half a pixel short of the image size, which UniformGrid rounds up.
+    frame.ai1Max = frame.ai1Min + (imgSizeX - 0.5) * frame.gridSize;
+    frame.ai2Min = frame.ai2Max - (imgSizeY - 0.5) * frame.gridSize;
+    return frame;
+}
+
+int main(int argc, const char * argv[])
+{
+    std::string outPrefix, pendulumTypeStr, domain, value;
+    std::vector<double> endDomain;
+    DoublePendulum::Variant pendulumType;
+    DoublePendulum::Integrator integrator;
+    DoublePendulum::MathAccuracy mathAccuracy;
+    Fractal::Precision precision;
+    Fractal::EarlyExit earlyExit;
+    UniformGrid::RenderMode renderMode;
+    DataFile::Encoding dataEncoding;
+    Frame start, end;
+    double dt, boundaryTolerance;
+    int nStepMax, framesNum, framesInFlight, imgSizeX, imgSizeY, digits, compressionLevel, tileSize;
+    TileScheduler::Order tileOrder;
+    CommandLineOptions options(argc, argv);
+
+    if (options.positionalNum != 15) {
+        std::cerr << "Wrong number of arguments!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    outPrefix = std::string(argv[1]);
+    pendulumTypeStr = std::string(argv[2]);
+    if (pendulumTypeStr == "simple") {
+        pendulumType = DoublePendulum::Variant::Simple;
+    } else if (pendulumTypeStr == "compound") {
+        pendulumType = DoublePendulum::Variant::Compound;
+    } else {
+        std::cerr << "Invalid type parameter!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    start.M1 = std::stof(argv[3]);
+    start.M2 = std::stof(argv[4]);
+    start.L1 = std::stof(argv[5]);
+    start.L2 = std::stof(argv[6]);
+    start.ai1Min = std::stod(argv[7]);
+    start.ai1Max = std::stod(argv[8]);
+    start.ai2Min = std::stod(argv[9]);
+    start.ai2Max = std::stod(argv[10]);
+    start.gridSize = std::stod(argv[11]);
+    dt = std::stof(argv[12]);
+    nStepMax = std::stoi(argv[13]);
+    framesNum = std::stoi(argv[14]);
+    if (framesNum < 1) {
+        std::cerr << "Invalid number of frames!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (start.ai1Max <= start.ai1Min || start.ai2Max <= start.ai2Min || start.gridSize <= 0) {
+        std::cerr << "Invalid domain!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    // Options: the end of the sweep...
+    end = start;
+    end.M1 = options.getDouble("to-m1", start.M1);
+    end.M2 = options.getDouble("to-m2", start.M2);
+    end.L1 = options.getDouble("to-l1", start.L1);
+    end.L2 = options.getDouble("to-l2", start.L2);
+    std::istringstream domainList(options.getString("to-domain", ""));
+    while (std::getline(domainList, value, ',')) {
+        endDomain.push_back(std::stod(value));
+    }
+    if (options.has("to-domain")) {
+        if (endDomain.size() != 4 || endDomain[1] <= endDomain[0] || endDomain[3] <= endDomain[2]) {
+            std::cerr << "Invalid to domain option!" << std::endl << std::endl;
+            printHelpMessage();
+            return 1;
+        }
+        end.ai1Min = endDomain[0];
+        end.ai1Max = endDomain[1];
+        end.ai2Min = endDomain[2];
+        end.ai2Max = endDomain[3];
+    }
+    framesInFlight = options.getInt("frames-in-flight", 2);
+    if (framesInFlight < 1) {
+        std::cerr << "Invalid frames in flight option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    // ... and the evaluation of each frame, as in fractalGen.
+    if (!DoublePendulum::stringToIntegrator(options.getString("integrator", "rk4"), integrator)) {
+        std::cerr << "Invalid integrator option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!DoublePendulum::stringToMathAccuracy(options.getString("math", "exact"), mathAccuracy)) {
+        std::cerr << "Invalid math option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToPrecision(options.getString("precision", "double"), precision)) {
+        std::cerr << "Invalid precision option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!Fractal::stringToEarlyExit(options.getString("early-exit", "off"), earlyExit)) {
+        std::cerr << "Invalid early exit option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!UniformGrid::stringToRenderMode(options.getString("render", "full"), renderMode)) {
+        std::cerr << "Invalid render option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    boundaryTolerance = options.getDouble("boundary-tolerance", 0);
+    if (boundaryTolerance < 0) {
+        std::cerr << "Invalid boundary tolerance option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    tileSize = options.getInt("tile-size", 32);
+    if (tileSize < 1 || tileSize > UniformGrid::MAX_TILE_SIZE) {
+        std::cerr << "Invalid tile size option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!TileScheduler::stringToOrder(options.getString("tile-order", "morton"), tileOrder)) {
+        std::cerr << "Invalid tile order option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!DataFile::stringToEncoding(options.getString("data-encoding", "dense"), dataEncoding)) {
+        std::cerr << "Invalid data encoding option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    compressionLevel = options.getInt("png-level", PngWriter::DEFAULT_LEVEL);
+    if (compressionLevel < 0 || compressionLevel > PngWriter::MAX_LEVEL) {
+        std::cerr << "Invalid PNG level option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    double rtol = options.getDouble("rtol", 1e-8);
+    double atol = options.getDouble("atol", 1e-8);
+    double fallbackFraction = options.getDouble("fallback-fraction", 0.5);
+    double recurrenceTolerance = options.getDouble("recurrence-tolerance", 0.001);
+
+    ThreadPool::setSharedSize(options.getInt("threads", 0));
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+
+    // Same image size as UniformGrid for the first frame.
+    imgSizeX = (int) ceil((start.ai1Max - start.ai1Min) / start.gridSize);
+    imgSizeY = (int) ceil((start.ai2Max - start.ai2Min) / start.gridSize);
+    digits = std::max(4, (int) std::to_string(framesNum - 1).size());
+
+    // Render frame k in the calling thread, submitting its work to the shared pool.
+    auto renderFrame = [&](int k) {
+        Frame frame = interpolateFrame(start, end, imgSizeX, imgSizeY, framesNum > 1 ? (double) k / (framesNum - 1) : 0);
+        std::ostringstream fileName;
+
+        auto pendulum = DoublePendulum::makeDoublePendulum(frame.M1, frame.M2, frame.L1, frame.L2, dt, g, pendulumType);
+        pendulum->setIntegrator(integrator, rtol, atol);
+        pendulum->mathAccuracy = mathAccuracy;
+        auto fractal = std::make_shared<Fractal>(std::move(pendulum));
+        fractal->precision = precision;
+        fractal->fallbackFraction = fallbackFraction;
+        fractal->earlyExit = earlyExit;
+        fractal->recurrenceTolerance = recurrenceTolerance;
+
+        UniformGrid grid(fractal, nStepMax, frame.ai1Min, frame.ai1Max, frame.ai2Min, frame.ai2Max, frame.gridSize);
+        grid.renderMode = renderMode;
+        grid.boundaryTolerance = boundaryTolerance;
+        grid.tileSize = tileSize;
+        grid.tileOrder = tileOrder;
+        grid.dataEncoding = dataEncoding;
+        grid.compressionLevel = compressionLevel;
+
+        fileName << outPrefix << std::setw(digits) << std::setfill('0') << k;
+        grid.calcData();
+        grid.saveImage(fileName.str() + ".png");
+        grid.saveBinaryData(fileName.str() + ".dat");
+        return fileName.str();
+    };
+
+    /*
+     * Each frame is driven by its own thread (not a task of the pool, since
+     * it waits for the tasks of the frame): the tasks of the frames in
+     * flight are queued on the pool one frame after the other.
+     */
+    std::deque<std::future<std::string>> frames;
+    try {
+        for (int k = 0; k < framesNum || !frames.empty(); k++) {
+            if (k < framesNum) {
+                frames.push_back(std::async(std::launch::async, renderFrame, k));
+            }
+            if ((int) frames.size() >= framesInFlight || k >= framesNum - 1) {
+                std::string fileName = frames.front().get();
+                frames.pop_front();
+                std::cout << "Saved frame " << fileName << std::endl;
+            }
+        }
+    } catch (const std::runtime_error &error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+}
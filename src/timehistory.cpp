@@ -5,6 +5,9 @@
  * algorithm and the coordinates of the notable points are saved in a
  * text file which can be later used to generate an animation with
  * other tools. 
+ *
+ * With an adaptive integrator the states are still saved every dt seconds,
+ * interpolating them with the dense output of the integrator.
  */
 
 #define _USE_MATH_DEFINES
@@ -13,15 +16,19 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include "DoublePendulum/DoublePendulum.hpp"
 #include "DoublePendulum/SimpleDoublePendulum.hpp"
 #include "DoublePendulum/CompoundDoublePendulum.hpp"
+#include "DoublePendulum/KernelDispatch.hpp"
+#include "DoublePendulum/DormandPrince54.hpp"
+#include "CommandLineOptions.hpp"
 
 const double g = 9.81;
 
 void printHelpMessage() {
     std::cout << "Usage:" << std::endl << std::endl;
-    std::cout << program_invocation_name << " M1 M2 L1 L2 ai1 ai2 wi1 wi2 type dt nStepMax" << std::endl << std::endl;
+    std::cout << program_invocation_name << " outFile type M1 M2 L1 L2 ai1 ai2 wi1 wi2 dt nStepMax [options]" << std::endl << std::endl;
     std::cout << "\toutFile:    output file name." << std::endl;
     std::cout << "\ttype:       type of pendulum. One of [simple, compound]." << std::endl;
     std::cout << "\tM1, M2:     masses of the rods in [kg]." << std::endl;
@@ -30,6 +37,16 @@ void printHelpMessage() {
     std::cout << "\twi1, wi2:   starting angular velocities of the rods in [rad/s]." << std::endl;
     std::cout << "\tdt:         time step of the simulation in [s]." << std::endl;
     std::cout << "\tnStepMax:   maximum number of steps of the simulation." << std::endl << std::endl;
+    std::cout << "Options:" << std::endl << std::endl;
+    std::cout << "\t--integrator NAME:" << std::endl;
+    std::cout << "\t            integrator used to solve the motion. One of [rk4, dopri54, midpoint, gauss4, verlet]. Defaults to rk4." << std::endl;
+    std::cout << "\t            with dopri54 dt is the sampling interval of the output, not the step size." << std::endl;
+    std::cout << "\t            midpoint, gauss4 and verlet are symplectic: the energy error stays bounded also with a large dt." << std::endl;
+    std::cout << "\t--rtol VAL, --atol VAL:" << std::endl;
+    std::cout << "\t            relative and absolute error tolerances of the adaptive integrators. Default to 1e-8." << std::endl;
+    std::cout << "\t--math NAME:" << std::endl;
+    std::cout << "\t            accuracy of the sine and cosine functions. One of [exact, fast]. Defaults to exact." << std::endl;
+    std::cout << "\t            fast uses vectorized polynomials, within 2.5 ulp of the exact results." << std::endl << std::endl;
 }
 
 int main(int argc, const char * argv[])
@@ -41,8 +58,11 @@ int main(int argc, const char * argv[])
     int nStepMax;
     bool simplePendulum;
     std::unique_ptr<DoublePendulum> pendulum;
+    DoublePendulum::Integrator integrator;
+    DoublePendulum::MathAccuracy mathAccuracy;
+    CommandLineOptions options(argc, argv);
 
-    if (argc != 13) {
+    if (options.positionalNum != 13) {
         std::cout << "Wrong number of arguments!" << std::endl << std::endl;
         printHelpMessage();
         return 1;
@@ -78,6 +98,17 @@ int main(int argc, const char * argv[])
     // Environment parameters.
     dt = std::stof(argv[11]);
     nStepMax = std::stoi(argv[12]);
+    // Options.
+    if (!DoublePendulum::stringToIntegrator(options.getString("integrator", "rk4"), integrator)) {
+        std::cerr << "Invalid integrator option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
+    if (!DoublePendulum::stringToMathAccuracy(options.getString("math", "exact"), mathAccuracy)) {
+        std::cerr << "Invalid math option!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
 
     // Output stream
     std::ofstream outFile(outFileName);
@@ -88,6 +119,14 @@ int main(int argc, const char * argv[])
     } else {
         pendulum = std::make_unique<CompoundDoublePendulum>(M1, M2, L1, L2, dt, g);
     }
+    pendulum->setIntegrator(integrator, options.getDouble("rtol", 1e-8), options.getDouble("atol", 1e-8));
+    pendulum->mathAccuracy = mathAccuracy;
+
+    for (auto &name: options.getUnused()) {
+        std::cerr << "Unknown option --" << name << "!" << std::endl << std::endl;
+        printHelpMessage();
+        return 1;
+    }
 
     StateVector currState, nextState;
 
@@ -97,12 +136,69 @@ int main(int argc, const char * argv[])
     currState.a2 = ai2;
     currState.w2 = wi2;
 
+    // Track the energy error of the integrator along the whole trajectory.
+    double initialEnergy = pendulum->getEnergy(currState);
+    double energyDrift = 0, energyDriftMax = 0;
+    long unconvergedSteps = 0;
+    bool converged;
+    auto writeState = [&](StateVector state) {
+        energyDrift = pendulum->getEnergy(state) - initialEnergy;
+        energyDriftMax = std::max(energyDriftMax, std::abs(energyDrift));
+        outFile << pendulum->getTextOutput(state);
+    };
+    auto reportEnergyDrift = [&]() {
+        std::cerr << "Energy drift (" << DoublePendulum::integratorToString(integrator) << "): max |E - E0| = "
+                  << energyDriftMax << " [J], final E - E0 = " << energyDrift << " [J]";
+        if (initialEnergy != 0) {
+            std::cerr << " (max relative " << energyDriftMax / std::abs(initialEnergy) << ")";
+        }
+        std::cerr << std::endl;
+        if (pendulum->isSymplectic()) {
+            std::cerr << "Steps not converged (" << DoublePendulum::integratorToString(integrator) << "): "
+                      << unconvergedSteps << ", done with RK4" << std::endl;
+        }
+    };
+
+    if (pendulum->isAdaptive()) {
+        // False if the integration stopped before the end.
+        bool completed = visitMath(pendulum->mathAccuracy, [&](auto math) {
+            return visitKernel(*pendulum, [&](const auto &kernel) {
+                DormandPrince54 solver(kernel, pendulum->rtol, pendulum->atol, math);
+                double tOut;
+
+                solver.reset(currState, 0, dt);
+                for (int i = 1; i < nStepMax; i++) {
+                    // Advance until the sampling time is covered by the last step...
+                    tOut = i * dt;
+                    while (solver.getTime() < tOut) {
+                        if (!solver.step((nStepMax - 1) * dt)) {
+                            std::cerr << "Step size underflow at t = " << solver.getTime() << " [s]!" << std::endl;
+                            return false;
+                        }
+                    }
+                    // ... and interpolate the state at that time.
+                    writeState(solver.denseOutput(tOut));
+                }
+                std::cerr << "Evaluations of the state equation: " << solver.getRhsEvaluations() << std::endl;
+                return true;
+            });
+        });
+        if (!completed) {
+            std::cerr << outFileName << " is truncated!" << std::endl;
+            return 1;
+        }
+        reportEnergyDrift();
+        return 0;
+    }
+
     for (int i = 0; i < nStepMax - 1; i++) {
-        nextState = pendulum->calcNextState(currState);
+        nextState = pendulum->calcNextState(currState, converged);
+        unconvergedSteps += !converged;
         
         for (int j = 0; j < pendulum->N_STATE_VARS; j++) {
             currState[j] = nextState[j];
         }
-        outFile << pendulum->getTextOutput(currState);
+        writeState(currState);
     }
+    reportEnergyDrift();
 }
\ No newline at end of file